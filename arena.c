@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "common.h"
+
+/*
+ * slab allocator for fixed size elements (chunks, marker) of a data
+ * set. Elements are handed out from large slabs and can't be freed
+ * individually - all of them are released with the arena.
+ *
+ * Arenas are reference counted to allow other data sets to share the
+ * elements.
+ */
+
+#define ARENA_SLAB_MAX	65536u	/* max elements per slab */
+
+#ifdef USE_PTHREAD
+/* data sets might share storage across threads - see srmio_pool_run() */
+static pthread_mutex_t arena_refs_lock = PTHREAD_MUTEX_INITIALIZER;
+# define ARENA_REFS_LOCK	pthread_mutex_lock( &arena_refs_lock )
+# define ARENA_REFS_UNLOCK	pthread_mutex_unlock( &arena_refs_lock )
+#else
+# define ARENA_REFS_LOCK
+# define ARENA_REFS_UNLOCK
+#endif
+
+struct _srmio_slab_t {
+	unsigned char	*base;
+	size_t		used;	/* elements */
+	size_t		avail;	/* elements */
+};
+
+/* address range of a slab - kept sorted for srmio_arena_owns() */
+struct _srmio_span_t {
+	const unsigned char	*base;
+	const unsigned char	*end;
+};
+
+struct _srmio_arena_t {
+	unsigned	refs;
+	size_t		esize;	/* element size */
+	size_t		next;	/* size of next slab in elements */
+
+	struct _srmio_slab_t	*slab;
+	struct _srmio_span_t	*span;	/* same count as slab */
+	size_t		sused;
+	size_t		savail;
+};
+
+/*
+ * allocate new arena for elements of esize bytes. The first slab is
+ * sized to hold "initial" elements.
+ *
+ * on success pointer is returned
+ * returns NULL on error and sets errno.
+ */
+srmio_arena_t srmio_arena_new( size_t esize, size_t initial, srmio_error_t *err )
+{
+	srmio_arena_t arena;
+
+	assert( esize );
+	assert( initial );
+
+	if( NULL == (arena = malloc( sizeof(struct _srmio_arena_t) ))){
+		srmio_error_errno( err, "new arena" );
+		return NULL;
+	}
+
+	memset( arena, 0, sizeof(struct _srmio_arena_t) );
+	arena->refs = 1;
+	arena->esize = esize;
+	arena->next = initial;
+
+	return arena;
+}
+
+/*
+ * get additional reference to arena
+ */
+srmio_arena_t srmio_arena_ref( srmio_arena_t arena )
+{
+	assert( arena );
+
+	ARENA_REFS_LOCK;
+	assert( arena->refs );
+	++arena->refs;
+	ARENA_REFS_UNLOCK;
+
+	return arena;
+}
+
+/*
+ * check if arena is referenced by more than one data set
+ */
+bool srmio_arena_shared( srmio_arena_t arena )
+{
+	unsigned refs;
+
+	if( ! arena )
+		return false;
+
+	ARENA_REFS_LOCK;
+	refs = arena->refs;
+	ARENA_REFS_UNLOCK;
+
+	return refs > 1;
+}
+
+/*
+ * drop reference. When the last one is gone, all slabs - and therefore
+ * all elements handed out - are released.
+ */
+void srmio_arena_free( srmio_arena_t arena )
+{
+	size_t i;
+	unsigned refs;
+
+	if( ! arena )
+		return;
+
+	ARENA_REFS_LOCK;
+	assert( arena->refs );
+	refs = --arena->refs;
+	ARENA_REFS_UNLOCK;
+
+	if( refs )
+		return;
+
+	for( i = 0; i < arena->sused; ++i )
+		free( arena->slab[i].base );
+
+	free( arena->slab );
+	free( arena->span );
+	free( arena );
+}
+
+/*
+ * make room for another slab
+ */
+static bool _srmio_arena_grow( srmio_arena_t arena, srmio_error_t *err )
+{
+	struct _srmio_slab_t *slab;
+	struct _srmio_span_t *span;
+
+	if( arena->sused < arena->savail )
+		return true;
+
+	if( NULL == (slab = realloc( arena->slab, (arena->savail + 8)
+		* sizeof(struct _srmio_slab_t) ))){
+
+		srmio_error_errno( err, "enlarge arena" );
+		return false;
+	}
+	arena->slab = slab;
+
+	if( NULL == (span = realloc( arena->span, (arena->savail + 8)
+		* sizeof(struct _srmio_span_t) ))){
+
+		srmio_error_errno( err, "enlarge arena" );
+		return false;
+	}
+	arena->span = span;
+
+	arena->savail += 8;
+	return true;
+}
+
+/*
+ * find first span with a base above p
+ */
+static size_t _srmio_arena_span_find( srmio_arena_t arena,
+	const unsigned char *p )
+{
+	size_t lo = 0, hi = arena->sused;
+
+	while( lo < hi ){
+		size_t mid = lo + (hi - lo) / 2;
+
+		if( arena->span[mid].base <= p )
+			lo = mid +1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * add address range of new slab. Room was made by _srmio_arena_grow()
+ * and the slab isn't counted in sused, yet.
+ */
+static void _srmio_arena_span_add( srmio_arena_t arena,
+	const unsigned char *base, size_t n )
+{
+	size_t i = _srmio_arena_span_find( arena, base );
+
+	memmove( &arena->span[i+1], &arena->span[i],
+		(arena->sused - i) * sizeof(struct _srmio_span_t) );
+	arena->span[i].base = base;
+	arena->span[i].end = base + n * arena->esize;
+}
+
+/*
+ * add new slab that can hold at least n elements
+ */
+static bool _srmio_arena_slab( srmio_arena_t arena, size_t n,
+	srmio_error_t *err )
+{
+	struct _srmio_slab_t *slab;
+	size_t avail = arena->next;
+
+	if( avail < n )
+		avail = n;
+
+	if( avail > SIZE_MAX / arena->esize ){
+		srmio_error_set( err, "arena slab too large" );
+		return false;
+	}
+
+	if( ! _srmio_arena_grow( arena, err ) )
+		return false;
+
+	slab = &arena->slab[arena->sused];
+	if( NULL == (slab->base = malloc( avail * arena->esize ))){
+		srmio_error_errno( err, "new arena slab" );
+		return false;
+	}
+	slab->used = 0;
+	slab->avail = avail;
+	_srmio_arena_span_add( arena, slab->base, avail );
+	++arena->sused;
+
+	/* grow geometrically */
+	if( arena->next < ARENA_SLAB_MAX )
+		arena->next *= 2;
+
+	return true;
+}
+
+/*
+ * get storage for n consecutive elements. Storage is uninitialized.
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+void *srmio_arena_alloc( srmio_arena_t arena, size_t n, srmio_error_t *err )
+{
+	struct _srmio_slab_t *slab;
+	void *ret;
+
+	assert( arena );
+	assert( n );
+
+	slab = arena->sused ? &arena->slab[arena->sused -1] : NULL;
+	if( ! slab || slab->avail - slab->used < n ){
+		if( ! _srmio_arena_slab( arena, n, err ) )
+			return NULL;
+
+		slab = &arena->slab[arena->sused -1];
+	}
+
+	ret = slab->base + slab->used * arena->esize;
+	slab->used += n;
+
+	return ret;
+}
+
+/*
+ * hand a malloc()ed array of n elements over to the arena. It's
+ * released with the arena.
+ *
+ * returns false on error - base is still owned by the caller then.
+ */
+bool srmio_arena_adopt( srmio_arena_t arena, void *base, size_t n,
+	srmio_error_t *err )
+{
+	struct _srmio_slab_t *slab;
+
+	assert( arena );
+	assert( base );
+	assert( n );
+
+	if( ! _srmio_arena_grow( arena, err ) )
+		return false;
+
+	_srmio_arena_span_add( arena, base, n );
+	slab = &arena->slab[arena->sused++];
+	slab->base = base;
+	slab->used = n;
+	slab->avail = n;
+
+	/* keep allocating from the previous slab */
+	if( arena->sused > 1 ){
+		struct _srmio_slab_t prev = slab[-1];
+
+		slab[-1] = *slab;
+		*slab = prev;
+	}
+
+	return true;
+}
+
+/*
+ * make sure, the next n elements are handed out from a single slab
+ *
+ * returns false on error
+ */
+bool srmio_arena_reserve( srmio_arena_t arena, size_t n, srmio_error_t *err )
+{
+	struct _srmio_slab_t *slab;
+
+	assert( arena );
+
+	if( ! n )
+		return true;
+
+	slab = arena->sused ? &arena->slab[arena->sused -1] : NULL;
+	if( slab && slab->avail - slab->used >= n )
+		return true;
+
+	return _srmio_arena_slab( arena, n, err );
+}
+
+/*
+ * check if element lies within this arena's storage. This is a binary
+ * search over the slabs' address ranges.
+ */
+bool srmio_arena_owns( srmio_arena_t arena, const void *elem )
+{
+	const unsigned char *p = elem;
+	size_t i;
+
+	if( ! arena || ! arena->sused )
+		return false;
+
+	if( 0 == (i = _srmio_arena_span_find( arena, p )))
+		return false;
+
+	return p < arena->span[i-1].end;
+}
+
@@ -50,6 +50,10 @@ bool buf_set_uint8( unsigned char *buf, size_t pos, uint16_t x )
 	return true;
 }
 
+/*
+ * fill the max bytes at pos with string. Longer strings are cut, the
+ * rest of the field is zeroed - also when string is NULL.
+ */
 bool buf_set_string( unsigned char *buf, size_t pos, const char *string, size_t max )
 {
 	size_t len;
@@ -60,11 +64,13 @@ bool buf_set_string( unsigned char *buf, size_t pos, const char *string, size_t
 	}
 
 	if( ! string ){
-		buf[pos] = 0;
+		memset( &buf[pos], 0, max );
 		return true;
 	}
 
 	len = strlen( string );
+	if( len > max )
+		len = max;
 	memcpy( &buf[pos], string, len );
 
 	if( len < max )
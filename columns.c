@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "common.h"
+
+#define COLUMNS_ALLOC	1024
+
+/*
+ * allocate empty columns
+ *
+ * on success pointer is returned
+ * returns NULL on error and sets errno.
+ */
+srmio_columns_t srmio_columns_new( srmio_error_t *err )
+{
+	srmio_columns_t cols;
+
+	if( NULL == (cols = malloc( sizeof(struct _srmio_columns_t) ))){
+		srmio_error_errno( err, "new columns" );
+		return NULL;
+	}
+
+	memset( cols, 0, sizeof(struct _srmio_columns_t) );
+	return cols;
+}
+
+/*
+ * free columns and all arrays held in it
+ */
+void srmio_columns_free( srmio_columns_t cols )
+{
+	if( ! cols )
+		return;
+
+	free( cols->time );
+	free( cols->dur );
+	free( cols->pwr );
+	free( cols->speed );
+	free( cols->cad );
+	free( cols->hr );
+	free( cols->ele );
+	free( cols->temp );
+	free( cols );
+}
+
+#define COLUMN_GROW( col, avail ) { \
+	void *tmp; \
+	if( NULL == (tmp = realloc( cols->col, (avail) * sizeof(*cols->col)))){ \
+		srmio_error_errno( err, "enlarge columns" ); \
+		return false; \
+	} \
+	cols->col = tmp; \
+	}
+
+/*
+ * make room for at least "avail" rows. Existing rows are kept.
+ *
+ * returns false on error
+ */
+bool srmio_columns_reserve( srmio_columns_t cols, unsigned avail,
+	srmio_error_t *err )
+{
+	assert( cols );
+
+	if( avail <= cols->avail )
+		return true;
+
+	COLUMN_GROW( time, avail );
+	COLUMN_GROW( dur, avail );
+	COLUMN_GROW( pwr, avail );
+	COLUMN_GROW( speed, avail );
+	COLUMN_GROW( cad, avail );
+	COLUMN_GROW( hr, avail );
+	COLUMN_GROW( ele, avail );
+	COLUMN_GROW( temp, avail );
+
+	cols->avail = avail;
+	return true;
+}
+
+/*
+ * append a copy of chunk's values to the columns
+ *
+ * returns false on error
+ */
+bool srmio_columns_add( srmio_columns_t cols, srmio_chunk_t chunk,
+	srmio_error_t *err )
+{
+	unsigned i;
+
+	assert( cols );
+	assert( chunk );
+
+	if( cols->used >= cols->avail ){
+		unsigned avail = cols->avail < COLUMNS_ALLOC
+			? COLUMNS_ALLOC : 2 * cols->avail;
+
+		if( avail < cols->avail ){
+			srmio_error_set( err, "too many chunks" );
+			return false;
+		}
+
+		if( ! srmio_columns_reserve( cols, avail, err ) )
+			return false;
+	}
+
+	i = cols->used++;
+	cols->time[i] = chunk->time;
+	cols->dur[i] = chunk->dur;
+	cols->pwr[i] = chunk->pwr;
+	cols->speed[i] = chunk->speed;
+	cols->cad[i] = chunk->cad;
+	cols->hr[i] = chunk->hr;
+	cols->ele[i] = chunk->ele;
+	cols->temp[i] = chunk->temp;
+
+	return true;
+}
+
+/*
+ * copy row i of the columns into the specified chunk
+ */
+void srmio_columns_get( srmio_columns_t cols, unsigned i, srmio_chunk_t chunk )
+{
+	assert( cols );
+	assert( i < cols->used );
+	assert( chunk );
+
+	chunk->time = cols->time[i];
+	chunk->dur = cols->dur[i];
+	chunk->pwr = cols->pwr[i];
+	chunk->speed = cols->speed[i];
+	chunk->cad = cols->cad[i];
+	chunk->hr = cols->hr[i];
+	chunk->ele = cols->ele[i];
+	chunk->temp = cols->temp[i];
+}
+
+/*
+ * copy data's chunks into columns (struct of arrays). The copy isn't
+ * updated when data changes - release it with srmio_columns_free()
+ * when you're done. Library functions iterate with
+ * srmio_data_chunk_get() instead, to avoid the copy.
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_columns_t srmio_data_columns( srmio_data_t data, srmio_error_t *err )
+{
+	srmio_columns_t cols;
+	unsigned i;
+
+	assert( data );
+
+	if( NULL == (cols = srmio_columns_new( err )))
+		return NULL;
+
+	if( ! srmio_columns_reserve( cols, data->cused, err ) )
+		goto clean1;
+
+	for( i = 0; i < data->cused; ++i ){
+		struct _srmio_chunk_t chunk;
+
+		srmio_data_chunk_get( data, i, &chunk );
+		if( ! srmio_columns_add( cols, &chunk, err ) )
+			goto clean1;
+	}
+
+	return cols;
+
+clean1:
+	srmio_columns_free( cols );
+	return NULL;
+}
@@ -72,6 +72,21 @@
 
 #include <stdarg.h>
 
+#if defined HAVE_MMAP && defined HAVE_SYS_MMAN_H
+# define USE_MMAP
+# include <sys/mman.h>
+#endif
+
+/* vector code must give same results as scalar SSE2 math */
+#if defined HAVE_X86_SIMD && defined __x86_64__
+# define USE_X86_SIMD
+#endif
+
+#if defined HAVE_LIBPTHREAD && defined HAVE_PTHREAD_H
+# define USE_PTHREAD
+# include <pthread.h>
+#endif
+
 #ifdef HAVE_WINDOWS_H
 # define UNICODE
 # include <windows.h>
@@ -185,6 +200,158 @@ uint32_t buf_get_buint32( const unsigned char *buf, size_t pos );
 bool buf_set_buint16( unsigned char *buf, size_t pos, uint32_t x );
 bool buf_set_buint32( unsigned char *buf, size_t pos, uint64_t x );
 
+/************************************************************
+ *
+ * from file_srm_simd.c
+ *
+ ************************************************************/
+
+typedef enum {
+	srmio_simd_none,
+	srmio_simd_sse2,
+	srmio_simd_avx2,
+} srmio_simd_t;
+
+srmio_simd_t srmio_simd_level( void );
+
+#ifdef USE_X86_SIMD
+unsigned srmio_file_chunks_srm6_sse2( srmio_chunk_t ck,
+	const unsigned char *buf, unsigned n, srmio_time_t time,
+	srmio_time_t recint );
+unsigned srmio_file_chunks_srm6_avx2( srmio_chunk_t ck,
+	const unsigned char *buf, unsigned n, srmio_time_t time,
+	srmio_time_t recint );
+unsigned srmio_file_chunks_srm7_sse2( srmio_chunk_t ck,
+	const unsigned char *buf, unsigned n, srmio_time_t time,
+	srmio_time_t recint );
+unsigned srmio_file_chunks_srm7_avx2( srmio_chunk_t ck,
+	const unsigned char *buf, unsigned n, srmio_time_t time,
+	srmio_time_t recint );
+#endif
+
+/************************************************************
+ *
+ * from arena.c
+ *
+ ************************************************************/
+
+typedef struct _srmio_arena_t *srmio_arena_t;
+
+srmio_arena_t srmio_arena_new( size_t esize, size_t initial, srmio_error_t *err );
+srmio_arena_t srmio_arena_ref( srmio_arena_t arena );
+bool srmio_arena_shared( srmio_arena_t arena );
+void srmio_arena_free( srmio_arena_t arena );
+void *srmio_arena_alloc( srmio_arena_t arena, size_t n, srmio_error_t *err );
+bool srmio_arena_reserve( srmio_arena_t arena, size_t n, srmio_error_t *err );
+bool srmio_arena_adopt( srmio_arena_t arena, void *base, size_t n,
+	srmio_error_t *err );
+bool srmio_arena_owns( srmio_arena_t arena, const void *elem );
+
+/************************************************************
+ *
+ * from data.c
+ *
+ ************************************************************/
+
+srmio_chunk_t srmio_data_chunk_clone( srmio_data_t data, srmio_chunk_t chunk,
+	srmio_error_t *err );
+srmio_marker_t srmio_data_marker_clone( srmio_data_t data,
+	srmio_marker_t marker, srmio_error_t *err );
+bool srmio_data_owns( srmio_data_t data, srmio_chunk_t chunk );
+srmio_chunk_t srmio_data_chunks_alloc( srmio_data_t data, size_t n,
+	srmio_error_t *err );
+bool srmio_data_add_chunksp( srmio_data_t data, srmio_chunk_t chunks,
+	size_t n, srmio_error_t *err );
+bool srmio_data_add_ownp( srmio_data_t data, srmio_chunk_t chunk,
+	srmio_error_t *err );
+void srmio_data_release_shared( srmio_data_t data );
+
+/************************************************************
+ *
+ * from columns.c
+ *
+ ************************************************************/
+
+srmio_columns_t srmio_columns_new( srmio_error_t *err );
+bool srmio_columns_reserve( srmio_columns_t cols, unsigned avail,
+	srmio_error_t *err );
+bool srmio_columns_add( srmio_columns_t cols, srmio_chunk_t chunk,
+	srmio_error_t *err );
+
+/************************************************************
+ *
+ * from mindex.c
+ *
+ ************************************************************/
+
+typedef struct _srmio_mindex_t *srmio_mindex_t;
+
+void srmio_mindex_free( srmio_mindex_t idx );
+void srmio_mindex_invalidate( srmio_mindex_t idx );
+void srmio_mindex_added( srmio_data_t data );
+bool srmio_mindex_shift( srmio_data_t data, unsigned pos,
+	unsigned delta, srmio_error_t *err );
+
+/************************************************************
+ *
+ * from tindex.c
+ *
+ ************************************************************/
+
+typedef struct _srmio_tindex_t *srmio_tindex_t;
+
+void srmio_tindex_free( srmio_tindex_t idx );
+void srmio_tindex_added( srmio_data_t data );
+
+/************************************************************
+ *
+ * from stats.c
+ *
+ ************************************************************/
+
+typedef struct _srmio_sums_t *srmio_sums_t;
+
+void srmio_sums_free( srmio_sums_t sums );
+void srmio_sums_invalidate( srmio_sums_t sums );
+void srmio_sums_added( srmio_data_t data, srmio_chunk_t chunk );
+
+/************************************************************
+ *
+ * from compact.c
+ *
+ ************************************************************/
+
+typedef struct _srmio_packed_t *srmio_packed_t;
+typedef void (*srmio_packed_get_t)( void *priv, unsigned i,
+	srmio_chunk_t chunk );
+typedef void (*srmio_packed_release_t)( void *priv );
+
+srmio_packed_t srmio_packed_new( unsigned used, srmio_packed_get_t get,
+	srmio_packed_release_t release, void *priv, srmio_error_t *err );
+void srmio_packed_free( srmio_packed_t packed );
+bool srmio_data_packed_set( srmio_data_t data, srmio_packed_t packed,
+	srmio_error_t *err );
+
+/************************************************************
+ *
+ * from fixup.c
+ *
+ ************************************************************/
+
+srmio_data_t srmio_fixup_data( srmio_fixup_t fx );
+
+/************************************************************
+ *
+ * from split.c
+ *
+ ************************************************************/
+
+bool srmio_split_at( srmio_time_t gap, srmio_time_t overlap,
+	srmio_chunk_t prev, srmio_chunk_t this );
+srmio_split_iter_t srmio_data_split_iter_blocks( srmio_data_t src,
+	const struct _srmio_block_t *block, unsigned cnt,
+	unsigned min_chunks, srmio_error_t *err );
+
 /************************************************************
  *
  * from list.c
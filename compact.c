@@ -0,0 +1,419 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "common.h"
+
+/*
+ * compact in-memory encoding of a data set's chunks. Values are stored
+ * with the resolution the devices deliver:
+ *
+ * time:	1/10 sec relative to base time
+ * dur:		1/10 sec
+ * pwr:		W
+ * speed:	mm/s
+ * temp:	1/10 deg C
+ * ele:		m
+ * cad:		1/min
+ * hr:		1/min
+ */
+struct _srmio_pchunk_t {
+	uint32_t	time;
+	uint16_t	dur;
+	uint16_t	pwr;
+	uint16_t	speed;
+	int16_t		temp;
+	int16_t		ele;
+	uint8_t		cad;
+	uint8_t		hr;
+};
+
+struct _srmio_packed_t {
+	unsigned		used;
+
+	/* fixed point chunks from srmio_data_compact() */
+	srmio_time_t		base;
+	struct _srmio_pchunk_t	*pk;
+
+	/* other encodings, see srmio_packed_new() */
+	srmio_packed_get_t	get;
+	srmio_packed_release_t	release;
+	void			*priv;
+};
+
+#define PACKED_SPEED	3.6	/* km/h -> mm/s: / 3.6 * 1000 */
+
+static long _srmio_round( double v )
+{
+	return v < 0 ? (long)(v - 0.5) : (long)(v + 0.5);
+}
+
+/*
+ * encode chunk's values, fail when they exceed the compact range
+ */
+static bool _srmio_packed_set( struct _srmio_pchunk_t *pk,
+	srmio_time_t base, srmio_chunk_t chunk )
+{
+	long speed = _srmio_round( chunk->speed * 1000 / PACKED_SPEED );
+	long temp = _srmio_round( chunk->temp * 10 );
+
+	if( chunk->time < base || chunk->time - base > UINT32_MAX )
+		return false;
+
+	if( chunk->dur > UINT16_MAX
+		|| chunk->pwr > UINT16_MAX
+		|| speed < 0 || speed > UINT16_MAX
+		|| temp < INT16_MIN || temp > INT16_MAX
+		|| chunk->ele < INT16_MIN || chunk->ele > INT16_MAX
+		|| chunk->cad > UINT8_MAX
+		|| chunk->hr > UINT8_MAX )
+
+		return false;
+
+	pk->time = chunk->time - base;
+	pk->dur = chunk->dur;
+	pk->pwr = chunk->pwr;
+	pk->speed = speed;
+	pk->temp = temp;
+	pk->ele = chunk->ele;
+	pk->cad = chunk->cad;
+	pk->hr = chunk->hr;
+
+	return true;
+}
+
+static void _srmio_packed_get( struct _srmio_pchunk_t *pk,
+	srmio_time_t base, srmio_chunk_t chunk )
+{
+	chunk->time = base + pk->time;
+	chunk->dur = pk->dur;
+	chunk->pwr = pk->pwr;
+	chunk->speed = (double)pk->speed * PACKED_SPEED / 1000;
+	chunk->temp = (double)pk->temp / 10;
+	chunk->ele = pk->ele;
+	chunk->cad = pk->cad;
+	chunk->hr = pk->hr;
+}
+
+/*
+ * decode chunk i
+ */
+static void _srmio_packed_chunk( srmio_packed_t packed, unsigned i,
+	srmio_chunk_t chunk )
+{
+	if( packed->get )
+		(*packed->get)( packed->priv, i, chunk );
+	else
+		_srmio_packed_get( &packed->pk[i], packed->base, chunk );
+}
+
+/*
+ * create compact chunks that are decoded by "get". This is used for
+ * encodings the library doesn't create itself - like a mapped file.
+ * "release" is called for priv when the chunks are freed. It's not
+ * called when this fails.
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_packed_t srmio_packed_new( unsigned used, srmio_packed_get_t get,
+	srmio_packed_release_t release, void *priv, srmio_error_t *err )
+{
+	srmio_packed_t packed;
+
+	assert( get );
+
+	if( NULL == (packed = malloc( sizeof(struct _srmio_packed_t) ))){
+		srmio_error_errno( err, "compact data" );
+		return NULL;
+	}
+	memset( packed, 0, sizeof(struct _srmio_packed_t) );
+
+	packed->used = used;
+	packed->get = get;
+	packed->release = release;
+	packed->priv = priv;
+
+	return packed;
+}
+
+/*
+ * release compact chunks
+ */
+void srmio_packed_free( srmio_packed_t packed )
+{
+	if( ! packed )
+		return;
+
+	if( packed->release )
+		(*packed->release)( packed->priv );
+	free( packed->pk );
+	free( packed );
+}
+
+/*
+ * drop all materialized chunks
+ */
+static bool _srmio_data_unmaterialize( srmio_data_t data, srmio_error_t *err )
+{
+	srmio_chunk_t *tmp;
+	unsigned i;
+
+	if( NULL == (tmp = malloc( sizeof(srmio_chunk_t) ))){
+		srmio_error_errno( err, "compact chunks" );
+		return false;
+	}
+	*tmp = NULL;
+
+	for( i=0; data->cforeign && i < data->cused; ++i ){
+		if( ! data->chunks[i] )
+			continue;
+
+		if( srmio_data_owns( data, data->chunks[i] ) )
+			continue;
+
+		srmio_chunk_free(data->chunks[i]);
+		--data->cforeign;
+	}
+	free( data->chunks );
+	data->chunks = tmp;
+	data->cavail = 0;
+
+	srmio_arena_free( data->carena );
+	data->carena = NULL;
+	srmio_data_release_shared( data );
+
+	srmio_data_changed( data );
+	return true;
+}
+
+/*
+ * switch data to a compact in-memory encoding of its chunks. This
+ * needs about a quarter of the memory, but resolution is reduced to
+ * what the devices deliver. Fails when chunks exceed the compact value
+ * range - data is unchanged in this case.
+ *
+ * Chunks are accessed with srmio_data_chunk() or
+ * srmio_data_chunk_get(), srmio_data_expand() goes back to the full
+ * representation. Other library functions handle compact data
+ * transparently.
+ *
+ * returns false on error
+ */
+bool srmio_data_compact( srmio_data_t data, srmio_error_t *err )
+{
+	srmio_packed_t packed;
+	srmio_time_t base;
+	unsigned i;
+
+	assert( data );
+
+	if( data->packed && ! data->cavail )
+		return true;
+
+	if( NULL == (packed = malloc( sizeof(struct _srmio_packed_t) ))){
+		srmio_error_errno( err, "compact data" );
+		return false;
+	}
+	memset( packed, 0, sizeof(struct _srmio_packed_t) );
+	packed->used = data->cused;
+
+	if( data->cused && NULL == (packed->pk = malloc( data->cused
+		* sizeof(struct _srmio_pchunk_t) ))){
+
+		srmio_error_errno( err, "compact chunks" );
+		goto clean1;
+	}
+
+	/* time offsets are relative to the earliest chunk */
+	base = 0;
+	for( i = 0; i < data->cused; ++i ){
+		struct _srmio_chunk_t chunk;
+
+		srmio_data_chunk_get( data, i, &chunk );
+		if( ! i || chunk.time < base )
+			base = chunk.time;
+	}
+	packed->base = base;
+
+	for( i = 0; i < data->cused; ++i ){
+		struct _srmio_chunk_t chunk;
+
+		srmio_data_chunk_get( data, i, &chunk );
+		if( ! _srmio_packed_set( &packed->pk[i], base, &chunk ) ){
+			srmio_error_set( err, "chunk %u exceeds compact range", i );
+			goto clean1;
+		}
+	}
+
+	if( ! _srmio_data_unmaterialize( data, err ) )
+		goto clean1;
+
+	srmio_packed_free( data->packed );
+	data->packed = packed;
+
+	return true;
+
+clean1:
+	srmio_packed_free( packed );
+	return false;
+}
+
+/*
+ * replace data's chunks with the compact ones. data takes over packed
+ * on success. Like after srmio_data_compact(), data->chunks only holds
+ * the chunks materialized by srmio_data_chunk().
+ *
+ * returns false on error
+ */
+bool srmio_data_packed_set( srmio_data_t data, srmio_packed_t packed,
+	srmio_error_t *err )
+{
+	assert( data );
+	assert( packed );
+
+	if( ! _srmio_data_unmaterialize( data, err ) )
+		return false;
+
+	srmio_packed_free( data->packed );
+	data->packed = packed;
+	data->cused = packed->used;
+
+	return true;
+}
+
+/*
+ * make data->chunks hold an entry for each chunk. Entries of chunks
+ * that weren't materialized yet are NULL.
+ */
+static bool _srmio_data_index( srmio_data_t data, srmio_error_t *err )
+{
+	srmio_chunk_t *tmp;
+
+	if( data->cavail >= data->cused )
+		return true;
+
+	if( NULL == (tmp = calloc( data->cused +1, sizeof(srmio_chunk_t) ))){
+		srmio_error_errno( err, "compact chunk index" );
+		return false;
+	}
+
+	free( data->chunks );
+	data->chunks = tmp;
+	data->cavail = data->cused;
+	return true;
+}
+
+/*
+ * get pointer to chunk i. For compact data the chunk is decoded on
+ * first access. Changes to it are picked up by the next
+ * srmio_data_compact().
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_chunk_t srmio_data_chunk( srmio_data_t data, unsigned i,
+	srmio_error_t *err )
+{
+	srmio_chunk_t chunk;
+
+	assert( data );
+
+	if( i >= data->cused ){
+		srmio_error_set( err, "chunk %u out of range", i );
+		return NULL;
+	}
+
+	if( ! data->packed )
+		return data->chunks[i];
+
+	if( ! _srmio_data_index( data, err ) )
+		return NULL;
+
+	if( data->chunks[i] )
+		return data->chunks[i];
+
+	if( NULL == (chunk = srmio_data_chunk_new( data, err )))
+		return NULL;
+
+	_srmio_packed_chunk( data->packed, i, chunk );
+	data->chunks[i] = chunk;
+
+	return chunk;
+}
+
+/*
+ * copy values of chunk i to the specified chunk. Doesn't allocate
+ * anything - even for compact data.
+ */
+void srmio_data_chunk_get( srmio_data_t data, unsigned i, srmio_chunk_t chunk )
+{
+	assert( data );
+	assert( i < data->cused );
+	assert( chunk );
+
+	if( data->packed && ( data->cavail < data->cused
+		|| ! data->chunks[i] )){
+
+		_srmio_packed_chunk( data->packed, i, chunk );
+		return;
+	}
+
+	memcpy( chunk, data->chunks[i], sizeof(struct _srmio_chunk_t) );
+}
+
+/*
+ * go back from compact encoding to individually allocated chunks.
+ * Nothing is done for data that isn't compact.
+ *
+ * returns false on error
+ */
+bool srmio_data_expand( srmio_data_t data, srmio_error_t *err )
+{
+	unsigned i;
+
+	assert( data );
+
+	if( ! data->packed )
+		return true;
+
+	if( ! _srmio_data_index( data, err ) )
+		return false;
+
+	if( data->cused && ! data->carena && NULL == (data->carena =
+		srmio_arena_new( sizeof(struct _srmio_chunk_t),
+		data->cused, err )))
+
+		return false;
+
+	if( data->cused && ! srmio_arena_reserve( data->carena,
+		data->cused, err ))
+
+		return false;
+
+	for( i = 0; i < data->cused; ++i ){
+		if( ! srmio_data_chunk( data, i, err ) )
+			return false;
+	}
+
+	srmio_packed_free( data->packed );
+	data->packed = NULL;
+
+	return true;
+}
+
+/*
+ * check if data uses the compact encoding
+ */
+bool srmio_data_is_compact( srmio_data_t data )
+{
+	assert( data );
+
+	return data->packed != NULL;
+}
+
@@ -74,43 +74,643 @@ srmio_data_t srmio_data_header( srmio_data_t src, srmio_error_t *err )
 	dst->zeropos = src->zeropos;
 	dst->circum = src->circum;
 
+	if( src->sums && ! srmio_data_stats_enable( dst, err ) )
+		goto clean1;
+
 	return dst;
 clean1:
 	srmio_data_free(dst);
 	return NULL;
 }
 
+#define DATA_CHUNK_SLAB		1024
+#define DATA_MARKER_SLAB	32
+
+/*
+ * get uninitialized storage for n consecutive chunks that's owned by
+ * data.
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_chunk_t srmio_data_chunks_alloc( srmio_data_t data, size_t n,
+	srmio_error_t *err )
+{
+	if( ! data->carena && NULL == (data->carena = srmio_arena_new(
+		sizeof(struct _srmio_chunk_t), DATA_CHUNK_SLAB, err )))
+
+		return NULL;
+
+	return srmio_arena_alloc( data->carena, n, err );
+}
+
+/*
+ * allocate and initialize new chunk that's owned by data. It's
+ * released together with data - don't free it yourself. You still
+ * have to add it with srmio_data_add_chunkp().
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_chunk_t srmio_data_chunk_new( srmio_data_t data, srmio_error_t *err )
+{
+	srmio_chunk_t tmp;
+
+	assert( data );
+
+	if( NULL == (tmp = srmio_data_chunks_alloc( data, 1, err )))
+		return NULL;
+
+	memset( tmp, 0, sizeof(struct _srmio_chunk_t));
+	return tmp;
+}
+
+/*
+ * copy chunk to new one that's owned by data.
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_chunk_t srmio_data_chunk_clone( srmio_data_t data, srmio_chunk_t chunk,
+	srmio_error_t *err )
+{
+	srmio_chunk_t tmp;
+
+	assert( data );
+	assert( chunk );
+
+	if( NULL == (tmp = srmio_data_chunks_alloc( data, 1, err )))
+		return NULL;
+
+	memcpy( tmp, chunk, sizeof(struct _srmio_chunk_t));
+	return tmp;
+}
+
+/*
+ * allocate and initialize new marker that's owned by data. It's
+ * released together with data - don't free it yourself. You still
+ * have to add it with srmio_data_add_markerp().
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_marker_t srmio_data_marker_new( srmio_data_t data, srmio_error_t *err )
+{
+	srmio_marker_t tmp;
+
+	assert( data );
+
+	if( ! data->marena && NULL == (data->marena = srmio_arena_new(
+		sizeof(struct _srmio_marker_t), DATA_MARKER_SLAB, err )))
+
+		return NULL;
+
+	if( NULL == (tmp = srmio_arena_alloc( data->marena, 1, err )))
+		return NULL;
+
+	memset( tmp, 0, sizeof(struct _srmio_marker_t));
+	return tmp;
+}
+
+/*
+ * copy marker to new one that's owned by data.
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_marker_t srmio_data_marker_clone( srmio_data_t data,
+	srmio_marker_t marker, srmio_error_t *err )
+{
+	srmio_marker_t tmp;
+
+	assert( marker );
+
+	if( NULL == (tmp = srmio_data_marker_new( data, err )))
+		return NULL;
+
+	tmp->first = marker->first;
+	tmp->last = marker->last;
+
+	if( marker->notes && NULL == (tmp->notes = strdup( marker->notes ))){
+		srmio_error_errno( err, "marker clone notes" );
+		return NULL;
+	}
+
+	return tmp;
+}
+
+
+/*
+ * next size for geometrically growing arrays
+ */
+static unsigned _srmio_data_grow( unsigned avail, unsigned min )
+{
+	if( avail < min )
+		return min;
+
+	if( avail > (UINT_MAX -1) / 2 )
+		return UINT_MAX -1;
+
+	return 2 * avail;
+}
+
+/*
+ * resize chunk list to hold avail chunks (+ NULL terminator)
+ */
+static bool _srmio_data_chunks_resize( srmio_data_t data, unsigned avail,
+	srmio_error_t *err )
+{
+	srmio_chunk_t *tmp;
+
+	if( avail <= data->cavail ){
+		srmio_error_set( err, "too many chunks" );
+		return false;
+	}
+
+	if( NULL == (tmp = realloc( data->chunks,
+		((size_t)avail + 1) * sizeof(srmio_chunk_t)))){
+		srmio_error_errno( err, "enlarge data chunks" );
+		return false;
+	}
+
+	data->cavail = avail;
+	data->chunks = tmp;
+	return true;
+}
+
+/*
+ * resize marker list to hold avail marker (+ NULL terminator)
+ */
+static bool _srmio_data_marker_resize( srmio_data_t data, unsigned avail,
+	srmio_error_t *err )
+{
+	srmio_marker_t *tmp;
+
+	if( avail <= data->mavail ){
+		srmio_error_set( err, "too many marker");
+		return false;
+	}
+
+	if( NULL == (tmp = realloc( data->marker,
+		((size_t)avail + 1) * sizeof(srmio_marker_t)))){
+		srmio_error_errno( err, "enlarge data marker" );
+		return false;
+	}
+
+	data->mavail = avail;
+	data->marker = tmp;
+	return true;
+}
+
+/*
+ * preallocate memory for a total of "chunks" chunks and "markers"
+ * marker. Use this when you know in advance how much data you're going
+ * to add.
+ *
+ * Compact data stays compact, only marker are reserved. Adding chunks
+ * expands it anyway, see srmio_data_compact() - call
+ * srmio_data_expand() first when you want the chunks reserved.
+ *
+ * returns false on error
+ */
+bool srmio_data_reserve( srmio_data_t data, unsigned chunks, unsigned markers,
+	srmio_error_t *err )
+{
+	assert( data );
+
+	if( data->packed )
+		goto marker;
+
+	if( chunks > data->cavail ){
+		if( ! _srmio_data_chunks_resize( data, chunks, err ) )
+			return false;
+	}
+
+	if( chunks > data->cused ){
+		if( ! data->carena && NULL == (data->carena = srmio_arena_new(
+			sizeof(struct _srmio_chunk_t), DATA_CHUNK_SLAB, err )))
+
+			return false;
+
+		if( ! srmio_arena_reserve( data->carena,
+			chunks - data->cused, err ))
+
+			return false;
+	}
+
+marker:
+	if( markers > data->mavail ){
+		if( ! _srmio_data_marker_resize( data, markers, err ) )
+			return false;
+	}
+
+	if( markers > data->mused ){
+		if( ! data->marena && NULL == (data->marena = srmio_arena_new(
+			sizeof(struct _srmio_marker_t), DATA_MARKER_SLAB, err )))
+
+			return false;
+
+		if( ! srmio_arena_reserve( data->marena,
+			markers - data->mused, err ))
+
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * check if chunk lives in data's own or shared storage - and therefore
+ * isn't released individually.
+ */
+bool srmio_data_owns( srmio_data_t data, srmio_chunk_t chunk )
+{
+	unsigned i;
+
+	if( srmio_arena_owns( data->carena, chunk ) )
+		return true;
+
+	for( i = 0; i < data->sused; ++i ){
+		if( srmio_arena_owns( data->shared[i], chunk ) )
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * make room to append n chunk pointers
+ */
+static bool _srmio_data_append_prepare( srmio_data_t data, size_t n,
+	srmio_error_t *err )
+{
+	unsigned avail;
+
+	if( ! srmio_data_expand( data, err ) )
+		return false;
+
+	if( n >= UINT_MAX -1 - data->cused ){
+		srmio_error_set( err, "too many chunks" );
+		return false;
+	}
+
+	if( data->cused + n <= data->cavail )
+		return true;
+
+	avail = _srmio_data_grow( data->cavail, DATA_CHUNK_SLAB );
+	if( avail < data->cused + n )
+		avail = data->cused + n;
+
+	return _srmio_data_chunks_resize( data, avail, err );
+}
+
+/*
+ * append chunk pointer to list and update indices. Room must have been
+ * made with _srmio_data_append_prepare(). The list isn't terminated.
+ */
+static void _srmio_data_append_one( srmio_data_t data, srmio_chunk_t chunk )
+{
+	data->chunks[data->cused++] = chunk;
+
+	srmio_tindex_added( data );
+	srmio_sums_added( data, chunk );
+}
+
+/*
+ * append pointers to n consecutive chunks to list. Room must have been
+ * made with _srmio_data_append_prepare().
+ */
+static void _srmio_data_append_array( srmio_data_t data, srmio_chunk_t chunks,
+	size_t n )
+{
+	size_t i;
+
+	for( i = 0; i < n; ++i )
+		_srmio_data_append_one( data, &chunks[i] );
+
+	data->chunks[data->cused] = NULL;
+}
+
+/*
+ * append chunk pointer to list
+ */
+static bool _srmio_data_append( srmio_data_t data, srmio_chunk_t chunk,
+	srmio_error_t *err )
+{
+	if( ! _srmio_data_append_prepare( data, 1, err ) )
+		return false;
+
+	_srmio_data_append_array( data, chunk, 1 );
+	return true;
+}
 
 /*
  * add chunk to end of data's chunk list. Extends list when necessary.
- * Chunk is not copied.
+ * Chunk is not copied. Chunks allocated with srmio_chunk_new() are
+ * freed with data.
  *
  * on success 0 is returned
  * returns -1 and sets errno on error
  */
 bool srmio_data_add_chunkp( srmio_data_t data, srmio_chunk_t chunk, srmio_error_t *err )
 {
-	if( data->cused >= data->cavail ){
-		srmio_chunk_t *tmp;
+	bool foreign = ! srmio_data_owns( data, chunk );
+
+	if( ! _srmio_data_append( data, chunk, err ) )
+		return false;
+
+	if( foreign )
+		++data->cforeign;
+
+	return true;
+}
+
+/*
+ * add chunk from srmio_data_chunk_new() or srmio_data_chunk_clone() to
+ * end of data's chunk list. Unlike srmio_data_add_chunkp() this doesn't
+ * need to look up who owns the chunk.
+ *
+ * returns false on error
+ */
+bool srmio_data_add_ownp( srmio_data_t data, srmio_chunk_t chunk,
+	srmio_error_t *err )
+{
+	return _srmio_data_append( data, chunk, err );
+}
+
+/*
+ * keep storage of src's chunks alive for dst
+ */
+static bool _srmio_data_share( srmio_data_t dst, srmio_data_t src,
+	srmio_error_t *err )
+{
+	unsigned i;
+
+	for( i = 0; i <= src->sused; ++i ){
+		srmio_arena_t arena = i < src->sused
+			? src->shared[i] : src->carena;
+		srmio_arena_t *tmp;
+		unsigned j;
+
+		if( ! arena || arena == dst->carena )
+			continue;
+
+		for( j = 0; j < dst->sused; ++j )
+			if( dst->shared[j] == arena )
+				break;
 
-		if( data->cavail > UINT_MAX - 1001 ){
-			srmio_error_set( err, "too many chunks" );
+		if( j < dst->sused )
+			continue;
+
+		if( NULL == (tmp = realloc( dst->shared,
+			(dst->sused +1) * sizeof(srmio_arena_t) ))){
+
+			srmio_error_errno( err, "share chunks" );
 			return false;
 		}
 
-		if( NULL == (tmp = realloc( data->chunks,
-			(data->cavail + 1001) * sizeof(srmio_chunk_t)))){
-			srmio_error_errno( err, "enlarge data chunks" );
-			return false;
+		dst->shared = tmp;
+		dst->shared[dst->sused++] = srmio_arena_ref( arena );
+	}
+
+	return true;
+}
+
+/*
+ * add chunk i of src to dst without copying it. The chunk's storage is
+ * shared by both data sets until it's modified - see
+ * srmio_data_chunk_unshare(). Falls back to copying the chunk when src
+ * doesn't allow sharing it.
+ *
+ * returns false on error
+ */
+bool srmio_data_add_chunkref( srmio_data_t dst, srmio_data_t src,
+	unsigned i, srmio_error_t *err )
+{
+	srmio_chunk_t chunk;
+
+	assert( dst );
+	assert( src );
+	assert( i < src->cused );
+
+	if( src->packed ){
+		struct _srmio_chunk_t tmp;
+
+		srmio_data_chunk_get( src, i, &tmp );
+		return srmio_data_add_chunk( dst, &tmp, err );
+	}
+
+	chunk = src->chunks[i];
+	if( src->cforeign && ! srmio_data_owns( src, chunk ) )
+		return srmio_data_add_chunk( dst, chunk, err );
+
+	if( ! _srmio_data_share( dst, src, err ) )
+		return false;
+
+	return _srmio_data_append( dst, chunk, err );
+}
+
+/*
+ * add n chunks of src starting at "first" to dst without copying them.
+ * Like calling srmio_data_add_chunkref() for each of them, but src's
+ * storage is only looked at once.
+ *
+ * returns false on error
+ */
+bool srmio_data_add_chunkrefs( srmio_data_t dst, srmio_data_t src,
+	unsigned first, unsigned n, srmio_error_t *err )
+{
+	unsigned i;
+
+	assert( dst );
+	assert( src );
+	assert( dst != src );
+	assert( first <= src->cused && n <= src->cused - first );
+
+	if( ! n )
+		return true;
+
+	if( src->packed || src->cforeign ){
+		for( i = first; i < first + n; ++i ){
+			if( ! srmio_data_add_chunkref( dst, src, i, err ))
+				return false;
 		}
 
-		data->cavail += 1000;
-		data->chunks = tmp;
+		return true;
+	}
+
+	if( ! _srmio_data_share( dst, src, err ) )
+		return false;
+
+	if( ! _srmio_data_append_prepare( dst, n, err ) )
+		return false;
+
+	for( i = first; i < first + n; ++i )
+		_srmio_data_append_one( dst, src->chunks[i] );
+
+	dst->chunks[dst->cused] = NULL;
+	return true;
+}
+
+/*
+ * create data set with src's header and a range of its chunks. Chunks
+ * are shared with src - see srmio_data_add_chunkref(). Marker
+ * overlapping the range are copied and clipped to it.
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_data_t srmio_data_slice( srmio_data_t src, unsigned first,
+	unsigned last, srmio_error_t *err )
+{
+	srmio_data_t dst;
+	srmio_marker_t *marker = NULL;
+	unsigned i;
+
+	assert( src );
+
+	if( first > last || last >= src->cused ){
+		srmio_error_set( err, "slice out of range: %u-%u, used=%u",
+			first, last, src->cused );
+		return NULL;
+	}
+
+	if( NULL == (dst = srmio_data_header( src, err )))
+		return NULL;
+
+	if( ! _srmio_data_chunks_resize( dst, last - first +1, err ))
+		goto clean1;
+
+	if( ! srmio_data_add_chunkrefs( dst, src, first, last - first +1, err ))
+		goto clean1;
+
+	if( NULL == (marker = srmio_data_markers_range( src, first, last, err )))
+		goto clean1;
+
+	for( i = 0; marker[i]; ++i ){
+		srmio_marker_t mk;
+
+		if( NULL == (mk = srmio_data_marker_clone( dst, marker[i], err )))
+			goto clean1;
+
+		mk->first = mk->first < first ? 0 : mk->first - first;
+		mk->last = mk->last > last ? last - first : mk->last - first;
+
+		if( ! srmio_data_add_markerp( dst, mk, err ))
+			goto clean1;
+	}
+	free( marker );
+
+	return dst;
+
+clean1:
+	free( marker );
+	srmio_data_free( dst );
+	return NULL;
+}
+
+/*
+ * own chunk storage is referenced by slices: keep it as shared storage
+ * and allocate new chunks from a fresh arena. This way the chunks
+ * referenced by slices are copied before they're modified.
+ *
+ * returns false on error
+ */
+static bool _srmio_data_detach( srmio_data_t data, srmio_error_t *err )
+{
+	srmio_arena_t *tmp;
+
+	if( ! srmio_arena_shared( data->carena ) )
+		return true;
+
+	if( NULL == (tmp = realloc( data->shared,
+		(data->sused +1) * sizeof(srmio_arena_t) ))){
+
+		srmio_error_errno( err, "detach chunks" );
+		return false;
+	}
+
+	data->shared = tmp;
+	data->shared[data->sused++] = data->carena;
+	data->carena = NULL;
+
+	return true;
+}
+
+/*
+ * get chunk i for modification. When its storage is shared with other
+ * data sets - in either direction - it's copied first.
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_chunk_t srmio_data_chunk_unshare( srmio_data_t data, unsigned i,
+	srmio_error_t *err )
+{
+	srmio_chunk_t chunk;
+	unsigned s;
+
+	if( ! _srmio_data_detach( data, err ) )
+		return NULL;
+
+	if( NULL == (chunk = srmio_data_chunk( data, i, err )))
+		return NULL;
+
+	if( ! data->sused || srmio_arena_owns( data->carena, chunk ) )
+		return chunk;
+
+	for( s = 0; s < data->sused; ++s ){
+		if( ! srmio_arena_owns( data->shared[s], chunk ) )
+			continue;
+
+		if( NULL == (chunk = srmio_data_chunk_clone( data, chunk, err )))
+			return NULL;
+
+		data->chunks[i] = chunk;
+		break;
 	}
 
-	data->chunks[data->cused] = chunk;
-	data->chunks[++ data->cused] = NULL;
+	return chunk;
+}
+
+/*
+ * drop references to other data set's storage
+ */
+void srmio_data_release_shared( srmio_data_t data )
+{
+	unsigned i;
+
+	for( i = 0; i < data->sused; ++i )
+		srmio_arena_free( data->shared[i] );
 
+	free( data->shared );
+	data->shared = NULL;
+	data->sused = 0;
+}
+
+/*
+ * copy all chunks that are shared with other data sets.
+ *
+ * returns false on error
+ */
+bool srmio_data_unshare( srmio_data_t data, srmio_error_t *err )
+{
+	unsigned i;
+
+	assert( data );
+
+	if( ! _srmio_data_detach( data, err ) )
+		return false;
+
+	if( ! data->sused )
+		return true;
+
+	for( i = 0; i < data->cused; ++i ){
+		if( ! srmio_data_chunk_unshare( data, i, err ) )
+			return false;
+	}
+
+	srmio_data_release_shared( data );
 	return true;
 }
 
@@ -124,41 +724,113 @@ bool srmio_data_add_chunk( srmio_data_t data, srmio_chunk_t chunk, srmio_error_t
 {
 	srmio_chunk_t nc;
 
-	if( NULL == (nc = srmio_chunk_clone(chunk, err)))
+	if( NULL == (nc = srmio_data_chunk_clone( data, chunk, err)))
+		return false;
+	return srmio_data_add_ownp( data, nc, err );
+}
+
+/*
+ * add copies of n consecutive chunks to end of data's chunk list. Use
+ * this instead of srmio_data_add_chunk() when you've got several chunks
+ * at once.
+ *
+ * returns false on error
+ */
+bool srmio_data_add_chunks( srmio_data_t data,
+	const struct _srmio_chunk_t *src, size_t n, srmio_error_t *err )
+{
+	srmio_chunk_t chunks;
+
+	assert( data );
+	assert( src || ! n );
+
+	if( ! n )
+		return true;
+
+	if( NULL == (chunks = srmio_data_chunks_alloc( data, n, err )))
+		return false;
+
+	memcpy( chunks, src, n * sizeof(struct _srmio_chunk_t) );
+
+	return srmio_data_add_chunksp( data, chunks, n, err );
+}
+
+/*
+ * add n consecutive chunks from srmio_data_chunks_alloc() to end of
+ * data's chunk list.
+ *
+ * returns false on error
+ */
+bool srmio_data_add_chunksp( srmio_data_t data, srmio_chunk_t chunks,
+	size_t n, srmio_error_t *err )
+{
+	if( ! _srmio_data_append_prepare( data, n, err ) )
+		return false;
+
+	_srmio_data_append_array( data, chunks, n );
+	return true;
+}
+
+/*
+ * add n consecutive chunks to end of data's chunk list without copying
+ * them. src must be allocated with malloc(). On success data takes
+ * ownership of it - it's freed with data. On failure it's still owned
+ * by the caller.
+ *
+ * returns false on error
+ */
+bool srmio_data_add_chunks_move( srmio_data_t data, srmio_chunk_t src,
+	size_t n, srmio_error_t *err )
+{
+	assert( data );
+	assert( src );
+
+	if( ! n ){
+		free( src );
+		return true;
+	}
+
+	if( ! _srmio_data_append_prepare( data, n, err ) )
 		return false;
-	return srmio_data_add_chunkp( data, nc, err );
+
+	if( ! data->carena && NULL == (data->carena = srmio_arena_new(
+		sizeof(struct _srmio_chunk_t), DATA_CHUNK_SLAB, err )))
+
+		return false;
+
+	if( ! srmio_arena_adopt( data->carena, src, n, err ) )
+		return false;
+
+	_srmio_data_append_array( data, src, n );
+
+	return true;
 }
 
 /*
  * add marker to end of data's marker list. Extends list when necessary.
- * Marker is not copied.
+ * Marker is not copied. Markers allocated with srmio_marker_new() are
+ * freed with data.
  *
  * on success 0 is returned
  * returns -1 and sets errno on error
  */
 bool srmio_data_add_markerp( srmio_data_t data, srmio_marker_t mk, srmio_error_t *err )
 {
-	if( data->mused >= data->mavail ){
-		srmio_marker_t *tmp;
+	/* pending shifts don't apply to new marker */
+	srmio_data_marker_sync( data );
 
-		if( data->mavail > UINT_MAX - 11 ){
-			srmio_error_set( err, "too many marker");
-			return false;
-		}
+	if( data->mused >= data->mavail ){
+		if( ! _srmio_data_marker_resize( data,
+			_srmio_data_grow( data->mavail, DATA_MARKER_SLAB ), err ))
 
-		if( NULL == (tmp = realloc( data->marker,
-			(data->mavail + 11) * sizeof(srmio_marker_t)))){
-			srmio_error_errno( err, "enlarge data marker" );
 			return false;
-		}
-
-		data->mavail += 10;
-		data->marker = tmp;
 	}
 
 	data->marker[data->mused] = mk;
 	data->marker[++ data->mused] = NULL;
 
+	srmio_mindex_added( data );
+
 	return true;
 }
 
@@ -193,19 +865,12 @@ bool srmio_data_add_marker( srmio_data_t data, unsigned first, unsigned last, sr
 		return false;
 	}
 
-	if( NULL == (mk = srmio_marker_new( err ) ))
+	if( NULL == (mk = srmio_data_marker_new( data, err ) ))
 		return false;
 	mk->first = first;
 	mk->last = last;
 
-	if( ! srmio_data_add_markerp( data, mk, err ) )
-		goto clean1;
-
-	return true;
-
-clean1:
-	free(mk);
-	return false;
+	return srmio_data_add_markerp( data, mk, err );
 }
 
 
@@ -214,6 +879,8 @@ clean1:
  */
 bool srmio_data_time_start( srmio_data_t data, srmio_time_t *start, srmio_error_t *err )
 {
+	struct _srmio_chunk_t first;
+
 	assert( data );
 	assert( start );
 
@@ -222,12 +889,15 @@ bool srmio_data_time_start( srmio_data_t data, srmio_time_t *start, srmio_error_
 		return false;
 	}
 
-	*start = data->chunks[0]->time;
+	srmio_data_chunk_get( data, 0, &first );
+	*start = first.time;
 	return true;
 }
 
 bool srmio_data_time_end( srmio_data_t data, srmio_time_t *end, srmio_error_t *err )
 {
+	struct _srmio_chunk_t last;
+
 	assert( data );
 	assert( end );
 
@@ -236,8 +906,8 @@ bool srmio_data_time_end( srmio_data_t data, srmio_time_t *end, srmio_error_t *e
 		return false;
 	}
 
-	*end = data->chunks[data->cused -1]->time
-		+ data->chunks[data->cused -1]->dur;
+	srmio_data_chunk_get( data, data->cused -1, &last );
+	*end = last.time + last.dur;
 	return true;
 }
 
@@ -247,6 +917,8 @@ bool srmio_data_time_end( srmio_data_t data, srmio_time_t *end, srmio_error_t *e
  */
 bool srmio_data_recint( srmio_data_t data, srmio_time_t *recint, srmio_error_t *err )
 {
+	struct _srmio_chunk_t last;
+
 	assert( data );
 	assert( recint );
 
@@ -255,14 +927,16 @@ bool srmio_data_recint( srmio_data_t data, srmio_time_t *recint, srmio_error_t *
 		return false;
 	}
 
-	*recint = data->chunks[data->cused-1]->dur;
+	srmio_data_chunk_get( data, data->cused -1, &last );
+	*recint = last.dur;
 	return true;
 }
 
 
 /*
  * find gaps in chunklist (non-continuos time), allocate and build list
- * with marker identifying the continuos blocks.
+ * with marker identifying the continuos blocks. See
+ * srmio_data_block_list() for a cheaper alternative.
  *
  * parameters:
  *  data: the data structure to check
@@ -272,81 +946,52 @@ bool srmio_data_recint( srmio_data_t data, srmio_time_t *recint, srmio_error_t *
  */
 srmio_marker_t *srmio_data_blocks( srmio_data_t data, srmio_error_t *err )
 {
+	const struct _srmio_block_t *list;
 	srmio_marker_t *blocks;
-	unsigned avail = 10;
-	unsigned used = 1;
+	unsigned cnt;
 	unsigned i;
 
-	if( data->cused < 1 ){
-		srmio_error_set( err, "no data available");
+	if( NULL == (list = srmio_data_block_list( data, &cnt, err )))
 		return NULL;
-	}
 
-	if( NULL == (blocks = malloc( (1+ avail) * (sizeof(srmio_marker_t))))){
+	if( NULL == (blocks = malloc( (1+ cnt) * (sizeof(srmio_marker_t))))){
 		srmio_error_errno( err, "data blocks" );
 		return NULL;
 	}
 
-	if( NULL == (*blocks = srmio_marker_new( err )))
-		goto clean1;
-	blocks[0]->first = 0;
-	blocks[0]->last = data->cused -1;
-	blocks[1] = NULL;
-
-	for( i=1; i < data->cused; ++i ){
-		srmio_chunk_t prev = data->chunks[i-1];
-		srmio_chunk_t this = data->chunks[i];
-
-		if( prev->time + prev->dur != this->time ){
-
-			if( used >= avail ){
-				srmio_marker_t *tmp;
-				unsigned ns = avail + 10;
-
-				if( ns < avail ){
-					srmio_error_set( err, "too many blocks");
-					goto clean2;
-				}
-
-				if( NULL == (tmp = realloc(blocks, (1+ ns)
-					* (sizeof(srmio_marker_t)) ))){
-
-					srmio_error_errno( err, "enlage data blocks" );
-					goto clean2;
-				}
-
-				blocks = tmp;
-				avail = ns;
-			}
-
-			DPRINTF("found gap @%u "
-				"%.1f - %.1f = %.1f",
-				i,
-				(double)prev->time/10,
-				(double)this->time/10,
-				(double)(this->time - prev->time)/10);
-
-			if( NULL == (blocks[used] = srmio_marker_new(err) ) )
-				goto clean2;
-
-			blocks[used-1]->last = i -1;
-			blocks[used]->first = i;
-			blocks[used]->last = data->cused -1;
-			blocks[++used] = NULL;
-		}
+	for( i = 0; i < cnt; ++i ){
+		if( NULL == (blocks[i] = srmio_marker_new( err )))
+			goto clean1;
+
+		blocks[i]->first = list[i].first;
+		blocks[i]->last = list[i].last;
 	}
+	blocks[cnt] = NULL;
 
 	return blocks;
 
-clean2:
-	for( i=0; i < used; ++i )
-		srmio_marker_free( blocks[i] );
-
 clean1:
+	while( i > 0 )
+		srmio_marker_free( blocks[--i] );
+
 	free(blocks);
 	return NULL;
 }
 
+/*
+ * notify data about chunks or marker being modified in place. Drops
+ * all cached information derived from them.
+ */
+void srmio_data_changed( srmio_data_t data )
+{
+	assert( data );
+
+	srmio_mindex_invalidate( data->mindex );
+	srmio_tindex_free( data->tindex );
+	data->tindex = NULL;
+	srmio_sums_invalidate( data->sums );
+}
+
 /*
  * free all memory held in data structure
  */
@@ -357,14 +1002,34 @@ void srmio_data_free( srmio_data_t data )
 	if( data == NULL )
 		return;
 
-	for( i=0; i < data->cused; ++i )
+	/* chunks added with srmio_data_add_chunkp() */
+	for( i=0; data->cforeign && i < data->cused; ++i ){
+		if( srmio_data_owns( data, data->chunks[i] ) )
+			continue;
+
 		srmio_chunk_free(data->chunks[i]);
+		--data->cforeign;
+	}
 	free(data->chunks);
+	srmio_arena_free( data->carena );
+	srmio_data_release_shared( data );
+
+	for( i=0; i < data->mused; ++i ){
+		srmio_marker_t mk = data->marker[i];
 
-	for( i=0; i < data->mused; ++i )
-		srmio_marker_free(data->marker[i]);
+		if( srmio_arena_owns( data->marena, mk ) )
+			free( mk->notes );
+		else
+			srmio_marker_free( mk );
+	}
 	free(data->marker);
+	srmio_arena_free( data->marena );
+	srmio_mindex_free( data->mindex );
 
+	srmio_tindex_free( data->tindex );
+	srmio_sums_free( data->sums );
+	srmio_packed_free( data->packed );
+	free(data->athlete);
 	free(data->notes);
 	free(data);
 }
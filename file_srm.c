@@ -9,35 +9,6 @@
 
 #include "common.h"
 
-/* used for list of blocks within SRM files */
-struct _srm_block_t {
-	srmio_time_t	daydelta;
-	unsigned	chunks;
-};
-
-static bool _xread( FILE *fh, unsigned char *buf, size_t len, srmio_error_t *err )
-{
-	size_t ret;
-
-	assert( fh );
-	assert( buf );
-	assert( len );
-
-	ret = fread( buf, 1, len, fh );
-
-	if( ret == 0){
-		srmio_error_errno( err, "read" );
-		return false;
-	}
-
-	if( ret < len ){
-		srmio_error_set( err, "incomplete read %u/%u", ret, len);
-		return false;
-	}
-
-	return true;
-}
-
 static bool _xwrite( FILE *fh, unsigned char *buf, size_t len, srmio_error_t *err )
 {
 	size_t ret;
@@ -175,179 +146,321 @@ static unsigned _srm_mkdays( srmio_time_t input, srmio_error_t *err )
 	return days;
 }
 
-typedef srmio_chunk_t (*srmio_file_read_cfunc)( const unsigned char *buf,
-	srmio_error_t *err );
+/*
+ * decode n consecutive chunks of a block, starting at "time"
+ */
+typedef void (*srmio_file_read_cfunc)( srmio_chunk_t ck,
+	const unsigned char *buf, unsigned n, srmio_time_t time,
+	srmio_time_t recint );
 
-static srmio_chunk_t _srmio_data_chunk_srm6( const unsigned char *buf,
-	srmio_error_t *err )
+/*
+ * SRM5/6: 5 bytes per chunk, power and speed packed into the first 3,
+ * followed by cadence and heartrate. Cadence is byte 3 - it used to be
+ * read from byte 5, which belongs to the next chunk.
+ */
+static void _srmio_data_chunks_srm6( srmio_chunk_t ck,
+	const unsigned char *buf, unsigned n, srmio_time_t time,
+	srmio_time_t recint )
 {
-	srmio_chunk_t ck;
-	uint8_t c0, c1, c2;
+#ifdef USE_X86_SIMD
+	unsigned done = 0;
 
-	if( NULL == (ck = srmio_chunk_new(err) ))
-		return NULL;
+	switch( srmio_simd_level() ){
+	  case srmio_simd_avx2:
+		done = srmio_file_chunks_srm6_avx2( ck, buf, n, time, recint );
+		break;
+
+	  case srmio_simd_sse2:
+		done = srmio_file_chunks_srm6_sse2( ck, buf, n, time, recint );
+		break;
 
-	c0 = buf_get_uint8( buf, 0 );
-	c1 = buf_get_uint8( buf, 1 );
-	c2 = buf_get_uint8( buf, 2 );
+	  default:
+		break;
+	}
 
-	ck->pwr = ( c1 & 0x0f) | ( c2 << 4 );
-	ck->speed = (double)( ((c1 & 0xf0) << 3)
-		| (c0 & 0x7f) ) * 3 / 26;
-	ck->cad = buf_get_uint8( buf, 5 );
-	ck->hr = buf_get_uint8( buf, 4 );
+	ck += done;
+	buf += done * 5;
+	time += done * recint;
+	n -= done;
+#endif
 
-	return ck;
+	for( ; n; --n, ++ck, buf += 5, time += recint ){
+		unsigned c0 = buf[0];
+		unsigned c1 = buf[1];
+		unsigned c2 = buf[2];
+
+		ck->time = time;
+		ck->dur = recint;
+		ck->temp = 0;
+		ck->pwr = ( c1 & 0x0f) | ( c2 << 4 );
+		ck->speed = (double)( ((c1 & 0xf0) << 3)
+			| (c0 & 0x7f) ) * 3 / 26;
+		ck->cad = buf[3];
+		ck->hr = buf[4];
+		ck->ele = 0;
+	}
 }
 
-
-static srmio_chunk_t _srmio_data_chunk_srm7( const unsigned char *buf,
-	srmio_error_t *err )
+/*
+ * SRM7: 14 bytes per chunk, little endian
+ */
+static void _srmio_data_chunks_srm7( srmio_chunk_t ck,
+	const unsigned char *buf, unsigned n, srmio_time_t time,
+	srmio_time_t recint )
 {
-	srmio_chunk_t ck;
+#ifdef USE_X86_SIMD
+	unsigned done = 0;
 
-	if( NULL == (ck = srmio_chunk_new(err) ))
-		return NULL;
+	switch( srmio_simd_level() ){
+	  case srmio_simd_avx2:
+		done = srmio_file_chunks_srm7_avx2( ck, buf, n, time, recint );
+		break;
+
+	  case srmio_simd_sse2:
+		done = srmio_file_chunks_srm7_sse2( ck, buf, n, time, recint );
+		break;
+
+	  default:
+		break;
+	}
 
-	ck->pwr = buf_get_luint16( buf, 0 );
-	ck->cad = buf_get_uint8( buf, 2 );
-	ck->hr = buf_get_uint8( buf, 3 );
-	ck->speed = ( (double)buf_get_lint32( buf, 4 ) * 3.6) / 1000;
-	if( ck->speed < 0 )
-		ck->speed = 0;
-	ck->ele = buf_get_lint32( buf, 8 );
-	ck->temp = 0.1 * buf_get_lint16( buf, 12 );
+	ck += done;
+	buf += done * 14;
+	time += done * recint;
+	n -= done;
+#endif
 
-	return ck;
+	for( ; n; --n, ++ck, buf += 14, time += recint ){
+		ck->time = time;
+		ck->dur = recint;
+		ck->pwr = buf_get_luint16( buf, 0 );
+		ck->cad = buf[2];
+		ck->hr = buf[3];
+		ck->speed = ( (double)buf_get_lint32( buf, 4 ) * 3.6) / 1000;
+		if( ck->speed < 0 )
+			ck->speed = 0;
+		ck->ele = buf_get_lint32( buf, 8 );
+		ck->temp = 0.1 * buf_get_lint16( buf, 12 );
+	}
 }
 
+/* initial buffer size when reading streams */
+#define SRM_READ_ALLOC	65536
+
 /*
- * read SRM5/6/7 files, fill newly allocated data structure.
- *
- * on success data pointer is returned.
- * returns NULL and sets errno on failure.
+ * check that "need" more bytes are available at pos
  */
-srmio_data_t srmio_file_srm_read( FILE *fh, srmio_error_t *err )
+static bool _srm_avail( size_t pos, size_t need, size_t len,
+	srmio_error_t *err )
 {
-	srmio_data_t tmp;
-	unsigned char buf[1024];
-	srmio_time_t recint;
-	srmio_time_t timerefday;
-	srmio_file_read_cfunc cfunc = NULL;
-	unsigned chunklen;
-	unsigned mcmtlen;
-	unsigned bcnt;
-	struct _srm_block_t **blocks = NULL;
-	unsigned mcnt;
-	unsigned ckcnt;
-	unsigned i;
-
-	if( NULL == (tmp = srmio_data_new(err)))
-		return NULL;
+	if( pos > len || len - pos < need ){
+		srmio_error_set( err, "incomplete read %u/%u",
+			(unsigned)(pos < len ? len - pos : 0),
+			(unsigned)need );
+		return false;
+	}
 
+	return true;
+}
 
-	/* header */
+/* file layout from the header */
+struct _srm_head_t {
+	unsigned	mcmtlen;	/* length of marker comments */
+	unsigned	chunklen;	/* bytes per chunk */
+	srmio_file_read_cfunc	cfunc;
+	srmio_time_t	timerefday;
+	srmio_time_t	recint;
+	unsigned	bcnt;
+	unsigned	mcnt;		/* marker after the athlete name */
+	size_t		size;		/* header, marker, blocks, calibration */
+};
 
-	if( ! _xread( fh, buf, 86, err ) )
-		goto clean2;
+/*
+ * parse the 86 byte file header
+ *
+ * returns false on error
+ */
+static bool _srm_head( const unsigned char *buf, struct _srm_head_t *head,
+	srmio_error_t *err )
+{
 #ifdef DEBUG_FILE
 	DUMPHEX( "head", buf, 86 );
 #endif
 
 	if( 0 != strncmp( (char*)buf, "SRM", 3 )){
 		srmio_error_set( err, "unrecognized file format");
-		goto clean2;
+		return false;
 
 	}
 
 	switch( buf[3] ){
 	  case '5':
-		mcmtlen = 3;
-		chunklen = 5;
-		cfunc = _srmio_data_chunk_srm6;
+		head->mcmtlen = 3;
+		head->chunklen = 5;
+		head->cfunc = _srmio_data_chunks_srm6;
 		break;
 
 	  case '6':
-		mcmtlen = 255;
-		chunklen = 5;
-		cfunc = _srmio_data_chunk_srm6;
+		head->mcmtlen = 255;
+		head->chunklen = 5;
+		head->cfunc = _srmio_data_chunks_srm6;
 		break;
 
 	  case '7':
-		mcmtlen = 255;
-		chunklen = 14;
-		cfunc = _srmio_data_chunk_srm7;
+		head->mcmtlen = 255;
+		head->chunklen = 14;
+		head->cfunc = _srmio_data_chunks_srm7;
 		break;
 
 	  default:
 		srmio_error_set( err, "unsupported file format version: %c", buf[3] );
-		goto clean2;
+		return false;
 	}
 
-	if( (srmio_time_t)-1 == (timerefday = _srm_mktime( buf_get_luint16( buf, 4), err )))
-		goto clean2;
+	if( (srmio_time_t)-1 == (head->timerefday = _srm_mktime( buf_get_luint16( buf, 4), err )))
+		return false;
 #ifdef DEBUG_FILE
 	{
-	time_t t = timerefday / 10;
+	time_t t = head->timerefday / 10;
 	DPRINTF( "timerefday %u %.1f %s",
 		(unsigned)buf_get_luint16( buf, 4),
-		(double)timerefday/10, ctime( &t));
+		(double)head->timerefday/10, ctime( &t));
 	}
 #endif
 
-	tmp->circum = buf_get_luint16( buf, 6);
-	recint = 10 * buf_get_uint8( buf, 8 )
+	if( ! buf_get_uint8( buf, 9 ) ){
+		srmio_error_set( err, "invalid recint" );
+		return false;
+	}
+
+	head->recint = 10 * buf_get_uint8( buf, 8 )
 		/ buf_get_uint8( buf, 9 );
-	bcnt = buf_get_luint16( buf, 10);
-	mcnt = buf_get_luint16( buf, 12);
+	head->bcnt = buf_get_luint16( buf, 10);
+	head->mcnt = buf_get_luint16( buf, 12);
+	head->size = 86 + ( head->mcnt +1 ) * ( head->mcmtlen + 15 )
+		+ head->bcnt * 6 + 7;
+#ifdef DEBUG_FILE
+	DPRINTF( "bcnt=%u mcnt=%u(+1)", head->bcnt, head->mcnt );
+#endif
+
+	return true;
+}
+
+/*
+ * get start (relative to timerefday) and number of chunks of block i.
+ * SRM5 files have no blocks - there's a single one.
+ */
+static void _srm_block( const struct _srm_head_t *head,
+	const unsigned char *blocks, unsigned ckcnt, unsigned i,
+	srmio_time_t *daydelta, unsigned *chunks )
+{
+	if( ! head->bcnt ){
+		*daydelta = head->recint;
+		*chunks = ckcnt;
+		return;
+	}
+
+	*daydelta = buf_get_luint32( blocks, i * 6 ) / 10;
+	*chunks = buf_get_luint16( blocks, i * 6 +4 );
+
 #ifdef DEBUG_FILE
-	DPRINTF( "bcnt=%u mcnt=%u(+1)", bcnt, mcnt );
+	{
+	time_t t = (head->timerefday + *daydelta) / 10;
+	DPRINTF( "block %.1f %u %s",
+		(double)*daydelta/10,
+		*chunks,
+		ctime( &t) );
+	}
 #endif
+}
+
+/* file layout, filled by _srm_parse() */
+struct _srm_layout_t {
+	struct _srm_head_t	head;
+	const unsigned char	*blocks;
+	unsigned		nblocks;	/* SRM5: 1 */
+	unsigned		ckcnt;
+	size_t			pos;		/* offset of first chunk */
+};
+
+/*
+ * parse header, marker, block list and calibration from memory into a
+ * newly allocated data structure. Chunks are left to the caller.
+ *
+ * on success data pointer is returned.
+ * returns NULL on failure.
+ */
+static srmio_data_t _srm_parse( const unsigned char *mem, size_t len,
+	struct _srm_layout_t *lay, srmio_error_t *err )
+{
+	srmio_data_t tmp;
+	const unsigned char *buf;
+	size_t pos = 0;
+	unsigned mcmtlen;
+
+	assert( mem || ! len );
+
+	if( NULL == (tmp = srmio_data_new(err)))
+		return NULL;
+
+
+	/* header */
+
+	if( ! _srm_avail( pos, 86, len, err ) )
+		goto clean1;
+	buf = mem + pos;
+	pos += 86;
+
+	if( ! _srm_head( buf, &lay->head, err ))
+		goto clean1;
+
+	mcmtlen = lay->head.mcmtlen;
+	tmp->circum = buf_get_luint16( buf, 6);
 
 	/* "notes" is preceeded by length + zero padded */
 	/* TODO: iconv notes cp850 -> internal */
 	if( NULL == (tmp->notes = buf_get_string( buf, 16, 70 ))){
 		srmio_error_errno( err, "get notes" );
-		goto clean2;
+		goto clean1;
 	}
 
 	/* marker */
-	if( NULL == (tmp->marker = malloc( (mcnt +1) * sizeof(srmio_marker_t *)))){
-		srmio_error_errno( err, "alloc marker" );
-		goto clean2;
-	}
-	*tmp->marker = NULL;
-	tmp->mavail = mcnt;
+	if( ! srmio_data_reserve( tmp, 0, lay->head.mcnt, err ))
+		goto clean1;
 
 	/* first marker is just used for the athlete name */
-	if( ! _xread( fh, buf, mcmtlen + 15, err ))
-		goto clean2;
+	if( ! _srm_avail( pos, mcmtlen + 15, len, err ))
+		goto clean1;
+	buf = mem + pos;
+	pos += mcmtlen + 15;
 
 	if( NULL == (tmp->athlete = buf_get_string( buf, 0, mcmtlen ))){
 		srmio_error_errno( err, "get athlete" );
-		goto clean2;
+		goto clean1;
 	}
 	/* TODO: iconv athlete cp850 -> internal */
 
 	/* remaining marker */
-	for( ; tmp->mused < mcnt; ++tmp->mused ){
+	while( tmp->mused < lay->head.mcnt ){
 		srmio_marker_t tm;
 
-		if( ! _xread( fh, buf, mcmtlen + 15, err ))
-			goto clean2;
+		if( ! _srm_avail( pos, mcmtlen + 15, len, err ))
+			goto clean1;
+		buf = mem + pos;
+		pos += mcmtlen + 15;
 
-		if( NULL == (tm = srmio_marker_new(err)))
-			goto clean2;
+		if( NULL == (tm = srmio_data_marker_new( tmp, err )))
+			goto clean1;
 
-		tmp->marker[tmp->mused] = tm;
-		tmp->marker[tmp->mused+1] = NULL;
+		if( ! srmio_data_add_markerp( tmp, tm, err ))
+			goto clean1;
 
 		tm->first = buf_get_luint16( buf, mcmtlen +1)-1;
 		tm->last = buf_get_luint16( buf, mcmtlen +3)-1;
 
 		if( NULL == (tm->notes = buf_get_string( buf, 0, mcmtlen))){
 			srmio_error_errno( err, "get notes");
-			goto clean2;
+			goto clean1;
 		}
 		/* TODO: iconv notes cp850 -> internal */
 
@@ -359,96 +472,158 @@ srmio_data_t srmio_file_srm_read( FILE *fh, srmio_error_t *err )
 #endif
 	}
 
-	/* blocks */
-	if( NULL == (blocks = malloc( (bcnt+2) * sizeof( struct _srm_block_t *)))){
-		srmio_error_errno( err, "alloc blocks" );
-		goto clean2;
-	}
-	*blocks=NULL;
-
-	for( i = 0; i < bcnt; ++i ){
-		struct _srm_block_t *tb;
-
-		if( ! _xread( fh, buf, 6, err ))
-			goto clean3;
-
-		if( NULL == (tb = malloc(sizeof(struct _srm_block_t)))){
-			srmio_error_errno( err, "alloc block" );
-			goto clean3;
-		}
-
-		blocks[i] = tb;
-		blocks[i+1] = NULL;;
-
-		tb->daydelta = buf_get_luint32( buf, 0) / 10;
-		tb->chunks = buf_get_luint16( buf, 4);
-
-#ifdef DEBUG_FILE
-		{
-		time_t t = (timerefday + tb->daydelta) / 10;
-		DPRINTF( "block %.1f %u %s",
-			(double)tb->daydelta/10,
-			tb->chunks,
-			ctime( &t) );
-		}
-#endif
-
-	}
+	/* blocks are decoded when reading the chunks */
+	if( ! _srm_avail( pos, lay->head.bcnt * 6, len, err ))
+		goto clean1;
+	lay->blocks = mem + pos;
+	lay->nblocks = lay->head.bcnt ? lay->head.bcnt : 1;
+	pos += lay->head.bcnt * 6;
 
 	/* calibration */
-	if( ! _xread( fh, buf, 7, err ))
-		goto clean3;
+	if( ! _srm_avail( pos, 7, len, err ))
+		goto clean1;
+	buf = mem + pos;
+	pos += 7;
 #ifdef DEBUG_FILE
 	DUMPHEX( "calibration", buf, 7 );
 #endif
 
 	tmp->zeropos = buf_get_luint16( buf, 0);
 	tmp->slope = (double)(buf_get_luint16( buf, 2) * 140) / 42781;
-	ckcnt = buf_get_luint16( buf, 4);
+	lay->ckcnt = buf_get_luint16( buf, 4);
 #ifdef DEBUG_FILE
 	DPRINTF( "cal zpos=%d slope=%.1f, chunks=%u",
-		tmp->zeropos, tmp->slope, ckcnt );
+		tmp->zeropos, tmp->slope, lay->ckcnt );
 #endif
 
-	/* synthesize block for SRM5 files */
-	if( bcnt == 0 ){
-		blocks[1] = NULL;;
+	lay->pos = pos;
+	return tmp;
+
+clean1:
+	srmio_data_free(tmp);
+	return NULL;
+}
 
-		if( NULL == (blocks[0] = malloc(sizeof(struct _srm_block_t)))){
-			srmio_error_errno( err, "alloc block" );
-			goto clean3;
-		}
+/*
+ * get start and number of chunks of block i - limited to the "avail"
+ * chunks that are left in the file. Sets *truncated when the block is
+ * cut short. Empty blocks return 0 chunks.
+ *
+ * returns false on error
+ */
+static bool _srm_block_avail( const struct _srm_layout_t *lay, unsigned i,
+	unsigned long avail, srmio_time_t *start, unsigned *chunks,
+	bool *truncated, srmio_error_t *err )
+{
+	srmio_time_t daydelta;
+
+	_srm_block( &lay->head, lay->blocks, lay->ckcnt, i, &daydelta, chunks );
+	if( ! *chunks )
+		return true;
+
+	if( *chunks > avail ){
+		*truncated = true;
+		*chunks = avail;
+		if( ! *chunks )
+			return true;
+	}
+
+	*start = lay->head.timerefday + daydelta;
+	if( *start < lay->head.timerefday
+		|| *start + (srmio_time_t)(*chunks -1) * lay->head.recint
+		< *start ){
+
+		srmio_error_set( err, "time overflow in block %u", i );
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * premature end of file, fix marker
+ */
+static void _srm_truncated( srmio_data_t data )
+{
+	unsigned last = data->cused -1;
+	unsigned i;
+
+	STATMSG( "failed to read all chunks" );
+	for( i = 0; i < data->mused; ++i ){
+		srmio_marker_t mk = data->marker[i];
+
+		if( mk->first > last )
+			mk->first = last;
+		if( mk->last > last )
+			mk->last = last;
+	}
+}
+
+/*
+ * parse SRM5/6/7 file from memory. Everything is decoded directly from
+ * mem - this may be a mapped file. Nothing refers to mem after
+ * returning.
+ *
+ * on success data pointer is returned.
+ * returns NULL on failure.
+ */
+srmio_data_t srmio_file_srm_read_mem( const unsigned char *mem, size_t len,
+	srmio_error_t *err )
+{
+	srmio_data_t tmp;
+	struct _srm_layout_t lay;
+	size_t pos;
+	unsigned chunklen;
+	bool truncated = false;
+	unsigned long total;
+	unsigned i;
+
+	if( NULL == (tmp = _srm_parse( mem, len, &lay, err )))
+		return NULL;
+
+	pos = lay.pos;
+	chunklen = lay.head.chunklen;
 
-		blocks[0]->daydelta = recint;
-		blocks[0]->chunks = ckcnt;
+	/* preallocate all chunks at once - limited to what's there */
+	for( total = 0, i = 0; i < lay.nblocks; ++i ){
+		srmio_time_t daydelta;
+		unsigned chunks;
+
+		_srm_block( &lay.head, lay.blocks, lay.ckcnt, i, &daydelta,
+			&chunks );
+		total += chunks;
 	}
+	if( total > ( len - pos ) / chunklen )
+		total = ( len - pos ) / chunklen;
+
+	if( ! srmio_data_reserve( tmp, total, 0, err ))
+		goto clean2;
 
 	/* chunks */
-	for( i = 0; blocks[i]; ++i ){
+	for( i = 0; i < lay.nblocks && ! truncated; ++i ){
+		srmio_time_t start;
+		unsigned chunks;
+		srmio_chunk_t ck;
+#ifdef DEBUG_FILE
 		unsigned ci;
+#endif
 
-		for( ci = 0; ci < blocks[i]->chunks; ++ci ){
-			srmio_chunk_t ck;
+		if( ! _srm_block_avail( &lay, i, ( len - pos ) / chunklen,
+			&start, &chunks, &truncated, err ))
+			goto clean2;
 
-			if( ! _xread( fh, buf, chunklen, err )){
-				if( ! tmp->cused )
-					goto clean3;
-				STATMSG( "failed to read all chunks" );
-				goto premature_end;
-			}
+		if( ! chunks )
+			continue;
 
-			if( NULL == (ck = (*cfunc)( buf, err )))
-				goto clean3;
+		if( NULL == (ck = srmio_data_chunks_alloc( tmp, chunks, err )))
+			goto clean2;
 
-			ck->time = timerefday + blocks[i]->daydelta +
-				ci * recint;
-			ck->dur = recint;
-			if( ck->time < timerefday ){
-				srmio_error_set( err, "time overflow in block %u", i );
-				goto clean3;
-			}
+		(*lay.head.cfunc)( ck, mem + pos, chunks, start,
+			lay.head.recint );
+		pos += chunks * chunklen;
 
 #ifdef DEBUG_FILE
+		for( ci = 0; ci < chunks; ++ci ){
 			DPRINTF( "chunk "
 				"time=%.1f, "
 				"temp=%.1f, "
@@ -456,235 +631,947 @@ srmio_data_t srmio_file_srm_read( FILE *fh, srmio_error_t *err )
 				"spd=%.3f, "
 				"cad=%u, "
 				"hr=%u ",
-				(double)ck->time/10,
-				ck->temp,
-				ck->pwr,
-				ck->speed,
-				ck->cad,
-				ck->hr );
-#endif
-
-			if( ! srmio_data_add_chunkp( tmp, ck, err ) )
-				goto clean3;
-
+				(double)ck[ci].time/10,
+				ck[ci].temp,
+				ck[ci].pwr,
+				ck[ci].speed,
+				ck[ci].cad,
+				ck[ci].hr );
 		}
+#endif
 
-		free( blocks[i] );
+		if( ! srmio_data_add_chunksp( tmp, ck, chunks, err ) )
+			goto clean2;
 	}
-	free( blocks );
-
-
-	return tmp;
 
-premature_end:
-	/* premature end of file, fix marker */
-	ckcnt = tmp->cused -1;
-	for( i = 0; i < tmp->mused; ++i ){
-		srmio_marker_t mk = tmp->marker[i];
+	if( ! truncated )
+		return tmp;
 
-		if( mk->first > ckcnt )
-			mk->first = ckcnt;
-		if( mk->last > ckcnt )
-			mk->last = ckcnt;
+	if( ! tmp->cused ){
+		_srm_avail( pos, chunklen, len, err );
+		goto clean2;
 	}
 
+	_srm_truncated( tmp );
 	return tmp;
 
-clean3:
-	for( i = 0; blocks[i]; ++i )
-		free( blocks[i] );
-	free( blocks );
-
 clean2:
 	srmio_data_free(tmp);
 	return NULL;
 }
 
-/* TODO: srmio_file_srm6_write */
-
-bool set_marker( unsigned char *buf, char *note, unsigned first,
-	unsigned last, srmio_error_t *err )
+#ifdef USE_MMAP
+/*
+ * map regular file that has data after offset "off".
+ *
+ * returns false when the file can't be mapped.
+ */
+static bool _srm_map( int fd, off_t off, void **map, size_t *maplen )
 {
-	/* TODO: iconv notes -> cp850 */
-	buf_set_string( buf, 0, note, 255 );
-	buf_set_uint8( buf, 255, 1 ); /* active */
-	if( ! buf_set_luint16( buf, 256, first+1 ) ){
-		srmio_error_errno( err, "set marker" );
+	struct stat st;
+
+	if( off < 0 || 0 != fstat( fd, &st ) || ! S_ISREG( st.st_mode )
+		|| st.st_size <= off )
 		return false;
-	}
-	if( ! buf_set_luint16( buf, 258, last+1 ) ){
-		srmio_error_errno( err, "set marker" );
+
+	if( MAP_FAILED == (*map = mmap( NULL, st.st_size, PROT_READ,
+		MAP_PRIVATE, fd, 0 )))
 		return false;
-	}
-	memset( &buf[260], 0, 10 );
 
+	*maplen = st.st_size;
 	return true;
 }
 
-
 /*
- * write contents of data structure into specified file
+ * map regular file and parse it starting at offset "off". *mapped is
+ * false when the file can't be mapped.
  */
-bool srmio_file_srm7_write( srmio_data_t data, FILE *fh, srmio_error_t *err )
+static srmio_data_t _srm_read_map( int fd, off_t off, bool *mapped,
+	srmio_error_t *err )
 {
-	unsigned char buf[1024];
-	srmio_marker_t *blocks;
-	srmio_time_t timerefday;
-	srmio_time_t recint;
-	unsigned i;
+	srmio_data_t data;
+	void *map;
+	size_t maplen;
 
-	if( ! data ){
-		srmio_error_set( err, "no data to write" );
-		return false;
-	}
+	if( ! (*mapped = _srm_map( fd, off, &map, &maplen )))
+		return NULL;
 
-	if( data->notes && strlen(data->notes) > 255 ){
-		srmio_error_set( err, "notes are too long" );
-		return false;
-	}
+	data = srmio_file_srm_read_mem( (unsigned char *)map + off,
+		maplen - off, err );
 
-	if( data->athlete && strlen(data->athlete) > 255 ){
-		srmio_error_set( err, "athlete name ist too long" );
-		return false;
-	}
+	munmap( map, maplen );
+	return data;
+}
+#endif
 
-	if( data->cused < 1 || data->cused > UINT16_MAX ){
-		srmio_error_set( err, "too few/many chunks" );
+/*
+ * read stream up to its end into newly allocated *mem.
+ *
+ * returns false on error
+ */
+static bool _srm_slurp( FILE *fh, unsigned char **mem, size_t *used,
+	srmio_error_t *err )
+{
+	size_t alloc = 0;
+	size_t ret;
+
+	*mem = NULL;
+	*used = 0;
+
+	do {
+		if( *used >= alloc ){
+			unsigned char *tmp;
+
+			alloc = alloc ? 2 * alloc : SRM_READ_ALLOC;
+			if( NULL == (tmp = realloc( *mem, alloc ))){
+				srmio_error_errno( err, "read buffer" );
+				goto clean1;
+			}
+			*mem = tmp;
+		}
+
+		*used += (ret = fread( *mem + *used, 1, alloc - *used, fh ));
+	} while( ret > 0 );
+
+	if( ferror( fh ) ){
+		srmio_error_errno( err, "read" );
+		goto clean1;
+	}
+
+	return true;
+
+clean1:
+	free( *mem );
+	*mem = NULL;
+	return false;
+}
+
+/*
+ * read SRM5/6/7 file from file descriptor, starting at the current
+ * offset. Regular files are mapped, other files are read into memory
+ * up to their end.
+ *
+ * on success data pointer is returned.
+ * returns NULL on failure.
+ */
+srmio_data_t srmio_file_srm_read_fd( int fd, srmio_error_t *err )
+{
+	srmio_data_t data;
+	unsigned char *mem = NULL;
+	size_t alloc = 0;
+	size_t used = 0;
+	ssize_t ret;
+
+#ifdef USE_MMAP
+	{
+		bool mapped;
+
+		data = _srm_read_map( fd, lseek( fd, 0, SEEK_CUR ), &mapped,
+			err );
+		if( mapped )
+			return data;
+	}
+#endif
+
+	do {
+		if( used >= alloc ){
+			unsigned char *tmp;
+
+			alloc = alloc ? 2 * alloc : SRM_READ_ALLOC;
+			if( NULL == (tmp = realloc( mem, alloc ))){
+				srmio_error_errno( err, "read buffer" );
+				goto clean1;
+			}
+			mem = tmp;
+		}
+
+		if( 0 > (ret = read( fd, mem + used, alloc - used ))){
+			if( errno == EINTR )
+				continue;
+
+			srmio_error_errno( err, "read" );
+			goto clean1;
+		}
+
+		used += ret;
+	} while( ret > 0 );
+
+	data = srmio_file_srm_read_mem( mem, used, err );
+	free( mem );
+	return data;
+
+clean1:
+	free( mem );
+	return NULL;
+}
+
+/*
+ * read SRM5/6/7 file from stream, fill newly allocated data
+ * structure. The stream is read up to its end.
+ *
+ * on success data pointer is returned.
+ * returns NULL and sets errno on failure.
+ */
+srmio_data_t srmio_file_srm_read( FILE *fh, srmio_error_t *err )
+{
+	srmio_data_t data;
+	unsigned char *mem;
+	size_t used;
+
+	assert( fh );
+
+#ifdef USE_MMAP
+	{
+		bool mapped;
+
+		data = _srm_read_map( fileno( fh ), ftell( fh ), &mapped, err );
+		if( mapped ){
+			fseek( fh, 0, SEEK_END );
+			return data;
+		}
+	}
+#endif
+
+	if( ! _srm_slurp( fh, &mem, &used, err ) )
+		return NULL;
+
+	data = srmio_file_srm_read_mem( mem, used, err );
+	free( mem );
+	return data;
+}
+
+/*
+ * lazily decoded chunks of a file that's kept in memory. The chunk
+ * records are stored back to back, so chunk i is at a fixed offset.
+ * Its time is found through the (non-empty) blocks.
+ */
+struct _srm_lazy_block_t {
+	srmio_time_t	start;
+	unsigned	first;	/* chunk index */
+};
+
+struct _srm_lazy_t {
+	srmio_file_read_cfunc	cfunc;
+	unsigned		chunklen;
+	srmio_time_t		recint;
+	const unsigned char	*chunks;
+
+	struct _srm_lazy_block_t	*block;
+	unsigned		bused;
+
+	/* file contents - either mapped or read */
+	void			*map;
+	size_t			maplen;
+	unsigned char		*mem;
+};
+
+static void _srm_lazy_free( void *priv )
+{
+	struct _srm_lazy_t *lazy = priv;
+
+	if( ! lazy )
+		return;
+
+#ifdef USE_MMAP
+	if( lazy->map )
+		munmap( lazy->map, lazy->maplen );
+#endif
+	free( lazy->mem );
+	free( lazy->block );
+	free( lazy );
+}
+
+/*
+ * decode chunk i. Doesn't modify lazy, so it's safe to use from
+ * multiple threads.
+ */
+static void _srm_lazy_get( void *priv, unsigned i, srmio_chunk_t chunk )
+{
+	struct _srm_lazy_t *lazy = priv;
+	const struct _srm_lazy_block_t *blk;
+	unsigned lo = 0, hi = lazy->bused;
+
+	/* last block starting at or before i */
+	while( hi - lo > 1 ){
+		unsigned mid = lo + (hi - lo) / 2;
+
+		if( lazy->block[mid].first <= i )
+			lo = mid;
+		else
+			hi = mid;
+	}
+	blk = &lazy->block[lo];
+
+	(*lazy->cfunc)( chunk, lazy->chunks + (size_t)i * lazy->chunklen, 1,
+		blk->start + (srmio_time_t)(i - blk->first) * lazy->recint,
+		lazy->recint );
+}
+
+/*
+ * parse file in memory and attach lazy chunks to data. lazy is
+ * released with data - or when this fails.
+ */
+static srmio_data_t _srm_read_lazy( struct _srm_lazy_t *lazy,
+	const unsigned char *mem, size_t len, srmio_error_t *err )
+{
+	srmio_data_t tmp;
+	struct _srm_layout_t lay;
+	srmio_packed_t packed;
+	bool truncated = false;
+	unsigned long avail;
+	unsigned total = 0;
+	unsigned i;
+
+	if( NULL == (tmp = _srm_parse( mem, len, &lay, err )))
+		goto clean1;
+
+	lazy->cfunc = lay.head.cfunc;
+	lazy->chunklen = lay.head.chunklen;
+	lazy->recint = lay.head.recint;
+	lazy->chunks = mem + lay.pos;
+
+	if( NULL == (lazy->block = malloc( lay.nblocks
+		* sizeof(struct _srm_lazy_block_t) ))){
+
+		srmio_error_errno( err, "lazy blocks" );
+		goto clean2;
+	}
+
+	/* index blocks like srmio_file_srm_read_mem() reads them */
+	avail = ( len - lay.pos ) / lay.head.chunklen;
+	for( i = 0; i < lay.nblocks && ! truncated; ++i ){
+		srmio_time_t start;
+		unsigned chunks;
+
+		if( ! _srm_block_avail( &lay, i, avail, &start, &chunks,
+			&truncated, err ))
+			goto clean2;
+
+		if( ! chunks )
+			continue;
+
+		lazy->block[lazy->bused].start = start;
+		lazy->block[lazy->bused].first = total;
+		++lazy->bused;
+
+		total += chunks;
+		avail -= chunks;
+	}
+
+	if( truncated && ! total ){
+		_srm_avail( lay.pos, lay.head.chunklen, len, err );
+		goto clean2;
+	}
+
+	if( NULL == (packed = srmio_packed_new( total, _srm_lazy_get,
+		_srm_lazy_free, lazy, err )))
+		goto clean2;
+
+	if( ! srmio_data_packed_set( tmp, packed, err )){
+		srmio_packed_free( packed );
+		srmio_data_free( tmp );
+		return NULL;
+	}
+
+	if( truncated )
+		_srm_truncated( tmp );
+
+	return tmp;
+
+clean2:
+	srmio_data_free( tmp );
+clean1:
+	_srm_lazy_free( lazy );
+	return NULL;
+}
+
+/*
+ * like srmio_file_srm_read(), but only header, marker and the block
+ * list are parsed up front. Chunks are decoded on access - they're
+ * only available through srmio_data_chunk() and srmio_data_chunk_get().
+ * Regular files are mapped and stay mapped until data is freed, other
+ * streams are read into memory. The data set is compact, see
+ * srmio_data_compact(). srmio_data_expand() decodes all chunks.
+ *
+ * on success data pointer is returned.
+ * returns NULL on failure.
+ */
+srmio_data_t srmio_file_srm_read_lazy( FILE *fh, srmio_error_t *err )
+{
+	struct _srm_lazy_t *lazy;
+	size_t len;
+
+	assert( fh );
+
+	if( NULL == (lazy = malloc( sizeof(struct _srm_lazy_t) ))){
+		srmio_error_errno( err, "lazy data" );
+		return NULL;
+	}
+	memset( lazy, 0, sizeof(struct _srm_lazy_t) );
+
+#ifdef USE_MMAP
+	{
+		long off = ftell( fh );
+
+		if( _srm_map( fileno( fh ), off, &lazy->map, &lazy->maplen )){
+			fseek( fh, 0, SEEK_END );
+			return _srm_read_lazy( lazy,
+				(unsigned char *)lazy->map + off,
+				lazy->maplen - off, err );
+		}
+		lazy->map = NULL;
+	}
+#endif
+
+	if( ! _srm_slurp( fh, &lazy->mem, &len, err ) ){
+		_srm_lazy_free( lazy );
+		return NULL;
+	}
+
+	return _srm_read_lazy( lazy, lazy->mem, len, err );
+}
+
+/*
+ * count bytes left in stream. Regular files are just stat()ed, others
+ * are read to their end.
+ *
+ * returns false on error
+ */
+static bool _srm_left( FILE *fh, unsigned long *left, srmio_error_t *err )
+{
+	unsigned char buf[4096];
+	struct stat st;
+	long pos;
+	size_t ret;
+
+	if( 0 <= (pos = ftell( fh ))
+		&& 0 == fstat( fileno( fh ), &st )
+		&& S_ISREG( st.st_mode ) ){
+
+		*left = st.st_size > pos ? st.st_size - pos : 0;
+		return true;
+	}
+
+	*left = 0;
+	while( 0 < (ret = fread( buf, 1, sizeof(buf), fh )))
+		*left += ret;
+
+	if( ferror( fh ) ){
+		srmio_error_errno( err, "read" );
 		return false;
 	}
 
-	if( data->mused > UINT16_MAX ){
-		srmio_error_set( err, "too many marker" );
+	return true;
+}
+
+/*
+ * get summary of SRM5/6/7 file from stream without decoding the
+ * chunks. Only header, marker and blocks are read. Start and end match
+ * what srmio_data_time_start/_end() give for the data read by
+ * srmio_file_srm_read() - including truncated files.
+ *
+ * returns false on error
+ */
+bool srmio_file_srm_probe( FILE *fh, srmio_file_srm_info_t info,
+	srmio_error_t *err )
+{
+	unsigned char hbuf[86];
+	unsigned char *buf;
+	const unsigned char *blocks, *cal;
+	struct _srm_head_t head;
+	unsigned long avail;
+	unsigned nblocks, ckcnt, i;
+	size_t ret;
+	bool found = false;
+
+	assert( fh );
+	assert( info );
+
+	memset( info, 0, sizeof(struct _srmio_file_srm_info_t) );
+
+	if( sizeof(hbuf) != (ret = fread( hbuf, 1, sizeof(hbuf), fh ))){
+		if( ferror( fh ) )
+			srmio_error_errno( err, "read" );
+		else
+			srmio_error_set( err, "incomplete read %u/%u",
+				(unsigned)ret, (unsigned)sizeof(hbuf) );
 		return false;
 	}
 
-	if( ! srmio_data_recint( data, &recint, err ) )
+	if( ! _srm_head( hbuf, &head, err ))
 		return false;
 
-	if( NULL == (blocks = srmio_data_blocks( data, err )))
+	info->version = hbuf[3];
+	info->recint = head.recint;
+	info->marker = head.mcnt;
+
+	/* marker, blocks and calibration */
+	if( NULL == (buf = malloc( head.size - 86 ))){
+		srmio_error_errno( err, "probe buffer" );
 		return false;
+	}
 
-	/* header */
-	{
-		srmio_chunk_t *ck;
-		srmio_time_t mintime = -1;
-		unsigned long bcnt;
-		unsigned mcnt = data->mused; /* +1 for all_workout marker */
-		unsigned days;
+	if( head.size - 86 != (ret = fread( buf, 1, head.size - 86, fh ))){
+		if( ferror( fh ) )
+			srmio_error_errno( err, "read" );
+		else
+			srmio_error_set( err, "incomplete read %u/%u",
+				(unsigned)(86 + ret), (unsigned)head.size );
+		goto clean1;
+	}
 
-		/* count blocks */
-		for( bcnt = 0; blocks[bcnt] && bcnt <= ULONG_MAX; ++bcnt );
+	/* first marker is just used for the athlete name */
+	memcpy( info->athlete, buf, head.mcmtlen );
+	/* TODO: iconv athlete cp850 -> internal */
 
-		/* time-jumps in PCV lead to nonlinear timestamps, find
-		 * lowest one: */
-		for( ck = data->chunks; *ck; ++ck ){
-			if( mintime > (*ck)->time )
-				mintime = (*ck)->time;
-		}
+	blocks = buf + ( head.mcnt +1 ) * ( head.mcmtlen + 15 );
+	cal = blocks + head.bcnt * 6;
+	ckcnt = buf_get_luint16( cal, 4 );
 
-		if( (unsigned)-1 == ( days = _srm_mkdays( mintime, err )))
-			goto clean1;
-		if( (srmio_time_t)-1 == (timerefday = _srm_mktime( days, err )))
-			goto clean1;
+	if( ! _srm_left( fh, &avail, err ))
+		goto clean1;
+	avail /= head.chunklen;
 
-		DPRINTF( "mcnt=%u bcnt=%lu "
-			"mintime=%.1f "
-			"days=%u timerefday=%.1f "
-			"'%s'",
-			mcnt,
-			bcnt,
-			(double)mintime/10,
-			days,
-			(double)timerefday/10,
-			data->notes );
-
-		if( timerefday > mintime ){
-			srmio_error_set( err, "start time is big" );
-			goto clean1;
-		}
+	/* walk blocks like srmio_file_srm_read_mem() does */
+	nblocks = head.bcnt ? head.bcnt : 1;
+	for( i = 0; i < nblocks && avail; ++i ){
+		srmio_time_t daydelta;
+		srmio_time_t start;
+		unsigned chunks;
+
+		_srm_block( &head, blocks, ckcnt, i, &daydelta, &chunks );
+		if( ! chunks )
+			continue;
+
+		if( chunks > avail )
+			chunks = avail;
+
+		start = head.timerefday + daydelta;
+		if( start < head.timerefday
+			|| start + (srmio_time_t)(chunks -1) * head.recint < start ){
 
-		/* header */
-		memcpy( buf, "SRM7", 4 );
-		if( ! buf_set_luint16( buf, 4, days ) ){
-			srmio_error_errno( err, "set days" );
+			srmio_error_set( err, "time overflow in block %u", i );
 			goto clean1;
 		}
-		if( ! buf_set_luint16( buf, 6, data->circum ) ){
-			srmio_error_errno( err, "set circum" );
-			goto clean1;
+
+		if( ! found ){
+			info->start = start;
+			found = true;
 		}
-		if( recint < 10 ){
-			buf_set_uint8( buf, 8, (unsigned char)(recint % 10) );
-			buf_set_uint8( buf, 9, 10u );
-		} else {
-			if( ! buf_set_uint8( buf, 8, recint / 10 ) ){
-				srmio_error_errno( err, "set recint" );
-				goto clean1;
-			}
-			buf_set_uint8( buf, 9, 1u );
+		info->end = start + (srmio_time_t)chunks * head.recint;
+		info->chunks += chunks;
+		avail -= chunks;
+	}
+
+	if( ! found ){
+		srmio_error_set( err, "no data available" );
+		goto clean1;
+	}
+
+	free( buf );
+	return true;
+
+clean1:
+	free( buf );
+	return false;
+}
+
+static bool set_marker( unsigned char *buf, unsigned mcmtlen, char *note,
+	unsigned first, unsigned last, srmio_error_t *err )
+{
+	/* TODO: iconv notes -> cp850 */
+	buf_set_string( buf, 0, note, mcmtlen );
+	buf_set_uint8( buf, mcmtlen, 1 ); /* active */
+	if( ! buf_set_luint16( buf, mcmtlen +1, first+1 ) ){
+		srmio_error_errno( err, "set marker" );
+		return false;
+	}
+	if( ! buf_set_luint16( buf, mcmtlen +3, last+1 ) ){
+		srmio_error_errno( err, "set marker" );
+		return false;
+	}
+	memset( &buf[mcmtlen +5], 0, 10 );
+
+	return true;
+}
+
+typedef void (*srmio_file_write_cfunc)( srmio_chunk_t ck,
+	unsigned char *buf );
+
+/*
+ * value ranges of all chunks. They're checked once, so the chunks can
+ * be encoded without further checks.
+ */
+struct _srm_range_t {
+	srmio_time_t	mintime;
+	unsigned	pwr;
+	unsigned	cad;
+	unsigned	hr;
+	double		speed_min;
+	double		speed_max;
+	double		temp_min;
+	double		temp_max;
+	long		ele_min;
+	long		ele_max;
+};
+
+static void _srm_range( srmio_data_t data, struct _srm_range_t *range )
+{
+	struct _srmio_chunk_t ck;
+	unsigned i;
+
+	srmio_data_chunk_get( data, 0, &ck );
+	range->mintime = ck.time;
+	range->pwr = ck.pwr;
+	range->cad = ck.cad;
+	range->hr = ck.hr;
+	range->speed_min = range->speed_max = ck.speed;
+	range->temp_min = range->temp_max = ck.temp;
+	range->ele_min = range->ele_max = ck.ele;
+
+	for( i = 1; i < data->cused; ++i ){
+		srmio_data_chunk_get( data, i, &ck );
+
+		/* time-jumps in PCV lead to nonlinear timestamps, find
+		 * lowest one: */
+		if( range->mintime > ck.time )
+			range->mintime = ck.time;
+
+		if( range->pwr < ck.pwr )
+			range->pwr = ck.pwr;
+		if( range->cad < ck.cad )
+			range->cad = ck.cad;
+		if( range->hr < ck.hr )
+			range->hr = ck.hr;
+
+		if( range->speed_min > ck.speed )
+			range->speed_min = ck.speed;
+		if( range->speed_max < ck.speed )
+			range->speed_max = ck.speed;
+
+		if( range->temp_min > ck.temp )
+			range->temp_min = ck.temp;
+		if( range->temp_max < ck.temp )
+			range->temp_max = ck.temp;
+
+		if( range->ele_min > ck.ele )
+			range->ele_min = ck.ele;
+		if( range->ele_max < ck.ele )
+			range->ele_max = ck.ele;
+	}
+}
+
+/*
+ * check that all chunks fit into the file format
+ *
+ * returns false on error
+ */
+static bool _srm_range_check( const struct _srm_range_t *range,
+	char version, srmio_error_t *err )
+{
+	if( range->cad > UINT8_MAX ){
+		srmio_error_set( err, "cadence out of range: %u", range->cad );
+		return false;
+	}
+	if( range->hr > UINT8_MAX ){
+		srmio_error_set( err, "heartrate out of range: %u", range->hr );
+		return false;
+	}
+
+	if( version != '7' ){
+		if( range->pwr > 0x0fff ){
+			srmio_error_set( err, "power out of range: %u",
+				range->pwr );
+			return false;
 		}
-		if( ! buf_set_luint16( buf, 10, bcnt ) ){
-			srmio_error_errno( err, "set block count" );
-			goto clean1;
+		if( range->speed_min < 0 ){
+			srmio_error_set( err, "speed out of range: %.1f",
+				range->speed_min );
+			return false;
 		}
-		if( ! buf_set_luint16( buf, 12, mcnt ) ){
-			srmio_error_errno( err, "set marker count" );
-			goto clean1;
+		if( 0.5 + range->speed_max * 26 / 3 >= 0x0800 ){
+			srmio_error_set( err, "speed out of range: %.1f",
+				range->speed_max );
+			return false;
 		}
-		buf_set_uint8( buf, 14, 0 );
 
-		{
-			int len = 0;
+		return true;
+	}
+
+	if( range->pwr > UINT16_MAX ){
+		srmio_error_set( err, "power out of range: %u", range->pwr );
+		return false;
+	}
+	if( 0.5 + ( range->speed_min * 1000 ) / 3.6 <= (double)INT32_MIN -1 ){
+		srmio_error_set( err, "speed out of range: %.1f",
+			range->speed_min );
+		return false;
+	}
+	if( 0.5 + ( range->speed_max * 1000 ) / 3.6 >= (double)INT32_MAX +1 ){
+		srmio_error_set( err, "speed out of range: %.1f",
+			range->speed_max );
+		return false;
+	}
+	if( range->ele_min < INT32_MIN || range->ele_max > INT32_MAX ){
+		srmio_error_set( err, "elevation out of range: %ld",
+			range->ele_min < INT32_MIN
+			? range->ele_min : range->ele_max );
+		return false;
+	}
+	if( 0.5 + range->temp_min * 10 <= INT16_MIN -1 ){
+		srmio_error_set( err, "temperature out of range: %.1f",
+			range->temp_min );
+		return false;
+	}
+	if( 0.5 + range->temp_max * 10 >= INT16_MAX +1 ){
+		srmio_error_set( err, "temperature out of range: %.1f",
+			range->temp_max );
+		return false;
+	}
+
+	return true;
+}
 
-			if( data->notes )
-				len = strlen( data->notes );
+/*
+ * SRM5/6 chunk, values were checked by _srm_range_check()
+ */
+static void _srmio_file_chunk_srm6( srmio_chunk_t ck, unsigned char *buf )
+{
+	unsigned speed = 0.5 + ck->speed * 26 / 3;
 
-			if( len > 70 ){
-				DPRINTF( "notes are too long, truncating" );
-				len = 70;
-			}
+	buf[0] = speed & 0x7f;
+	buf[1] = ( ck->pwr & 0x0f ) | ( (speed >> 3) & 0xf0 );
+	buf[2] = ck->pwr >> 4;
+	buf[3] = ck->cad;
+	buf[4] = ck->hr;
+}
 
-			buf_set_uint8( buf, 15, len );
-		}
+/*
+ * SRM7 chunk, values were checked by _srm_range_check()
+ */
+static void _srmio_file_chunk_srm7( srmio_chunk_t ck, unsigned char *buf )
+{
+	uint32_t speed = (int32_t)( 0.5 + ( ck->speed * 1000) / 3.6 );
+	uint32_t ele = (int32_t)ck->ele;
+	uint16_t temp = (int16_t)( 0.5 + ck->temp * 10 );
+
+	buf[0] = ck->pwr & 0xff;
+	buf[1] = ck->pwr >> 8;
+	buf[2] = ck->cad;
+	buf[3] = ck->hr;
+	buf[4] = speed & 0xff;
+	buf[5] = (speed >> 8) & 0xff;
+	buf[6] = (speed >> 16) & 0xff;
+	buf[7] = speed >> 24;
+	buf[8] = ele & 0xff;
+	buf[9] = (ele >> 8) & 0xff;
+	buf[10] = (ele >> 16) & 0xff;
+	buf[11] = ele >> 24;
+	buf[12] = temp & 0xff;
+	buf[13] = temp >> 8;
+}
 
-		/* TODO: iconv notes -> cp850 */
-		buf_set_string( buf, 16, data->notes, 70 );
+/*
+ * write contents of data structure into specified file using the
+ * given SRM file format version. The whole file is assembled in memory
+ * and written at once.
+ */
+static bool _srmio_file_srm_write( srmio_data_t data, FILE *fh,
+	char version, srmio_error_t *err )
+{
+	unsigned char *file, *buf;
+	size_t size;
+	srmio_file_write_cfunc cfunc;
+	unsigned mcmtlen;
+	unsigned chunklen;
+	const struct _srmio_block_t *blocks;
+	unsigned bcnt;
+	struct _srm_range_t range;
+	srmio_time_t timerefday;
+	srmio_time_t recint;
+	unsigned mcnt;
+	unsigned days;
+	unsigned i;
 
-		if( ! _xwrite( fh, buf, 86, err ))
-			goto clean2;
+	if( ! data ){
+		srmio_error_set( err, "no data to write" );
+		return false;
 	}
 
-	/* first "marker" for athlete name */
-	if( ! set_marker( buf, data->athlete, 0, data->cused-1, err ) )
+	if( data->notes && strlen(data->notes) > 255 ){
+		srmio_error_set( err, "notes are too long" );
+		return false;
+	}
+
+	switch( version ){
+	  case '5':
+		mcmtlen = 3;
+		chunklen = 5;
+		cfunc = _srmio_file_chunk_srm6;
+		break;
+
+	  case '6':
+		mcmtlen = 255;
+		chunklen = 5;
+		cfunc = _srmio_file_chunk_srm6;
+		break;
+
+	  default:
+		mcmtlen = 255;
+		chunklen = 14;
+		cfunc = _srmio_file_chunk_srm7;
+		break;
+	}
+
+	if( data->athlete && strlen(data->athlete) > 255 ){
+		srmio_error_set( err, "athlete name ist too long" );
+		return false;
+	}
+
+	if( data->cused < 1 || data->cused > UINT16_MAX ){
+		srmio_error_set( err, "too few/many chunks" );
+		return false;
+	}
+
+	if( data->mused > UINT16_MAX ){
+		srmio_error_set( err, "too many marker" );
+		return false;
+	}
+
+	if( ! srmio_data_recint( data, &recint, err ) )
+		return false;
+
+	if( NULL == (blocks = srmio_data_block_list( data, &bcnt, err )))
+		return false;
+
+	/* SRM5 files have a single block starting right after midnight,
+	 * checked below */
+	if( version == '5' && bcnt > 1 ){
+		srmio_error_set( err, "SRM5 files can't hold gaps" );
+		return false;
+	}
+
+	_srm_range( data, &range );
+	if( ! _srm_range_check( &range, version, err ) )
+		return false;
+
+	/* all marker are written as they are */
+	srmio_data_marker_sync( data );
+	mcnt = data->mused;
+
+	if( (unsigned)-1 == ( days = _srm_mkdays( range.mintime, err )))
+		goto clean1;
+	if( (srmio_time_t)-1 == (timerefday = _srm_mktime( days, err )))
+		goto clean1;
+
+	DPRINTF( "mcnt=%u bcnt=%u "
+		"mintime=%.1f "
+		"days=%u timerefday=%.1f "
+		"'%s'",
+		mcnt,
+		bcnt,
+		(double)range.mintime/10,
+		days,
+		(double)timerefday/10,
+		data->notes );
+
+	if( timerefday > range.mintime ){
+		srmio_error_set( err, "start time is big" );
+		goto clean1;
+	}
+
+	/* SRM5 readers place the first chunk at timerefday + recint */
+	if( version == '5' && range.mintime != timerefday + recint ){
+		srmio_error_set( err, "SRM5 files must start %.1fsec "
+			"after midnight", (double)recint / 10 );
+		goto clean1;
+	}
+
+	/* +1 for athlete "marker" */
+	size = 86 + ( mcnt +1 ) * ( mcmtlen + 15 )
+		+ ( version == '5' ? 0 : bcnt * 6 )
+		+ 7 + data->cused * chunklen;
+
+	if( NULL == (file = malloc( size ))){
+		srmio_error_errno( err, "write buffer" );
+		goto clean1;
+	}
+	buf = file;
+
+	/* header */
+	memcpy( buf, "SRM", 3 );
+	buf[3] = version;
+	if( ! buf_set_luint16( buf, 4, days ) ){
+		srmio_error_errno( err, "set days" );
+		goto clean2;
+	}
+	if( ! buf_set_luint16( buf, 6, data->circum ) ){
+		srmio_error_errno( err, "set circum" );
 		goto clean2;
+	}
+	if( recint < 10 ){
+		buf_set_uint8( buf, 8, (unsigned char)(recint % 10) );
+		buf_set_uint8( buf, 9, 10u );
+	} else {
+		if( ! buf_set_uint8( buf, 8, recint / 10 ) ){
+			srmio_error_errno( err, "set recint" );
+			goto clean2;
+		}
+		buf_set_uint8( buf, 9, 1u );
+	}
+	buf_set_luint16( buf, 10, version == '5' ? 0 : bcnt );
+	buf_set_luint16( buf, 12, mcnt );
+	buf_set_uint8( buf, 14, 0 );
+
+	{
+		int len = 0;
+
+		if( data->notes )
+			len = strlen( data->notes );
+
+		if( len > 70 ){
+			DPRINTF( "notes are too long, truncating" );
+			len = 70;
+		}
+
+		buf_set_uint8( buf, 15, len );
+	}
 
-	if( ! _xwrite( fh, buf, 270, err ))
+	/* TODO: iconv notes -> cp850 */
+	buf_set_string( buf, 16, data->notes, 70 );
+	buf += 86;
+
+	/* first "marker" for athlete name */
+	if( ! set_marker( buf, mcmtlen, data->athlete, 0, data->cused-1, err ) )
 		goto clean2;
+	buf += mcmtlen + 15;
 
 	/* other markers */
 	for( i = 0; i < data->mused; ++i ){
 		srmio_marker_t mk = data->marker[i];
 
-		if( ! set_marker( buf, mk->notes, mk->first, mk->last, err ))
-			goto clean2;
-
 		DPRINTF( "marker @0x%lx %u %u %s",
-			(unsigned long)ftell(fh),
+			(unsigned long)(buf - file),
 			mk->first,
 			mk->last,
 			mk->notes );
 
-		if( ! _xwrite( fh, buf, 270, err ))
+		if( ! set_marker( buf, mcmtlen, mk->notes, mk->first,
+			mk->last, err ))
 			goto clean2;
+		buf += mcmtlen + 15;
 	}
 
 	/* blocks */
-	for( i = 0; blocks[i]; ++i ){
-		srmio_marker_t bk = blocks[i];
-		srmio_chunk_t ck = data->chunks[bk->first];
+	for( i = 0; version != '5' && i < bcnt; ++i ){
+		const struct _srmio_block_t *bk = &blocks[i];
+		struct _srmio_chunk_t first;
+		srmio_chunk_t ck = &first;
 		unsigned blockdelta;
 		unsigned len = bk->last - bk->first +1;
 
+		srmio_data_chunk_get( data, bk->first, ck );
+
 		blockdelta = ck->time - timerefday;
 		if( blockdelta * 10 < blockdelta ){
 			srmio_error_set(err, "block %u ref=%.1f: "
@@ -699,53 +1586,40 @@ bool srmio_file_srm7_write( srmio_data_t data, FILE *fh, srmio_error_t *err )
 		blockdelta *= 10;
 
 		DPRINTF( "block @0x%lx %.1f %u",
-			(unsigned long)ftell( fh ),
+			(unsigned long)(buf - file),
 			(double)ck->time/10,
 			blockdelta );
-		if( ! buf_set_luint32( buf, 0, blockdelta) ){
-			srmio_error_errno( err, "set block time" );
-			goto clean1;
-		}
-		if( ! buf_set_luint16( buf, 4, len) ){
-			srmio_error_errno( err, "set block chunks" );
-			goto clean1;
-		}
 
-		if( ! _xwrite( fh, buf, 6, err ))
-			goto clean2;
+		buf_set_luint32( buf, 0, blockdelta );
+		buf_set_luint16( buf, 4, len );
+		buf += 6;
 	}
 
 
 	/* calibration */
-	DPRINTF( "cal @0x%lx", (unsigned long)ftell( fh ) );
+	DPRINTF( "cal @0x%lx", (unsigned long)(buf - file) );
 	{
 		/* TODO: check overflow: slope */
 		unsigned slope = 0.5 + ( data->slope * 42781) / 140;
 
 		if( ! buf_set_luint16( buf, 0, data->zeropos ) ){
 			srmio_error_errno( err, "set zeropos" );
-			goto clean1;
+			goto clean2;
 		}
 		if( ! buf_set_luint16( buf, 2, slope ) ){
 			srmio_error_errno( err, "set slope" );
-			goto clean1;
-		}
-		if( ! buf_set_luint16( buf, 4, data->cused ) ){
-			srmio_error_errno( err, "set chunk count" );
-			goto clean1;
+			goto clean2;
 		}
+		buf_set_luint16( buf, 4, data->cused );
 		buf_set_uint8( buf, 6, 0 );
-
-		if( ! _xwrite( fh, buf, 7, err ))
-			goto clean2;
-
+		buf += 7;
 	}
 
 
 	/* data */
-	DPRINTF( "data @0x%lx", (unsigned long)ftell( fh ) );
-	for( i = 0; blocks[i]; ++i ){
-		srmio_marker_t bk = blocks[i];
+	DPRINTF( "data @0x%lx", (unsigned long)(buf - file) );
+	for( i = 0; i < bcnt; ++i ){
+		const struct _srmio_block_t *bk = &blocks[i];
 		unsigned ci;
 
 		DPRINTF( "block#%u from %u to %u",
@@ -754,49 +1628,55 @@ bool srmio_file_srm7_write( srmio_data_t data, FILE *fh, srmio_error_t *err )
 			bk->last );
 
 		for( ci = bk->first; ci <= bk->last; ++ci ){
-			srmio_chunk_t ck = data->chunks[ci];
-			/* TODO: check overflow: speed, temp */
-			int32_t speed = 0.5 + ( ck->speed * 1000) / 3.6;
-			int16_t temp = 0.5 + ck->temp * 10;
+			struct _srmio_chunk_t chunk;
 
-			if( ! buf_set_luint16( buf, 0, ck->pwr ) ){
-				srmio_error_errno( err, "set power" );
-				goto clean1;
-			}
-			if( ! buf_set_uint8( buf, 2, ck->cad ) ){
-				srmio_error_errno( err, "set cadence" );
-				goto clean1;
-			}
-			if( ! buf_set_uint8( buf, 3, ck->hr ) ){
-				srmio_error_errno( err, "set heartrate" );
-				goto clean1;
-			}
-			if( ! buf_set_lint32( buf, 4, speed ) ){
-				srmio_error_errno( err, "set speed" );
-				goto clean1;
-			}
-			if( ! buf_set_lint32( buf, 8, ck->ele ) ){
-				srmio_error_errno( err, "set elevation" );
-				goto clean1;
-			}
-			if( ! buf_set_lint16( buf, 12, temp ) ){
-				srmio_error_errno( err, "set temperature" );
-				goto clean1;
-			}
-
-			if( ! _xwrite( fh, buf, 14, err ))
-				goto clean2;
+			srmio_data_chunk_get( data, ci, &chunk );
+			(*cfunc)( &chunk, buf );
+			buf += chunklen;
 		}
-
-		srmio_marker_free(blocks[i]);
 	}
-	free( blocks );
+	assert( (size_t)(buf - file) == size );
 
+	if( ! _xwrite( fh, file, size, err ))
+		goto clean2;
+
+	free( file );
 	return true;
 
 clean2:
+	free( file );
 clean1:
 	return false;
 }
 
+/*
+ * write data as SRM7 file
+ *
+ * returns false on error
+ */
+bool srmio_file_srm7_write( srmio_data_t data, FILE *fh, srmio_error_t *err )
+{
+	return _srmio_file_srm_write( data, fh, '7', err );
+}
+
+/*
+ * write data as SRM6 file. Elevation and temperature are lost.
+ *
+ * returns false on error
+ */
+bool srmio_file_srm6_write( srmio_data_t data, FILE *fh, srmio_error_t *err )
+{
+	return _srmio_file_srm_write( data, fh, '6', err );
+}
 
+/*
+ * write data as SRM5 file. Same as SRM6, but it only holds the day of
+ * the recording and data without gaps. Data must start one recint
+ * after midnight. Marker notes are cut to 3 chars.
+ *
+ * returns false on error
+ */
+bool srmio_file_srm5_write( srmio_data_t data, FILE *fh, srmio_error_t *err )
+{
+	return _srmio_file_srm_write( data, fh, '5', err );
+}
@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "common.h"
+
+/*
+ * vectorized chunk decoding for SRM files.
+ *
+ * Kernels decode groups of records into small column arrays and copy
+ * them into the chunks. They only handle complete groups and return the
+ * number of decoded records - the remaining ones are left to the
+ * scalar code in file_srm.c. Groups are only decoded when another
+ * record follows them, so 4 byte loads at the end of a record never
+ * read past the buffer.
+ *
+ * Conversions use the same double operations in the same order as the
+ * scalar code, so results are identical.
+ */
+
+#ifdef USE_X86_SIMD
+
+#include <immintrin.h>
+
+#define SIMD_SSE2	__attribute__((target("sse2")))
+#define SIMD_AVX2	__attribute__((target("avx2")))
+
+/* records per group */
+#define SRM_SIMD_SSE2	4
+#define SRM_SIMD_AVX2	8
+
+/*
+ * get supported instruction set
+ */
+srmio_simd_t srmio_simd_level( void )
+{
+	if( __builtin_cpu_supports( "avx2" ) )
+		return srmio_simd_avx2;
+
+	if( __builtin_cpu_supports( "sse2" ) )
+		return srmio_simd_sse2;
+
+	return srmio_simd_none;
+}
+
+/* unaligned little endian load */
+static inline int _srm_ld32( const unsigned char *buf )
+{
+	int32_t x;
+
+	memcpy( &x, buf, sizeof(x) );
+	return x;
+}
+
+/* load 32bit word at offset "off" of 4 consecutive records */
+#define SRM_LD4( buf, off, len ) _mm_setr_epi32( \
+	_srm_ld32( (buf) + (off) ), \
+	_srm_ld32( (buf) + (off) + (len) ), \
+	_srm_ld32( (buf) + (off) + 2 * (len) ), \
+	_srm_ld32( (buf) + (off) + 3 * (len) ) )
+
+/* same for 8 records */
+#define SRM_LD8( buf, off, len ) _mm256_setr_epi32( \
+	_srm_ld32( (buf) + (off) ), \
+	_srm_ld32( (buf) + (off) + (len) ), \
+	_srm_ld32( (buf) + (off) + 2 * (len) ), \
+	_srm_ld32( (buf) + (off) + 3 * (len) ), \
+	_srm_ld32( (buf) + (off) + 4 * (len) ), \
+	_srm_ld32( (buf) + (off) + 5 * (len) ), \
+	_srm_ld32( (buf) + (off) + 6 * (len) ), \
+	_srm_ld32( (buf) + (off) + 7 * (len) ) )
+
+/************************************************************
+ *
+ * SRM7: 14 byte records
+ *
+ * 0: pwr uint16, 2: cad uint8, 3: hr uint8, 4: speed int32,
+ * 8: ele int32, 12: temp int16
+ */
+
+/*
+ * copy decoded columns into chunks
+ */
+static inline void _srm_store7( srmio_chunk_t ck, unsigned n,
+	srmio_time_t time, srmio_time_t recint,
+	const int32_t *w0, const double *speed, const int32_t *ele,
+	const double *temp )
+{
+	unsigned j;
+
+	for( j = 0; j < n; ++j, ++ck, time += recint ){
+		ck->time = time;
+		ck->dur = recint;
+		ck->pwr = w0[j] & 0xffff;
+		ck->cad = ( w0[j] >> 16 ) & 0xff;
+		ck->hr = ( (uint32_t)w0[j] >> 24 );
+		ck->speed = speed[j];
+		ck->ele = ele[j];
+		ck->temp = temp[j];
+	}
+}
+
+SIMD_SSE2 unsigned srmio_file_chunks_srm7_sse2( srmio_chunk_t ck,
+	const unsigned char *buf, unsigned n, srmio_time_t time,
+	srmio_time_t recint )
+{
+	const __m128d kspeed = _mm_set1_pd( 3.6 );
+	const __m128d kdiv = _mm_set1_pd( 1000 );
+	const __m128d ktemp = _mm_set1_pd( 0.1 );
+	const __m128d zero = _mm_setzero_pd();
+	int32_t w0[SRM_SIMD_SSE2], ele[SRM_SIMD_SSE2];
+	double speed[SRM_SIMD_SSE2], temp[SRM_SIMD_SSE2];
+	unsigned i;
+
+	for( i = 0; n - i > SRM_SIMD_SSE2; i += SRM_SIMD_SSE2,
+		buf += SRM_SIMD_SSE2 * 14, ck += SRM_SIMD_SSE2,
+		time += SRM_SIMD_SSE2 * recint ){
+
+		__m128i vs = SRM_LD4( buf, 4, 14 );
+		__m128i vt = SRM_LD4( buf, 12, 14 );
+		__m128d d;
+
+		_mm_storeu_si128( (__m128i *)w0, SRM_LD4( buf, 0, 14 ) );
+		_mm_storeu_si128( (__m128i *)ele, SRM_LD4( buf, 8, 14 ) );
+
+		d = _mm_cvtepi32_pd( vs );
+		d = _mm_max_pd( _mm_div_pd( _mm_mul_pd( d, kspeed ), kdiv ), zero );
+		_mm_storeu_pd( speed, d );
+		d = _mm_cvtepi32_pd( _mm_srli_si128( vs, 8 ) );
+		d = _mm_max_pd( _mm_div_pd( _mm_mul_pd( d, kspeed ), kdiv ), zero );
+		_mm_storeu_pd( speed + 2, d );
+
+		vt = _mm_srai_epi32( _mm_slli_epi32( vt, 16 ), 16 );
+		_mm_storeu_pd( temp, _mm_mul_pd( ktemp, _mm_cvtepi32_pd( vt ) ));
+		_mm_storeu_pd( temp + 2, _mm_mul_pd( ktemp,
+			_mm_cvtepi32_pd( _mm_srli_si128( vt, 8 ) ) ));
+
+		_srm_store7( ck, SRM_SIMD_SSE2, time, recint,
+			w0, speed, ele, temp );
+	}
+
+	return i;
+}
+
+SIMD_AVX2 unsigned srmio_file_chunks_srm7_avx2( srmio_chunk_t ck,
+	const unsigned char *buf, unsigned n, srmio_time_t time,
+	srmio_time_t recint )
+{
+	const __m256d kspeed = _mm256_set1_pd( 3.6 );
+	const __m256d kdiv = _mm256_set1_pd( 1000 );
+	const __m256d ktemp = _mm256_set1_pd( 0.1 );
+	const __m256d zero = _mm256_setzero_pd();
+	int32_t w0[SRM_SIMD_AVX2], ele[SRM_SIMD_AVX2];
+	double speed[SRM_SIMD_AVX2], temp[SRM_SIMD_AVX2];
+	unsigned i;
+
+	for( i = 0; n - i > SRM_SIMD_AVX2; i += SRM_SIMD_AVX2,
+		buf += SRM_SIMD_AVX2 * 14, ck += SRM_SIMD_AVX2,
+		time += SRM_SIMD_AVX2 * recint ){
+
+		__m256i vs = SRM_LD8( buf, 4, 14 );
+		__m256i vt = SRM_LD8( buf, 12, 14 );
+		__m256d d;
+
+		_mm256_storeu_si256( (__m256i *)w0, SRM_LD8( buf, 0, 14 ));
+		_mm256_storeu_si256( (__m256i *)ele, SRM_LD8( buf, 8, 14 ));
+
+		d = _mm256_cvtepi32_pd( _mm256_castsi256_si128( vs ));
+		d = _mm256_max_pd( _mm256_div_pd( _mm256_mul_pd( d, kspeed ),
+			kdiv ), zero );
+		_mm256_storeu_pd( speed, d );
+		d = _mm256_cvtepi32_pd( _mm256_extracti128_si256( vs, 1 ));
+		d = _mm256_max_pd( _mm256_div_pd( _mm256_mul_pd( d, kspeed ),
+			kdiv ), zero );
+		_mm256_storeu_pd( speed + 4, d );
+
+		vt = _mm256_srai_epi32( _mm256_slli_epi32( vt, 16 ), 16 );
+		_mm256_storeu_pd( temp, _mm256_mul_pd( ktemp,
+			_mm256_cvtepi32_pd( _mm256_castsi256_si128( vt ))));
+		_mm256_storeu_pd( temp + 4, _mm256_mul_pd( ktemp,
+			_mm256_cvtepi32_pd( _mm256_extracti128_si256( vt, 1 ))));
+
+		_srm_store7( ck, SRM_SIMD_AVX2, time, recint,
+			w0, speed, ele, temp );
+	}
+
+	return i;
+}
+
+/************************************************************
+ *
+ * SRM5/6: 5 byte records
+ *
+ * byte 0: speed bits 0-6, byte 1: pwr bits 0-3 + speed bits 7-10,
+ * byte 2: pwr bits 4-11, byte 3: cad, byte 4: hr
+ */
+
+/*
+ * copy decoded columns into chunks
+ */
+static inline void _srm_store6( srmio_chunk_t ck, unsigned n,
+	srmio_time_t time, srmio_time_t recint, const int32_t *pwr,
+	const int32_t *w1, const double *speed )
+{
+	unsigned j;
+
+	for( j = 0; j < n; ++j, ++ck, time += recint ){
+		ck->time = time;
+		ck->dur = recint;
+		ck->temp = 0;
+		ck->pwr = pwr[j];
+		ck->speed = speed[j];
+		ck->cad = w1[j] >> 16 & 0xff;
+		ck->hr = (uint32_t)w1[j] >> 24;
+		ck->ele = 0;
+	}
+}
+
+SIMD_SSE2 unsigned srmio_file_chunks_srm6_sse2( srmio_chunk_t ck,
+	const unsigned char *buf, unsigned n, srmio_time_t time,
+	srmio_time_t recint )
+{
+	const __m128i m7f = _mm_set1_epi32( 0x7f );
+	const __m128i m0f = _mm_set1_epi32( 0x0f );
+	const __m128i mf0 = _mm_set1_epi32( 0xf0 );
+	const __m128i mff = _mm_set1_epi32( 0xff );
+	const __m128d k3 = _mm_set1_pd( 3 );
+	const __m128d k26 = _mm_set1_pd( 26 );
+	int32_t pwr[SRM_SIMD_SSE2], w1[SRM_SIMD_SSE2];
+	double speed[SRM_SIMD_SSE2];
+	unsigned i;
+
+	for( i = 0; n - i > SRM_SIMD_SSE2; i += SRM_SIMD_SSE2,
+		buf += SRM_SIMD_SSE2 * 5, ck += SRM_SIMD_SSE2,
+		time += SRM_SIMD_SSE2 * recint ){
+
+		/* c0 c1 c2 cad, c1 c2 cad hr */
+		__m128i v0 = SRM_LD4( buf, 0, 5 );
+		__m128i c1 = _mm_and_si128( _mm_srli_epi32( v0, 8 ), mff );
+		__m128i c2 = _mm_and_si128( _mm_srli_epi32( v0, 16 ), mff );
+		__m128i raw;
+		__m128d d;
+
+		_mm_storeu_si128( (__m128i *)w1, SRM_LD4( buf, 1, 5 ) );
+		_mm_storeu_si128( (__m128i *)pwr, _mm_or_si128(
+			_mm_and_si128( c1, m0f ), _mm_slli_epi32( c2, 4 )));
+
+		raw = _mm_or_si128( _mm_slli_epi32( _mm_and_si128( c1, mf0 ), 3 ),
+			_mm_and_si128( v0, m7f ));
+
+		d = _mm_div_pd( _mm_mul_pd( _mm_cvtepi32_pd( raw ), k3 ), k26 );
+		_mm_storeu_pd( speed, d );
+		d = _mm_cvtepi32_pd( _mm_srli_si128( raw, 8 ) );
+		d = _mm_div_pd( _mm_mul_pd( d, k3 ), k26 );
+		_mm_storeu_pd( speed + 2, d );
+
+		_srm_store6( ck, SRM_SIMD_SSE2, time, recint, pwr, w1, speed );
+	}
+
+	return i;
+}
+
+SIMD_AVX2 unsigned srmio_file_chunks_srm6_avx2( srmio_chunk_t ck,
+	const unsigned char *buf, unsigned n, srmio_time_t time,
+	srmio_time_t recint )
+{
+	const __m256i m7f = _mm256_set1_epi32( 0x7f );
+	const __m256i m0f = _mm256_set1_epi32( 0x0f );
+	const __m256i mf0 = _mm256_set1_epi32( 0xf0 );
+	const __m256i mff = _mm256_set1_epi32( 0xff );
+	const __m256d k3 = _mm256_set1_pd( 3 );
+	const __m256d k26 = _mm256_set1_pd( 26 );
+	int32_t pwr[SRM_SIMD_AVX2], w1[SRM_SIMD_AVX2];
+	double speed[SRM_SIMD_AVX2];
+	unsigned i;
+
+	for( i = 0; n - i > SRM_SIMD_AVX2; i += SRM_SIMD_AVX2,
+		buf += SRM_SIMD_AVX2 * 5, ck += SRM_SIMD_AVX2,
+		time += SRM_SIMD_AVX2 * recint ){
+
+		/* c0 c1 c2 cad, c1 c2 cad hr */
+		__m256i v0 = SRM_LD8( buf, 0, 5 );
+		__m256i c1 = _mm256_and_si256( _mm256_srli_epi32( v0, 8 ), mff );
+		__m256i c2 = _mm256_and_si256( _mm256_srli_epi32( v0, 16 ), mff );
+		__m256i raw;
+		__m256d d;
+
+		_mm256_storeu_si256( (__m256i *)w1, SRM_LD8( buf, 1, 5 ));
+		_mm256_storeu_si256( (__m256i *)pwr, _mm256_or_si256(
+			_mm256_and_si256( c1, m0f ), _mm256_slli_epi32( c2, 4 )));
+
+		raw = _mm256_or_si256( _mm256_slli_epi32(
+			_mm256_and_si256( c1, mf0 ), 3 ),
+			_mm256_and_si256( v0, m7f ));
+
+		d = _mm256_cvtepi32_pd( _mm256_castsi256_si128( raw ));
+		_mm256_storeu_pd( speed, _mm256_div_pd( _mm256_mul_pd( d, k3 ),
+			k26 ));
+		d = _mm256_cvtepi32_pd( _mm256_extracti128_si256( raw, 1 ));
+		_mm256_storeu_pd( speed + 4, _mm256_div_pd( _mm256_mul_pd( d, k3 ),
+			k26 ));
+
+		_srm_store6( ck, SRM_SIMD_AVX2, time, recint, pwr, w1, speed );
+	}
+
+	return i;
+}
+
+#else
+
+srmio_simd_t srmio_simd_level( void )
+{
+	return srmio_simd_none;
+}
+
+#endif
@@ -55,7 +55,9 @@ bool srmio_file_wkt_write( srmio_data_t data, FILE *fh, srmio_error_t *err )
 	}
 
 	for( i=0; i < data->cused; ++i ){
-		srmio_chunk_t ck = data->chunks[i];
+		struct _srmio_chunk_t ck;
+
+		srmio_data_chunk_get( data, i, &ck );
 
 		if( 0 > fprintf( fh,
 			"%.1lf\t"	/* time */
@@ -66,14 +68,14 @@ bool srmio_file_wkt_write( srmio_data_t data, FILE *fh, srmio_error_t *err )
 			"%.3lf\t"	/* dist */
 			"%ld\t"		/* ele */
 			"%.1lf\n",	/* temp */
-			(double)((ck->time + ck->dur) / 10),
-			(double)(ck->dur / 10),
-			(double)( (double)ck->pwr * ck->dur / 10 ),
-			ck->cad,
-			ck->hr,
-			(double)( (double)ck->speed * ck->dur / 36 ),
-			ck->ele,
-			ck->temp
+			(double)((ck.time + ck.dur) / 10),
+			(double)(ck.dur / 10),
+			(double)( (double)ck.pwr * ck.dur / 10 ),
+			ck.cad,
+			ck.hr,
+			(double)( ck.speed * ck.dur / 36 ),
+			ck.ele,
+			ck.temp
 			) ){
 
 			srmio_error_errno( err, "write" );
@@ -86,14 +88,17 @@ bool srmio_file_wkt_write( srmio_data_t data, FILE *fh, srmio_error_t *err )
 		goto clean2;
 	}
 
+	srmio_data_marker_sync( data );
 	for( i=0; i < data->mused; ++i ){
 		srmio_marker_t mk = data->marker[i];
-		srmio_chunk_t first = data->chunks[mk->first];
-		srmio_chunk_t last = data->chunks[mk->last];
+		struct _srmio_chunk_t first, last;
+
+		srmio_data_chunk_get( data, mk->first, &first );
+		srmio_data_chunk_get( data, mk->last, &last );
 
 		if( 0 > fprintf( fh, "%.1lf\t%.1lf\t%s\n",
-			(double)( first->time / 10 ),
-			(double)( (last->time + last->dur) / 10 ),
+			(double)( first.time / 10 ),
+			(double)( (last.time + last.dur) / 10 ),
 			mk->notes ? mk->notes : "" ) ){
 
 			srmio_error_errno( err, "write" );
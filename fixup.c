@@ -9,6 +9,49 @@
 
 #include "common.h"
 
+/*
+ * synthesize miss chunks to fill the gap between last and next. Values
+ * are interpolated linearly. The chunks are written to consecutive
+ * storage at fill.
+ */
+static void _srmio_fixup_fill( srmio_chunk_t fill, unsigned miss,
+	const struct _srmio_chunk_t *last, const struct _srmio_chunk_t *next )
+{
+	srmio_time_t start = last->time + last->dur;
+	srmio_time_t recint = next->dur;
+	double div = miss +1;
+
+	/* copy everything to locals - fill might alias them */
+	double temp = last->temp;
+	double pwr = last->pwr;
+	double speed = last->speed;
+	double cad = last->cad;
+	double hr = last->hr;
+	double ele = last->ele;
+
+	double dtemp = next->temp - last->temp;
+	double dpwr = (int)( next->pwr - last->pwr );
+	double dspeed = next->speed - last->speed;
+	double dcad = (int)( next->cad - last->cad );
+	double dhr = (int)( next->hr - last->hr );
+	double dele = next->ele - last->ele;
+
+	unsigned i;
+
+	for( i = 0; i < miss; ++i ){
+		double part = (double)(i +1) / div;
+
+		fill[i].time = start + i * recint;
+		fill[i].dur = recint;
+		fill[i].temp = part * dtemp + temp;
+		fill[i].pwr = part * dpwr + pwr + 0.5;
+		fill[i].speed = part * dspeed + speed;
+		fill[i].cad = part * dcad + cad + 0.5;
+		fill[i].hr = part * dhr + hr;
+		fill[i].ele = part * dele + ele + 0.5;
+	}
+}
+
 /*
  * add chunk to data.
  * chunk's timestamp is adjusted to fit recint
@@ -23,8 +66,8 @@ static bool srmio_data_add_fillp( srmio_data_t data, srmio_chunk_t chunk,
 	srmio_chunk_t last = data->chunks[data->cused-1];
 	srmio_time_t recint = chunk->dur;
 	srmio_time_t lnext = last->time + last->dur;
+	srmio_chunk_t fill;
 	unsigned miss;
-	unsigned i;
 
 	assert(data);
 	assert(data->cused);
@@ -54,58 +97,135 @@ static bool srmio_data_add_fillp( srmio_data_t data, srmio_chunk_t chunk,
 	}
 
 	if( ! miss )
-		return true;
+		return srmio_data_add_ownp( data, chunk, err );
 
 	DPRINTF( "synthesizing %d chunks @%.1f",
 		miss, (double)lnext / 10 );
 
-	/* ... adjust marker indices */
-	for( i=0; i < data->mused; ++i ){
-		srmio_marker_t mark = data->marker[i];
+	/* ... adjust marker indices - deferred, see callers */
+	if( ! srmio_mindex_shift( data, data->cused, miss, err ) )
+		return false;
 
-		if( mark->first >= data->cused )
-			mark->first += miss;
+	/* ... insert averaged data */
+	if( NULL == (fill = srmio_data_chunks_alloc( data, miss, err )))
+		return false;
 
-		if( mark->last >= data->cused )
-			mark->last += miss;
-	}
+	_srmio_fixup_fill( fill, miss, last, chunk );
+
+	if( ! srmio_data_add_chunksp( data, fill, miss, err ) )
+		return false;
+
+	if( ! srmio_data_add_ownp( data, chunk, err ) )
+		return false;
+
+	return true;
+}
 
-	/* ... insert averaged data */
-	for( i = 1; i <= miss; ++i ){
-		srmio_chunk_t fill;
-		double part = (double)i / (miss +1 );
 
-		if( NULL == (fill = srmio_chunk_new(err) ))
+/*
+ * add chunk to fixed data, fix small gaps/overlaps towards the
+ * previous chunk. When src is given, unmodified chunks are shared with
+ * chunk c of src instead of copying them.
+ */
+static bool _srmio_fixup_chunk( srmio_data_t fixed, srmio_chunk_t chunk,
+	srmio_data_t src, unsigned c, srmio_error_t *err )
+{
+	srmio_chunk_t last;
+	srmio_chunk_t this;
+	srmio_time_t recint = chunk->dur;
+	srmio_time_t lnext;
+
+	if( ! fixed->cused )
+		goto nofix;
+
+	last = fixed->chunks[fixed->cused-1];
+	lnext = last->time + last->dur;
+
+	/* overlapping < 1sec, adjust this time */
+	if( chunk->time < lnext
+		&& lnext - last->time < 10 ){
+
+		DPRINTF("adjusting overlap %.1f -> %.1f",
+			(double)chunk->time / 10,
+			(double)lnext / 10);
+
+		if( NULL == ( this = srmio_data_chunk_clone( fixed,
+			chunk, err )))
+
 			return false;
 
-		fill->time = last->time + last->dur + ((i-1) * recint);
-		fill->dur = recint;
-		fill->temp = part * (chunk->temp
-			- last->temp) + last->temp;
-		fill->pwr = part * (int)( chunk->pwr - last->pwr )
-			+ last->pwr + 0.5;
-		fill->speed = part * (chunk->speed
-			- last->speed) + last->speed;
-		fill->cad = part * (int)( chunk->cad - last->cad )
-			+ last->cad + 0.5;
-		fill->hr = part * (int)( chunk->hr
-			- last->hr ) + last->hr;
-		fill->ele = part * (chunk->ele - last->ele)
-			+ last->ele + 0.5;
-
-		if( ! srmio_data_add_chunkp( data, fill, err ) ){
-			srmio_chunk_free(fill);
+		this->time = lnext;
+
+		return srmio_data_add_ownp( fixed, this, err );
+	}
+
+	/* small gap > recint ... fill/shift  */
+	if( lnext < chunk->time
+		&& chunk->time - lnext <= 2*recint ){
+
+		if( NULL == ( this = srmio_data_chunk_clone( fixed,
+			chunk, err )))
+
 			return false;
+
+		return srmio_data_add_fillp( fixed, this, err );
+	}
+
+nofix:
+	/* nothing to fix (yet) */
+	if( src )
+		return srmio_data_add_chunkref( fixed, src, c, err );
+
+	return srmio_data_add_chunk( fixed, chunk, err );
+}
+
+/*
+ * fix "severe" overlaping: move chunks before an overlap back in time.
+ * Chunks after "last" are known to be fine, chunks before "first" are
+ * left alone.
+ */
+static bool _srmio_data_fix_overlap( srmio_data_t data, unsigned first,
+	unsigned last, srmio_error_t *err )
+{
+	srmio_time_t delta = 0;
+	unsigned c;
+
+	srmio_data_marker_sync( data );
+
+	for( c = last; c > first; --c ){
+		srmio_chunk_t this = data->chunks[c-1];
+		srmio_chunk_t next = data->chunks[c];
+		srmio_time_t recint = this->dur;
+		/* next is already moved by delta */
+		srmio_time_t nprev = next->time - recint + delta;
+
+		if( nprev < this->time ){
+			delta += this->time - nprev;
+			DPRINTF( "overlaping blocks #%d "
+				"@.%.1lf - %.1lf, "
+				"new delta: %.1f",
+				c,
+				0.1 * this->time,
+				0.1 * next->time,
+				(double)delta/10 );
 		}
+
+		if( ! delta )
+			continue;
+
+		if( NULL == (this = srmio_data_chunk_unshare( data, c-1, err )))
+			return false;
+
+		this->time -= delta;
 	}
 
-	if( ! srmio_data_add_chunkp( data, chunk, err ) )
-		return false;
+	/* times were modified in place */
+	if( delta )
+		srmio_data_changed( data );
 
 	return true;
 }
 
-
 /* TODO: skip n equal chunks or set pwr+cad = 0 before first chunk with
  * cad=0. These n chunks were recorded while PC was waiting for next
  * signal ... timeout is for cad=20 -> thats 3 chunks @ 1sec recint */
@@ -114,7 +234,8 @@ static bool srmio_data_add_fillp( srmio_data_t data, srmio_chunk_t chunk,
  * fix small time leaps at block boundaries
  * fix timestamps of overlapping chunks
  * fill small gaps with averaged data
- * fixed data is copied to a new srmio_data_t handle
+ * fixed data is copied to a new srmio_data_t handle. Unmodified chunks
+ * are shared with the original data.
  *
  * returns pointer to newly allocated srmio_data
  * returns NULL on failure
@@ -122,7 +243,7 @@ static bool srmio_data_add_fillp( srmio_data_t data, srmio_chunk_t chunk,
 srmio_data_t srmio_data_fixup( srmio_data_t data, srmio_error_t *err )
 {
 	srmio_data_t fixed;
-	srmio_time_t delta = 0;
+	struct _srmio_chunk_t chunk;
 	unsigned c, m;
 
 	assert( data );
@@ -139,10 +260,13 @@ srmio_data_t srmio_data_fixup( srmio_data_t data, srmio_error_t *err )
 		return NULL;
 
 	/* copy marker */
+	srmio_data_marker_sync( data );
 	for( m=0; m < data->mused; ++m ){
 		srmio_marker_t mark;
 
-		if( NULL == ( mark = srmio_marker_clone( data->marker[m], err ) ) )
+		if( NULL == ( mark = srmio_data_marker_clone( fixed,
+			data->marker[m], err ) ) )
+
 			goto clean1;
 
 		if( ! srmio_data_add_markerp( fixed, mark, err ) )
@@ -150,21 +274,91 @@ srmio_data_t srmio_data_fixup( srmio_data_t data, srmio_error_t *err )
 	}
 
 	/* copy chunks + fix smaller gaps/overlaps */
+	for( c=0; c < data->cused; ++c ){
+		srmio_data_chunk_get( data, c, &chunk );
+
+		if( ! _srmio_fixup_chunk( fixed, &chunk, data, c, err ))
+			goto clean1;
+	}
 
-	if( ! srmio_data_add_chunk( fixed, data->chunks[0], err ) )
+	if( ! _srmio_data_fix_overlap( fixed, 0, fixed->cused -1, err ) )
 		goto clean1;
 
-	for( c=1; c < data->cused; ++c ){
-		srmio_chunk_t last = fixed->chunks[fixed->cused-1];
-		srmio_chunk_t this;
-		srmio_time_t recint;
-		srmio_time_t lnext;
+	srmio_data_marker_sync( fixed );
+	return fixed;
 
-		if( NULL == ( this = srmio_chunk_clone( data->chunks[c], err )))
-			goto clean1;
+clean1:
+	srmio_data_free( fixed );
+	return NULL;
+}
+
+/* gap to fill by srmio_data_fixup_inplace() */
+struct _srmio_fixup_gap_t {
+	unsigned	c;	/* chunk following the gap */
+	unsigned	miss;	/* chunks to insert */
+	unsigned	total;	/* chunks inserted up to this gap */
+};
+
+/*
+ * new index of chunk i after filling the gaps
+ */
+static unsigned _srmio_fixup_shifted( struct _srmio_fixup_gap_t *gap,
+	unsigned gused, unsigned i )
+{
+	unsigned lo = 0, hi = gused;
+
+	/* find last gap with c <= i */
+	while( lo < hi ){
+		unsigned mid = lo + (hi - lo) / 2;
+
+		if( gap[mid].c <= i )
+			lo = mid +1;
+		else
+			hi = mid;
+	}
+
+	if( ! lo )
+		return i;
+
+	return i + gap[lo-1].total;
+}
+
+/*
+ * like srmio_data_fixup(), but modifies data instead of creating a
+ * copy. Timestamps are adjusted first, gaps are filled afterwards in
+ * a single pass moving each chunk at most once.
+ *
+ * On failure data is still consistent, but might be fixed partially.
+ *
+ * returns false on error
+ */
+bool srmio_data_fixup_inplace( srmio_data_t data, srmio_error_t *err )
+{
+	struct _srmio_fixup_gap_t *gap = NULL;
+	unsigned gused = 0, gavail = 0;
+	srmio_chunk_t fill;
+	unsigned total = 0;
+	unsigned c, g, dst;
+
+	assert( data );
+
+	DPRINTF("start %d", data->cused );
+
+	if( data->cused < 1 ){
+		srmio_error_set( err, "no data" );
+		return false;
+	}
+
+	if( ! srmio_data_expand( data, err ) )
+		return false;
 
-		recint = this->dur;
-		lnext = last->time + last->dur;
+	/* fix timestamps, find gaps */
+	for( c=1; c < data->cused; ++c ){
+		srmio_chunk_t last = data->chunks[c-1];
+		srmio_chunk_t this = data->chunks[c];
+		srmio_time_t recint = this->dur;
+		srmio_time_t lnext = last->time + last->dur;
+		unsigned miss;
 
 		/* overlapping < 1sec, adjust this time */
 		if( this->time < lnext
@@ -173,53 +367,640 @@ srmio_data_t srmio_data_fixup( srmio_data_t data, srmio_error_t *err )
 			DPRINTF("adjusting overlap %.1f -> %.1f",
 				(double)this->time / 10,
 				(double)lnext / 10);
-			this->time = lnext;
 
-			if( ! srmio_data_add_chunkp( fixed, this, err ) )
+			if( NULL == (this = srmio_data_chunk_unshare( data, c,
+				err )))
+
 				goto clean1;
 
+			this->time = lnext;
+			continue;
+		}
+
+		/* nothing to fix (yet) */
+		if( lnext >= this->time || this->time - lnext > 2*recint )
+			continue;
+
 		/* small gap > recint ... fill/shift  */
-		} else if( lnext < this->time
-			&& this->time - lnext <= 2*recint ){
+		if( lnext < last->time ){
+			srmio_error_set( err, "time overflow error" );
+			goto clean1;
+		}
+
+		miss = 0.4 + (this->time - lnext) / recint;
+		lnext += recint * miss;
+
+		/* ... adjust current time to fit n*recint */
+		if( this->time != lnext ){
+			DPRINTF("adjusting gap %.1f -> %.1f",
+				(double)this->time / 10,
+				(double)lnext / 10);
+
+			if( NULL == (this = srmio_data_chunk_unshare( data, c,
+				err )))
 
-			if( ! srmio_data_add_fillp( fixed, this, err ))
 				goto clean1;
 
-		/* nothing to fix (yet) */
-		} else {
-			if( ! srmio_data_add_chunkp( fixed, this, err ) )
+			this->time = lnext;
+		}
+
+		if( ! miss )
+			continue;
+
+		if( miss > UINT_MAX - data->cused - total ){
+			srmio_error_set( err, "too many chunks" );
+			goto clean1;
+		}
+
+		if( gused >= gavail ){
+			struct _srmio_fixup_gap_t *tmp;
+			unsigned avail = gavail ? 2 * gavail : 16;
+
+			if( NULL == (tmp = realloc( gap, avail
+				* sizeof(struct _srmio_fixup_gap_t) ))){
+
+				srmio_error_errno( err, "fixup gaps" );
 				goto clean1;
+			}
 
+			gap = tmp;
+			gavail = avail;
 		}
 
+		total += miss;
+		gap[gused].c = c;
+		gap[gused].miss = miss;
+		gap[gused].total = total;
+		++gused;
 	}
 
-	/* fix "severe" overlaping */
-	for( c = fixed->cused -1; c > 0; --c ){
-		srmio_chunk_t this = fixed->chunks[c-1];
-		srmio_chunk_t next = fixed->chunks[c];
-		srmio_time_t recint = this->dur;
-		srmio_time_t nprev = next->time - recint - delta;
+	/* times were modified in place */
+	srmio_data_changed( data );
 
-		if( nprev < this->time ){
-			delta += this->time - nprev;
-			DPRINTF( "overlaping blocks #%d "
-				"@.%.1lf - %.1lf, "
-				"new delta: %.1f",
-				c,
-				0.1 * this->time,
-				0.1 * next->time,
-				(double)delta/10 );
+	if( ! total )
+		goto overlap;
+
+	DPRINTF( "synthesizing %u chunks in %u gaps", total, gused );
+
+	/* get all memory before data is touched */
+	if( ! srmio_data_reserve( data, data->cused + total, 0, err ) )
+		goto clean1;
+
+	if( NULL == (fill = srmio_arena_alloc( data->carena, total, err )))
+		goto clean1;
+
+	/* ... adjust marker indices */
+	srmio_data_marker_sync( data );
+	for( c = 0; c < data->mused; ++c ){
+		srmio_marker_t mk = data->marker[c];
+
+		mk->first = _srmio_fixup_shifted( gap, gused, mk->first );
+		mk->last = _srmio_fixup_shifted( gap, gused, mk->last );
+	}
+
+	/* ... move chunks, insert averaged data - starting at the end */
+	dst = data->cused + total;
+	data->chunks[dst] = NULL;
+	c = data->cused;
+	for( g = gused; g > 0; --g ){
+		struct _srmio_fixup_gap_t *gp = &gap[g-1];
+		srmio_chunk_t last = data->chunks[gp->c -1];
+		unsigned i;
+
+		while( c > gp->c )
+			data->chunks[--dst] = data->chunks[--c];
+
+		DPRINTF( "synthesizing %d chunks @%.1f",
+			gp->miss, (double)(last->time + last->dur) / 10 );
+
+		total -= gp->miss;
+		_srmio_fixup_fill( &fill[total], gp->miss, last,
+			data->chunks[dst] );
+
+		for( i = gp->miss; i > 0; --i )
+			data->chunks[--dst] = &fill[total + i -1];
+	}
+	assert( dst == c );
+	data->cused += gap[gused-1].total;
+
+	srmio_data_changed( data );
+
+overlap:
+	free( gap );
+	return _srmio_data_fix_overlap( data, 0, data->cused -1, err );
+
+clean1:
+	free( gap );
+	srmio_data_changed( data );
+	return false;
+}
+
+/*
+ * parallel fixup: chunks following a gap of more than 2*recint don't
+ * need the previous chunk to get fixed. The data is split into parts at
+ * such gaps, the parts are fixed independently on a thread pool and
+ * joined afterwards.
+ */
+
+#define FIXUP_PART_MIN		4096	/* min chunks per part */
+#define FIXUP_PARTS_THREAD	4	/* parts per thread */
+
+struct _srmio_fixup_part_t {
+	unsigned	first;	/* first chunk in src */
+	unsigned	end;	/* chunk after last one in src */
+
+	srmio_data_t	fixed;
+	struct _srmio_fixup_gap_t	*gap;	/* filled gaps, total unset */
+	unsigned	gused;
+	unsigned	gavail;
+	unsigned	olast;	/* chunk following last overlap in fixed */
+
+	bool		failed;
+	srmio_error_t	err;
+};
+
+struct _srmio_fixup_job_t {
+	srmio_data_t	src;
+	struct _srmio_fixup_part_t	*part;
+};
+
+/*
+ * fix one part - called by srmio_pool_run()
+ */
+static void _srmio_fixup_part( void *arg, unsigned i )
+{
+	struct _srmio_fixup_job_t *job = arg;
+	struct _srmio_fixup_part_t *part = &job->part[i];
+	srmio_data_t fixed;
+	struct _srmio_chunk_t chunk;
+	unsigned c;
+
+	if( NULL == (fixed = srmio_data_header( job->src, &part->err )))
+		goto clean1;
+
+	part->fixed = fixed;
+	srmio_data_stats_disable( fixed );
+
+	if( ! srmio_data_reserve( fixed, part->end - part->first, 0,
+		&part->err ))
+
+		goto clean1;
+
+	for( c = part->first; c < part->end; ++c ){
+		unsigned used = fixed->cused;
+		srmio_chunk_t prev, this;
+
+		srmio_data_chunk_get( job->src, c, &chunk );
+
+		if( ! _srmio_fixup_chunk( fixed, &chunk, job->src, c,
+			&part->err ))
+
+			goto clean1;
+
+		if( fixed->cused > used +1 ){
+			if( part->gused >= part->gavail ){
+				struct _srmio_fixup_gap_t *tmp;
+				unsigned avail = part->gavail
+					? 2 * part->gavail : 16;
+
+				if( NULL == (tmp = realloc( part->gap, avail
+					* sizeof(struct _srmio_fixup_gap_t) ))){
+
+					srmio_error_errno( &part->err,
+						"fixup gaps" );
+					goto clean1;
+				}
+
+				part->gap = tmp;
+				part->gavail = avail;
+			}
+
+			part->gap[part->gused].c = c;
+			part->gap[part->gused].miss = fixed->cused - used -1;
+			++part->gused;
 		}
-		this->time -= delta;
+
+		if( fixed->cused < 2 )
+			continue;
+
+		prev = fixed->chunks[fixed->cused -2];
+		this = fixed->chunks[fixed->cused -1];
+		if( this->time < prev->time + prev->dur )
+			part->olast = fixed->cused -1;
 	}
 
-	return fixed;
+	return;
+
+clean1:
+	part->failed = true;
+}
+
+/*
+ * check if the first chunk of part doesn't need fixing towards the last
+ * chunk of the previous one - see _srmio_fixup_chunk().
+ */
+static bool _srmio_fixup_part_independent( srmio_data_t src,
+	struct _srmio_fixup_part_t *prev, struct _srmio_fixup_part_t *part )
+{
+	struct _srmio_chunk_t chunk;
+	srmio_chunk_t last;
+	srmio_time_t lnext;
+
+	srmio_data_chunk_get( src, part->first, &chunk );
+	last = prev->fixed->chunks[prev->fixed->cused -1];
+	lnext = last->time + last->dur;
+
+	/* overlaps of any size are handled across all chunks */
+	if( chunk.time < lnext )
+		return false;
+
+	if( lnext < chunk.time && chunk.time - lnext <= 2*chunk.dur )
+		return false;
+
+	return true;
+}
+
+/*
+ * like srmio_data_fixup(), but fixes independent parts of data on the
+ * threads of pool. Falls back to srmio_data_fixup() for small data, or
+ * when parts turn out to depend on each other after fixing them.
+ *
+ * Chunks of data are shared with other threads while this runs, data
+ * mustn't be modified.
+ *
+ * returns pointer to newly allocated srmio_data
+ * returns NULL on failure
+ */
+srmio_data_t srmio_data_fixup_parallel( srmio_data_t data,
+	srmio_pool_t pool, srmio_error_t *err )
+{
+	struct _srmio_fixup_job_t job;
+	struct _srmio_fixup_part_t *part = NULL;
+	struct _srmio_fixup_gap_t *gap = NULL;
+	srmio_data_t fixed = NULL;
+	struct _srmio_chunk_t prev, this;
+	unsigned pused, pavail, size;
+	unsigned gused = 0, total = 0, olast = 0;
+	unsigned c, p, m;
+
+	assert( data );
+
+	if( ! pool || srmio_pool_threads( pool ) < 2
+		|| data->cused < 2 * FIXUP_PART_MIN )
+
+		return srmio_data_fixup( data, err );
+
+	DPRINTF("start %d", data->cused );
+
+	/* find parts */
+	pavail = srmio_pool_threads( pool ) * FIXUP_PARTS_THREAD;
+	size = data->cused / pavail;
+	if( size < FIXUP_PART_MIN )
+		size = FIXUP_PART_MIN;
+
+	if( NULL == (part = malloc( pavail
+		* sizeof(struct _srmio_fixup_part_t) ))){
+
+		srmio_error_errno( err, "fixup parts" );
+		return NULL;
+	}
+	memset( part, 0, pavail * sizeof(struct _srmio_fixup_part_t) );
+
+	pused = 1;
+	srmio_data_chunk_get( data, 0, &prev );
+	for( c = 1; c < data->cused; ++c, prev = this ){
+		srmio_time_t lnext = prev.time + prev.dur;
+
+		srmio_data_chunk_get( data, c, &this );
+
+		if( c - part[pused-1].first < size || pused >= pavail )
+			continue;
+
+		if( this.time <= lnext
+			|| this.time - lnext <= 2 * this.dur )
+			continue;
+
+		part[pused-1].end = c;
+		part[pused++].first = c;
+	}
+	part[pused-1].end = data->cused;
+
+	if( pused < 2 ){
+		free( part );
+		return srmio_data_fixup( data, err );
+	}
+
+	DPRINTF("fixing %u parts", pused );
+
+	job.src = data;
+	job.part = part;
+	srmio_pool_run( pool, _srmio_fixup_part, &job, pused );
+
+	for( p = 0; p < pused; ++p ){
+		if( part[p].failed ){
+			srmio_error_copy( err, &part[p].err );
+			goto clean1;
+		}
+
+		if( p && ! _srmio_fixup_part_independent( data, &part[p-1],
+			&part[p] )){
+
+			DPRINTF("part %u depends on previous, "
+				"falling back to sequential fixup", p );
+			goto sequential;
+		}
+
+		gused += part[p].gused;
+	}
+
+	/* join parts */
+	if( NULL == (fixed = srmio_data_header( data, err ) ))
+		goto clean1;
+
+	if( gused && NULL == (gap = malloc( gused
+		* sizeof(struct _srmio_fixup_gap_t) ))){
+
+		srmio_error_errno( err, "fixup gaps" );
+		goto clean1;
+	}
+
+	gused = 0;
+	for( p = 0; p < pused; ++p ){
+		unsigned g;
+
+		if( part[p].olast )
+			olast = fixed->cused + part[p].olast;
+
+		if( ! srmio_data_add_chunkrefs( fixed, part[p].fixed, 0,
+			part[p].fixed->cused, err ))
+
+			goto clean1;
+
+		for( g = 0; g < part[p].gused; ++g ){
+			gap[gused] = part[p].gap[g];
+			total += gap[gused].miss;
+			gap[gused].total = total;
+			++gused;
+		}
+	}
+
+	/* copy marker, adjusted for filled gaps */
+	srmio_data_marker_sync( data );
+	for( m=0; m < data->mused; ++m ){
+		srmio_marker_t mark;
+
+		if( NULL == ( mark = srmio_data_marker_clone( fixed,
+			data->marker[m], err ) ) )
+
+			goto clean1;
+
+		mark->first = _srmio_fixup_shifted( gap, gused, mark->first );
+		mark->last = _srmio_fixup_shifted( gap, gused, mark->last );
+
+		if( ! srmio_data_add_markerp( fixed, mark, err ) )
+			goto clean1;
+	}
+
+	if( olast && ! _srmio_data_fix_overlap( fixed, 0, olast, err ) )
+		goto clean1;
+
+	srmio_data_marker_sync( fixed );
+
+	goto clean2;
+
+sequential:
+	fixed = srmio_data_fixup( data, err );
+	goto clean2;
 
 clean1:
 	srmio_data_free( fixed );
-	return NULL;
+	fixed = NULL;
+
+clean2:
+	for( p = 0; p < pused; ++p ){
+		srmio_data_free( part[p].fixed );
+		free( part[p].gap );
+	}
+	free( part );
+	free( gap );
+
+	return fixed;
 }
 
+/*
+ * streaming fixup: fixes chunks while they're added to a data set one
+ * by one - for example during download. The data is fixed the way
+ * srmio_data_split_iter_new() followed by srmio_data_fixup_inplace()
+ * on each piece would: nothing is fixed across the points where split
+ * cuts the unmodified data.
+ *
+ * Gaps and small overlaps towards the previous chunk are fixed right
+ * away. Correcting "severe" overlaps has to move earlier chunks of the
+ * same piece. This is deferred until the piece ends and limited to the
+ * chunks between its start and the last overlap seen.
+ */
+struct _srmio_fixup_t {
+	srmio_data_t		data;
+	srmio_time_t		gap;
+	srmio_time_t		overlap;
+	struct _srmio_chunk_t	prev;	/* previous chunk, as it was added */
+	unsigned		first;	/* first chunk of current piece */
+	bool			severe;	/* severe overlap seen in piece */
+	unsigned		olast;	/* chunk following the last overlap */
+	struct _srmio_block_t	*block;	/* finished pieces */
+	unsigned		bused;
+	unsigned		bavail;
+};
+
+/*
+ * start fixing chunks added to data through srmio_fixup_add(). Pieces
+ * end where srmio_data_split_iter_new() with gap and overlap would
+ * split. Chunks that were added before form the first piece.
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_fixup_t srmio_fixup_new( srmio_data_t data, srmio_time_t gap,
+	srmio_time_t overlap, srmio_error_t *err )
+{
+	srmio_fixup_t fx;
+
+	assert( data );
+
+	if( NULL == (fx = malloc( sizeof(struct _srmio_fixup_t) ))){
+		srmio_error_errno( err, "new fixup" );
+		return NULL;
+	}
+
+	fx->data = data;
+	fx->gap = gap;
+	fx->overlap = overlap;
+	fx->first = 0;
+	fx->block = NULL;
+	fx->bused = 0;
+	fx->bavail = 0;
+
+	/* chunks that were added before aren't checked */
+	fx->severe = data->cused > 1;
+	fx->olast = data->cused ? data->cused -1 : 0;
+
+	if( data->cused )
+		srmio_data_chunk_get( data, data->cused -1, &fx->prev );
+
+	return fx;
+}
+
+/*
+ * release fixup state. Data isn't touched.
+ */
+void srmio_fixup_free( srmio_fixup_t fx )
+{
+	if( ! fx )
+		return;
+
+	free( fx->block );
+	free( fx );
+}
 
+/*
+ * apply deferred overlap corrections to the current piece and remember
+ * it.
+ */
+static bool _srmio_fixup_piece_end( srmio_fixup_t fx, srmio_error_t *err )
+{
+	srmio_data_t data = fx->data;
+
+	if( fx->first >= data->cused )
+		return true;
+
+	if( fx->bused >= fx->bavail ){
+		struct _srmio_block_t *tmp;
+		unsigned avail = fx->bavail ? 2 * fx->bavail : 16;
+
+		if( NULL == (tmp = realloc( fx->block, avail
+			* sizeof(struct _srmio_block_t) ))){
+
+			srmio_error_errno( err, "fixup pieces" );
+			return false;
+		}
+
+		fx->block = tmp;
+		fx->bavail = avail;
+	}
 
+	if( fx->severe ){
+		if( ! srmio_data_expand( data, err ) )
+			return false;
+
+		if( ! _srmio_data_fix_overlap( data, fx->first, fx->olast,
+			err ) )
+
+			return false;
+	}
+
+	DPRINTF( "piece %u - %u", fx->first, data->cused -1 );
+	fx->block[fx->bused].first = fx->first;
+	fx->block[fx->bused].last = data->cused -1;
+	++fx->bused;
+
+	fx->first = data->cused;
+	fx->severe = false;
+
+	return true;
+}
+
+/*
+ * add copy of chunk to data, fix it towards the previous chunk and
+ * fill small gaps - unless a new piece starts with it. Marker within
+ * data are adjusted for inserted chunks.
+ *
+ * returns false on error
+ */
+bool srmio_fixup_add( srmio_fixup_t fx, srmio_chunk_t chunk,
+	srmio_error_t *err )
+{
+	srmio_data_t data;
+	srmio_chunk_t prev, this;
+
+	assert( fx );
+	assert( chunk );
+	assert( chunk->dur );
+
+	data = fx->data;
+
+	if( ! srmio_data_expand( data, err ) )
+		return false;
+
+	if( fx->first < data->cused
+		&& srmio_split_at( fx->gap, fx->overlap, &fx->prev, chunk ) ){
+
+		if( ! _srmio_fixup_piece_end( fx, err ) )
+			return false;
+	}
+
+	if( fx->first == data->cused ){
+		if( ! srmio_data_add_chunk( data, chunk, err ) )
+			return false;
+
+	} else if( ! _srmio_fixup_chunk( data, chunk, NULL, 0, err ) ){
+		return false;
+	}
+
+	fx->prev = *chunk;
+
+	/* data is the caller's - don't leave marker stale */
+	srmio_data_marker_sync( data );
+
+	if( data->cused - fx->first < 2 )
+		return true;
+
+	prev = data->chunks[data->cused -2];
+	this = data->chunks[data->cused -1];
+
+	if( this->time < prev->time + prev->dur ){
+		fx->severe = true;
+		fx->olast = data->cused -1;
+	}
+
+	return true;
+}
+
+/*
+ * finish the current piece and apply the deferred corrections for
+ * "severe" overlaps. Chunks added afterwards start a new piece.
+ *
+ * returns false on error
+ */
+bool srmio_fixup_finish( srmio_fixup_t fx, srmio_error_t *err )
+{
+	assert( fx );
+
+	return _srmio_fixup_piece_end( fx, err );
+}
+
+/*
+ * iterate over the pieces finished so far, see
+ * srmio_data_split_iter_next(). Pieces with less than min_chunks chunks
+ * are skipped. Data mustn't be modified while the iterator is used.
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_split_iter_t srmio_fixup_split_iter_new( srmio_fixup_t fx,
+	unsigned min_chunks, srmio_error_t *err )
+{
+	assert( fx );
+
+	return srmio_data_split_iter_blocks( fx->data, fx->block, fx->bused,
+		min_chunks, err );
+}
+
+/*
+ * data set chunks are added to
+ */
+srmio_data_t srmio_fixup_data( srmio_fixup_t fx )
+{
+	assert( fx );
+
+	return fx->data;
+}
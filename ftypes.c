@@ -30,8 +30,8 @@ static srmio_data_t (*rfunc[srmio_ftype_max])( FILE *fh, srmio_error_t *err ) =
 
 static bool (*wfunc[srmio_ftype_max])(srmio_data_t data, FILE *fh, srmio_error_t *err ) = {
 	NULL,
-	NULL, /* TODO: srmio_file_srm5_write */
-	NULL, /* TODO: srmio_file_srm6_write */
+	srmio_file_srm5_write,
+	srmio_file_srm6_write,
 	srmio_file_srm7_write,
 	srmio_file_wkt_write,
 };
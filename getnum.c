@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "getnum.h"
+
+#include "config.h"
+
+#include <errno.h>
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+
+/*
+ * parse unsigned decimal option argument up to max.
+ * returns false when arg isn't such a number
+ */
+bool get_num( const char *arg, unsigned long max, unsigned long *num )
+{
+	char *end;
+	unsigned long val;
+
+	/* strtoul() also takes whitespace and signs */
+	if( *arg < '0' || *arg > '9' )
+		return false;
+
+	errno = 0;
+	val = strtoul( arg, &end, 10 );
+	if( errno || *end || val > max )
+		return false;
+
+	*num = val;
+	return true;
+}
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#ifndef _GETNUM_H
+#define _GETNUM_H
+
+#include "srmio.h"
+
+/*
+ * option parsing shared by the command line tools
+ */
+
+bool get_num( const char *arg, unsigned long max, unsigned long *num );
+
+#endif
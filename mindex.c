@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "common.h"
+
+/*
+ * interval index over a data set's marker.
+ *
+ * Marker are kept sorted by their first chunk together with the
+ * running maximum of their last chunk. This allows to skip all marker
+ * ending before a queried range with a binary search.
+ *
+ * Shifting marker indices (when chunks are inserted) can be deferred
+ * internally: each shift is recorded with the position it applies to -
+ * translated back to unshifted indices - and the total delta so far.
+ * All shifts are applied in one pass by srmio_data_marker_sync(). This
+ * is only done for data that isn't handed out before it's synced -
+ * data->marker is public and must not be stale.
+ */
+
+struct _srmio_mshift_t {
+	unsigned	pos;	/* unshifted index this shift starts at */
+	unsigned	delta;	/* accumulated delta from here on */
+};
+
+struct _srmio_mindex_t {
+	/* sorted marker - only valid when "valid" is set */
+	bool		valid;
+	unsigned	*order;		/* index into data->marker */
+	unsigned	*maxlast;	/* max last of order[0..i] */
+	unsigned	used;
+	unsigned	avail;
+
+	/* pending shifts */
+	struct _srmio_mshift_t	*shift;
+	unsigned	sused;
+	unsigned	savail;
+};
+
+/*
+ * get index, create it when necessary
+ */
+static srmio_mindex_t _srmio_mindex_get( srmio_data_t data, srmio_error_t *err )
+{
+	srmio_mindex_t idx;
+
+	if( data->mindex )
+		return data->mindex;
+
+	if( NULL == (idx = malloc( sizeof(struct _srmio_mindex_t) ))){
+		srmio_error_errno( err, "new marker index" );
+		return NULL;
+	}
+
+	memset( idx, 0, sizeof(struct _srmio_mindex_t) );
+	data->mindex = idx;
+
+	return idx;
+}
+
+/*
+ * release marker index
+ */
+void srmio_mindex_free( srmio_mindex_t idx )
+{
+	if( ! idx )
+		return;
+
+	free( idx->order );
+	free( idx->maxlast );
+	free( idx->shift );
+	free( idx );
+}
+
+/*
+ * sorted marker order has to be rebuilt. Pending shifts are kept.
+ */
+void srmio_mindex_invalidate( srmio_mindex_t idx )
+{
+	if( ! idx )
+		return;
+
+	idx->valid = false;
+}
+
+/*
+ * make room for "avail" sorted marker
+ */
+static bool _srmio_mindex_reserve( srmio_mindex_t idx, unsigned avail,
+	srmio_error_t *err )
+{
+	unsigned *tmp;
+
+	if( avail <= idx->avail )
+		return true;
+
+	if( NULL == (tmp = realloc( idx->order, avail * sizeof(unsigned) ))){
+		srmio_error_errno( err, "enlarge marker index" );
+		return false;
+	}
+	idx->order = tmp;
+
+	if( NULL == (tmp = realloc( idx->maxlast, avail * sizeof(unsigned) ))){
+		srmio_error_errno( err, "enlarge marker index" );
+		return false;
+	}
+	idx->maxlast = tmp;
+
+	idx->avail = avail;
+	return true;
+}
+
+struct _srmio_mindex_sort_t {
+	unsigned	first;
+	unsigned	i;
+};
+
+static int _srmio_mindex_cmp( const void *a, const void *b )
+{
+	const struct _srmio_mindex_sort_t *sa = a;
+	const struct _srmio_mindex_sort_t *sb = b;
+
+	if( sa->first != sb->first )
+		return sa->first < sb->first ? -1 : 1;
+
+	if( sa->i != sb->i )
+		return sa->i < sb->i ? -1 : 1;
+
+	return 0;
+}
+
+static int _srmio_unsigned_cmp( const void *a, const void *b )
+{
+	unsigned ua = *(const unsigned*)a;
+	unsigned ub = *(const unsigned*)b;
+
+	if( ua == ub )
+		return 0;
+
+	return ua < ub ? -1 : 1;
+}
+
+/*
+ * recalculate running maximum of last from position i on
+ */
+static void _srmio_mindex_maxlast( srmio_data_t data, unsigned i )
+{
+	srmio_mindex_t idx = data->mindex;
+
+	for( ; i < idx->used; ++i ){
+		unsigned last = data->marker[idx->order[i]]->last;
+
+		if( i && idx->maxlast[i-1] > last )
+			last = idx->maxlast[i-1];
+
+		idx->maxlast[i] = last;
+	}
+}
+
+/*
+ * (re-)build sorted marker list
+ */
+static bool _srmio_mindex_build( srmio_data_t data, srmio_error_t *err )
+{
+	srmio_mindex_t idx;
+	struct _srmio_mindex_sort_t *sort;
+	unsigned i;
+
+	if( NULL == (idx = _srmio_mindex_get( data, err )))
+		return false;
+
+	if( idx->valid )
+		return true;
+
+	if( ! _srmio_mindex_reserve( idx, data->mused, err ) )
+		return false;
+
+	if( data->mused ){
+		if( NULL == (sort = malloc( data->mused
+			* sizeof(struct _srmio_mindex_sort_t) ))){
+
+			srmio_error_errno( err, "sort marker" );
+			return false;
+		}
+
+		for( i = 0; i < data->mused; ++i ){
+			sort[i].first = data->marker[i]->first;
+			sort[i].i = i;
+		}
+
+		qsort( sort, data->mused, sizeof(struct _srmio_mindex_sort_t),
+			_srmio_mindex_cmp );
+
+		for( i = 0; i < data->mused; ++i )
+			idx->order[i] = sort[i].i;
+
+		free( sort );
+	}
+
+	idx->used = data->mused;
+	_srmio_mindex_maxlast( data, 0 );
+	idx->valid = true;
+
+	return true;
+}
+
+/*
+ * update index for a marker that was appended to data->marker. Keeps
+ * the index when marker are added in ascending order.
+ */
+void srmio_mindex_added( srmio_data_t data )
+{
+	srmio_mindex_t idx = data->mindex;
+	unsigned i = data->mused -1;
+
+	if( ! idx || ! idx->valid )
+		return;
+
+	if( idx->used != i
+		|| ( i && data->marker[idx->order[i-1]]->first
+			> data->marker[i]->first )
+		|| ! _srmio_mindex_reserve( idx, data->mused, NULL ) ){
+
+		idx->valid = false;
+		return;
+	}
+
+	idx->order[i] = i;
+	++idx->used;
+	_srmio_mindex_maxlast( data, i );
+}
+
+/*
+ * apply accumulated shifts to value v
+ */
+static unsigned _srmio_mindex_shifted( srmio_mindex_t idx, unsigned v )
+{
+	unsigned lo = 0, hi = idx->sused;
+
+	/* find last shift with pos <= v */
+	while( lo < hi ){
+		unsigned mid = lo + (hi - lo) / 2;
+
+		if( idx->shift[mid].pos <= v )
+			lo = mid +1;
+		else
+			hi = mid;
+	}
+
+	if( ! lo )
+		return v;
+
+	return v + idx->shift[lo-1].delta;
+}
+
+/*
+ * apply all pending marker shifts
+ */
+void srmio_data_marker_sync( srmio_data_t data )
+{
+	srmio_mindex_t idx = data->mindex;
+	unsigned i;
+
+	if( ! idx || ! idx->sused )
+		return;
+
+	for( i = 0; i < data->mused; ++i ){
+		srmio_marker_t mk = data->marker[i];
+
+		mk->first = _srmio_mindex_shifted( idx, mk->first );
+		mk->last = _srmio_mindex_shifted( idx, mk->last );
+	}
+	idx->sused = 0;
+
+	/* shifting is monotonic, order is unchanged */
+	if( idx->valid )
+		_srmio_mindex_maxlast( data, 0 );
+}
+
+/*
+ * record shift of all marker indices >= pos by delta. The marker are
+ * only updated by srmio_data_marker_sync() - the caller has to sync
+ * before data is passed on.
+ *
+ * returns false on error
+ */
+bool srmio_mindex_shift( srmio_data_t data, unsigned pos,
+	unsigned delta, srmio_error_t *err )
+{
+	srmio_mindex_t idx;
+	struct _srmio_mshift_t *last = NULL;
+	unsigned total = 0;
+
+	assert( data );
+
+	if( ! delta || ! data->mused )
+		return true;
+
+	if( NULL == (idx = _srmio_mindex_get( data, err )))
+		return false;
+
+	if( idx->sused ){
+		last = &idx->shift[idx->sused -1];
+		total = last->delta;
+
+		/* only shifts with ascending positions can be deferred */
+		if( pos < total || pos - total < last->pos ){
+			srmio_data_marker_sync( data );
+			last = NULL;
+			total = 0;
+		}
+	}
+
+	if( last && pos - total == last->pos ){
+		last->delta += delta;
+		return true;
+	}
+
+	if( idx->sused >= idx->savail ){
+		struct _srmio_mshift_t *tmp;
+		unsigned avail = idx->savail ? 2 * idx->savail : 16;
+
+		if( NULL == (tmp = realloc( idx->shift,
+			avail * sizeof(struct _srmio_mshift_t) ))){
+
+			srmio_error_errno( err, "marker shift" );
+			return false;
+		}
+
+		idx->shift = tmp;
+		idx->savail = avail;
+	}
+
+	idx->shift[idx->sused].pos = pos - total;
+	idx->shift[idx->sused].delta = total + delta;
+	++idx->sused;
+
+	return true;
+}
+
+/*
+ * move all marker indices >= pos by delta - like it's necessary when
+ * "delta" chunks are inserted at pos.
+ *
+ * returns false on error
+ */
+bool srmio_data_marker_shift( srmio_data_t data, unsigned pos,
+	unsigned delta, srmio_error_t *err )
+{
+	if( ! srmio_mindex_shift( data, pos, delta, err ) )
+		return false;
+
+	srmio_data_marker_sync( data );
+	return true;
+}
+
+/*
+ * find marker overlapping chunks first to last.
+ *
+ * on success a NULL terminated list of marker is returned. It's in the
+ * same order as data->marker. The marker are owned by data, just
+ * free() the list.
+ * returns NULL on error.
+ */
+srmio_marker_t *srmio_data_markers_range( srmio_data_t data,
+	unsigned first, unsigned last, srmio_error_t *err )
+{
+	srmio_mindex_t idx;
+	srmio_marker_t *list;
+	unsigned *found;
+	unsigned lo, hi, i, used = 0;
+
+	assert( data );
+
+	if( first > last ){
+		srmio_error_set( err, "invalid marker range %u-%u",
+			first, last );
+		return NULL;
+	}
+
+	srmio_data_marker_sync( data );
+
+	if( ! _srmio_mindex_build( data, err ) )
+		return NULL;
+	idx = data->mindex;
+
+	/* skip marker that end before "first" */
+	lo = 0;
+	hi = idx->used;
+	while( lo < hi ){
+		unsigned mid = lo + (hi - lo) / 2;
+
+		if( idx->maxlast[mid] < first )
+			lo = mid +1;
+		else
+			hi = mid;
+	}
+
+	if( NULL == (found = malloc( (idx->used - lo +1) * sizeof(unsigned) ))){
+		srmio_error_errno( err, "marker range" );
+		return NULL;
+	}
+
+	for( i = lo; i < idx->used; ++i ){
+		srmio_marker_t mk = data->marker[idx->order[i]];
+
+		if( mk->first > last )
+			break;
+
+		if( mk->last >= first )
+			found[used++] = idx->order[i];
+	}
+
+	qsort( found, used, sizeof(unsigned), _srmio_unsigned_cmp );
+
+	if( NULL == (list = malloc( (used +1) * sizeof(srmio_marker_t) ))){
+		srmio_error_errno( err, "marker range" );
+		free( found );
+		return NULL;
+	}
+
+	for( i = 0; i < used; ++i )
+		list[i] = data->marker[found[i]];
+	list[used] = NULL;
+
+	free( found );
+	return list;
+}
+
@@ -286,6 +286,20 @@ bool srmio_pc_xfer_get_blocks( srmio_pc_t conn, size_t *blocks,
 	return true;
 }
 
+/*
+ * number of chunks the PC announced for the current block. This is
+ * just a hint for preallocation, 0 when it's unknown.
+ */
+bool srmio_pc_xfer_block_chunks( srmio_pc_t conn, size_t *chunks )
+{
+	assert( conn );
+	assert( chunks );
+
+	*chunks = conn->block_chunks;
+
+	return true;
+}
+
 
 bool srmio_pc_cmd_get_athlete( srmio_pc_t pch, char **athlete,
 	srmio_error_t *err )
@@ -429,21 +443,23 @@ bool srmio_pc_xfer_block_progress( srmio_pc_t pch, size_t *block_done )
  *
  ************************************************************/
 
+/* chunks collected before they're added to data */
+#define XFER_BATCH	64
+
 /*
  * retrieve recorded data from PC and build  "friendly" srmio_data_t structure.
- *
- * parameter:
- *  pch: conn handle
- *
+ * When fx is given, chunks are added through it.
  */
-bool srmio_pc_xfer_all( srmio_pc_t pch,
-	srmio_data_t data,
+static bool _srmio_pc_xfer_all( srmio_pc_t pch,
+	srmio_data_t data, srmio_fixup_t fx,
 	srmio_progress_t pfunc, void *prog_data,
 	srmio_error_t *err  )
 {
 	int mfirst = -1;
+	int plast;
 	struct _srmio_pc_xfer_block_t block;
-	struct _srmio_chunk_t chunk;
+	struct _srmio_chunk_t batch[XFER_BATCH];
+	unsigned bused = 0;
 	size_t done_chunks = 0;
 	size_t block_cnt, block_num = 0;
 	size_t prog_prev = 0, prog_sum=0;
@@ -490,6 +506,7 @@ bool srmio_pc_xfer_all( srmio_pc_t pch,
 		bool is_int;
 		bool is_first;
 		size_t prog_total;
+		size_t block_chunks;
 
 		srmio_pc_log( pch, "downloading ride block %d/%d",
 			block_num, block_cnt );
@@ -503,6 +520,17 @@ bool srmio_pc_xfer_all( srmio_pc_t pch,
 			data->athlete = strdup(block.athlete);
 		}
 
+		/* preallocate chunks, when the PC told us how many to expect */
+		if( srmio_pc_xfer_block_chunks( pch, &block_chunks )
+			&& block_chunks
+			&& block_chunks < UINT_MAX - data->cused ){
+
+			if( ! srmio_data_reserve( data, data->cused
+				+ block_chunks, 0, err ))
+
+				goto clean;
+		}
+
 		if( prog_sum ){
 			prog_total = prog_sum;
 
@@ -513,7 +541,8 @@ bool srmio_pc_xfer_all( srmio_pc_t pch,
 			prog_total = block_cnt * 1000;
 		}
 
-		while( srmio_pc_xfer_chunk_next( pch, &chunk, &is_int, &is_first  ) ){
+		while( srmio_pc_xfer_chunk_next( pch, &batch[bused], &is_int,
+			&is_first  ) ){
 
 			if( pfunc && 0 == done_chunks % 16 ){
 				size_t block_done = 0;
@@ -537,29 +566,51 @@ bool srmio_pc_xfer_all( srmio_pc_t pch,
 			}
 
 
-			if( ! srmio_data_add_chunk( data, &chunk, err ) )
-				goto clean;
+			/* fixup might insert chunks before this one */
+			plast = (int)(data->cused + bused) -1;
 
+			if( ! fx ){
+				++bused;
+
+			} else if( ! srmio_fixup_add( fx, &batch[bused], err ) ){
+				goto clean;
+			}
 			++done_chunks;
 
 			/* finish previous marker */
-			if( mfirst >= 0 && ( ! is_int || is_first ) )
+			if( mfirst >= 0 && ( ! is_int || is_first ) ){
+				if( ! srmio_data_add_chunks( data, batch, bused, err ) )
+					goto clean;
+				bused = 0;
+
 				if( ! srmio_data_add_marker( data, mfirst,
-					data->cused -2, err ) )
+					plast, err ) )
 
 					goto clean;
+			}
 
 			/* start marker */
 			if( is_first ){
-				mfirst = (int)data->cused -1;
+				mfirst = (int)(data->cused + bused) -1;
 				SRMIO_PC_DEBUG(pch,  "new marker at %d", mfirst );
 
 			} else if( ! is_int ){
 				mfirst = -1;
 
 			}
+
+			if( bused < XFER_BATCH )
+				continue;
+
+			if( ! srmio_data_add_chunks( data, batch, bused, err ) )
+				goto clean;
+			bused = 0;
 		}
 
+		if( ! srmio_data_add_chunks( data, batch, bused, err ) )
+			goto clean;
+		bused = 0;
+
 		/* finalize marker at block end */
 		if( mfirst >= 0 ){
 			SRMIO_PC_DEBUG(pch,  "finalizing marker at block end" );
@@ -587,6 +638,9 @@ bool srmio_pc_xfer_all( srmio_pc_t pch,
 		goto clean;
 	}
 
+	if( fx && ! srmio_fixup_finish( fx, err ) )
+		goto clean;
+
 	if( srmio_pc_xfer_state_success != srmio_pc_xfer_status( pch, err) )
 		goto clean;
 
@@ -601,3 +655,36 @@ clean:
 	return false;
 }
 
+/*
+ * retrieve recorded data from PC and build  "friendly" srmio_data_t structure.
+ *
+ * parameter:
+ *  pch: conn handle
+ *
+ */
+bool srmio_pc_xfer_all( srmio_pc_t pch,
+	srmio_data_t data,
+	srmio_progress_t pfunc, void *prog_data,
+	srmio_error_t *err  )
+{
+	assert( data );
+
+	return _srmio_pc_xfer_all( pch, data, NULL, pfunc, prog_data, err );
+}
+
+/*
+ * like srmio_pc_xfer_all(), but the chunks are fixed while they're
+ * downloaded to the data set of fx. Its pieces are finished when the
+ * download is complete, see srmio_fixup_split_iter_new().
+ */
+bool srmio_pc_xfer_all_fixup( srmio_pc_t pch,
+	srmio_fixup_t fx,
+	srmio_progress_t pfunc, void *prog_data,
+	srmio_error_t *err  )
+{
+	assert( fx );
+
+	return _srmio_pc_xfer_all( pch, srmio_fixup_data( fx ), fx,
+		pfunc, prog_data, err );
+}
+
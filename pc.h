@@ -73,6 +73,7 @@ struct _srmio_pc_t {
 	srmio_pc_xfer_type_t		xfer_type;
 	srmio_pc_xfer_state_t		xfer_state;
 	size_t				block_cnt;
+	size_t				block_chunks; /* of current block, 0=unknown */
 
 	/* object model */
 	const srmio_pc_methods_t	*methods;
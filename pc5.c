@@ -1542,6 +1542,7 @@ static bool _srmio_pc5_xfer_start( srmio_pc_t conn, srmio_error_t *err )
 	conn->xfer_state = srmio_pc_xfer_state_running;
 	conn->xfer_type = srmio_pc_xfer_type_new;
 	conn->block_cnt = 1;
+	conn->block_chunks = 0;
 	SELF(conn)->block_num = 0;
 	SELF(conn)->pkt_num = -1;
 	SELF(conn)->chunk_num = PC5_PKT_CHUNKS; /* triggers first pkt xfer */
@@ -1595,6 +1596,7 @@ static bool _srmio_pc5_xfer_start( srmio_pc_t conn, srmio_error_t *err )
 		goto clean2;
 	}
 	SELF(conn)->block.total = 1+SELF(conn)->pkt_cnt;
+	conn->block_chunks = SELF(conn)->pkt_cnt * PC5_PKT_CHUNKS;
 
 	return true;
 
@@ -716,6 +716,7 @@ static bool _srmio_pc7_xfer_start( srmio_pc_t conn, srmio_error_t *err )
 
 	conn->xfer_state = srmio_pc_xfer_state_running;
 	SELF(conn)->block_num = 0;
+	conn->block_chunks = 0;
 
 	conn->block_cnt = buf_get_buint16( recv.data, 0 );
 	SRMIO_PC_DEBUG( conn,"blocks: %d", conn->block_cnt);
@@ -844,6 +845,8 @@ static bool _srmio_pc7_xfer_block_next( srmio_pc_t conn, srmio_pc_xfer_block_t b
 		block->end = block->start + block->total * block->recint;
 	}
 
+	conn->block_chunks = SELF(conn)->chunk_cnt;
+
 
 	SRMIO_PC_DEBUG( conn,"block %d, chunks=%d, time=%.1f, recint=%.1f",
 		block_num, SELF(conn)->chunk_cnt,
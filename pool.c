@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "common.h"
+
+/*
+ * thread pool to process independent items in parallel.
+ *
+ * Workers are started once and wait for srmio_pool_run() to hand out
+ * items. The calling thread picks items, as well. Without pthreads
+ * everything is done by the caller.
+ */
+
+#define POOL_THREADS_MAX	64
+
+struct _srmio_pool_t {
+	unsigned	threads;	/* including caller */
+
+#ifdef USE_PTHREAD
+	pthread_t	*thread;
+	unsigned	started;
+
+	pthread_mutex_t	lock;
+	pthread_cond_t	work;	/* new items or quit */
+	pthread_cond_t	done;	/* last item finished */
+	bool		quit;
+
+	/* current run */
+	srmio_pool_job_t	func;
+	void		*arg;
+	unsigned	n;
+	unsigned	next;	/* next item to hand out */
+	unsigned	busy;	/* items in progress */
+#endif
+};
+
+#ifdef USE_PTHREAD
+/*
+ * process items until there are none left. Called with lock held.
+ */
+static void _srmio_pool_items( srmio_pool_t pool )
+{
+	while( pool->next < pool->n ){
+		srmio_pool_job_t func = pool->func;
+		void *arg = pool->arg;
+		unsigned i = pool->next++;
+
+		++pool->busy;
+		pthread_mutex_unlock( &pool->lock );
+
+		(*func)( arg, i );
+
+		pthread_mutex_lock( &pool->lock );
+		if( ! --pool->busy && pool->next >= pool->n )
+			pthread_cond_broadcast( &pool->done );
+	}
+}
+
+static void *_srmio_pool_worker( void *data )
+{
+	srmio_pool_t pool = data;
+
+	pthread_mutex_lock( &pool->lock );
+	while( ! pool->quit ){
+		if( pool->next < pool->n )
+			_srmio_pool_items( pool );
+		else
+			pthread_cond_wait( &pool->work, &pool->lock );
+	}
+	pthread_mutex_unlock( &pool->lock );
+
+	return NULL;
+}
+#endif
+
+/*
+ * get number of online CPUs, 1 when unknown
+ */
+static unsigned _srmio_pool_cpus( void )
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	long n = sysconf( _SC_NPROCESSORS_ONLN );
+
+	if( n > 0 )
+		return n > POOL_THREADS_MAX ? POOL_THREADS_MAX : n;
+#endif
+	return 1;
+}
+
+/*
+ * create pool with "threads" threads - the caller of srmio_pool_run()
+ * counts as one of them. With 0 threads, the number of CPUs is used.
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_pool_t srmio_pool_new( unsigned threads, srmio_error_t *err )
+{
+	srmio_pool_t pool;
+
+	if( ! threads )
+		threads = _srmio_pool_cpus();
+
+	if( threads > POOL_THREADS_MAX )
+		threads = POOL_THREADS_MAX;
+
+	if( NULL == (pool = malloc( sizeof(struct _srmio_pool_t) ))){
+		srmio_error_errno( err, "new pool" );
+		return NULL;
+	}
+
+	memset( pool, 0, sizeof(struct _srmio_pool_t) );
+	pool->threads = threads;
+
+#ifdef USE_PTHREAD
+	if( threads < 2 )
+		return pool;
+
+	if( NULL == (pool->thread = malloc( (threads -1) * sizeof(pthread_t) ))){
+		srmio_error_errno( err, "new pool" );
+		goto clean1;
+	}
+
+	pthread_mutex_init( &pool->lock, NULL );
+	pthread_cond_init( &pool->work, NULL );
+	pthread_cond_init( &pool->done, NULL );
+
+	for( ; pool->started < threads -1; ++pool->started ){
+		int ret;
+
+		if( 0 != (ret = pthread_create( &pool->thread[pool->started],
+			NULL, _srmio_pool_worker, pool ))){
+
+			errno = ret;
+			srmio_error_errno( err, "pool thread" );
+			goto clean2;
+		}
+	}
+
+	return pool;
+
+clean2:
+	srmio_pool_free( pool );
+	return NULL;
+
+clean1:
+	free( pool );
+	return NULL;
+#else
+	pool->threads = 1;
+	return pool;
+#endif
+}
+
+/*
+ * stop threads, release pool
+ */
+void srmio_pool_free( srmio_pool_t pool )
+{
+	if( ! pool )
+		return;
+
+#ifdef USE_PTHREAD
+	if( pool->thread ){
+		unsigned i;
+
+		pthread_mutex_lock( &pool->lock );
+		pool->quit = true;
+		pthread_cond_broadcast( &pool->work );
+		pthread_mutex_unlock( &pool->lock );
+
+		for( i = 0; i < pool->started; ++i )
+			pthread_join( pool->thread[i], NULL );
+
+		pthread_cond_destroy( &pool->done );
+		pthread_cond_destroy( &pool->work );
+		pthread_mutex_destroy( &pool->lock );
+		free( pool->thread );
+	}
+#endif
+
+	free( pool );
+}
+
+/*
+ * get number of threads working on items - including the caller
+ */
+unsigned srmio_pool_threads( srmio_pool_t pool )
+{
+	assert( pool );
+
+	return pool->threads;
+}
+
+/*
+ * call func( arg, i ) for i = 0 .. n-1 and wait for all calls to
+ * finish. Calls are done in parallel and in no particular order. Only
+ * one run at a time is supported for each pool.
+ */
+void srmio_pool_run( srmio_pool_t pool, srmio_pool_job_t func,
+	void *arg, unsigned n )
+{
+	unsigned i;
+
+	assert( pool );
+	assert( func );
+
+#ifdef USE_PTHREAD
+	if( pool->thread && n > 1 ){
+		pthread_mutex_lock( &pool->lock );
+		assert( pool->next >= pool->n );
+
+		pool->func = func;
+		pool->arg = arg;
+		pool->n = n;
+		pool->next = 0;
+		pthread_cond_broadcast( &pool->work );
+
+		_srmio_pool_items( pool );
+		while( pool->busy )
+			pthread_cond_wait( &pool->done, &pool->lock );
+
+		pool->n = pool->next = 0;
+		pthread_mutex_unlock( &pool->lock );
+		return;
+	}
+#endif
+
+	for( i = 0; i < n; ++i )
+		(*func)( arg, i );
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "common.h"
+
+/*
+ * change recording interval.
+ *
+ * The new chunks are laid out on a grid of "recint" starting at the
+ * first chunk and restarting after each gap. Each new chunk gets the
+ * average of the old chunks it overlaps - weighted by the overlapping
+ * time. When it lies within a single, longer old chunk, values are
+ * interpolated linearly between the centers of this chunk and its
+ * neighbour. Gaps are kept: new chunks that are less than half covered
+ * by old ones are skipped.
+ */
+
+/* chunks collected before they're added to data */
+#define RESAMPLE_BATCH	256
+
+struct _srmio_resample_sum_t {
+	double	temp;
+	double	pwr;
+	double	speed;
+	double	cad;
+	double	hr;
+	double	ele;
+};
+
+static void _srmio_resample_add( struct _srmio_resample_sum_t *sum,
+	srmio_chunk_t ck, double w )
+{
+	sum->temp += w * ck->temp;
+	sum->pwr += w * ck->pwr;
+	sum->speed += w * ck->speed;
+	sum->cad += w * ck->cad;
+	sum->hr += w * ck->hr;
+	sum->ele += w * ck->ele;
+}
+
+/*
+ * find neighbour of chunk i to interpolate towards "center" - returns
+ * false when there is none.
+ */
+static bool _srmio_resample_neighbour( srmio_data_t data, unsigned i,
+	srmio_chunk_t ck, double center, srmio_chunk_t other )
+{
+	if( center < ck->time + 0.5 * ck->dur ){
+		if( i < 1 )
+			return false;
+
+		srmio_data_chunk_get( data, i -1, other );
+		return other->time + other->dur == ck->time;
+
+	}
+
+	if( i +1 >= data->cused )
+		return false;
+
+	srmio_data_chunk_get( data, i +1, other );
+	return ck->time + ck->dur == other->time;
+}
+
+/*
+ * calculate values for new chunk starting at t from old chunks
+ * first..end-1. Returns false when they cover less than half of it.
+ */
+static bool _srmio_resample_chunk( srmio_data_t data, unsigned first,
+	unsigned end, srmio_time_t t, srmio_time_t recint,
+	srmio_chunk_t chunk )
+{
+	struct _srmio_resample_sum_t sum;
+	struct _srmio_chunk_t ck, other;
+	srmio_time_t tend = t + recint;
+	srmio_time_t covered = 0;
+	double div;
+	unsigned i;
+
+	memset( &sum, 0, sizeof(sum) );
+	srmio_data_chunk_get( data, first, &ck );
+
+	if( end - first == 1 && ck.dur > recint
+		&& ck.time <= t
+		&& ck.time + ck.dur >= tend ){
+
+		/* upsampling: interpolate */
+		double center = t + 0.5 * recint;
+		double mid = ck.time + 0.5 * ck.dur;
+		double f = 0;
+
+		if( _srmio_resample_neighbour( data, first, &ck, center,
+			&other )){
+
+			double omid = other.time + 0.5 * other.dur;
+
+			f = ( center - mid ) / ( omid - mid );
+		}
+
+		_srmio_resample_add( &sum, &ck, 1 - f );
+		if( f )
+			_srmio_resample_add( &sum, &other, f );
+		div = 1;
+
+	} else {
+		/* downsampling: average */
+		for( i = first; i < end; ++i ){
+			srmio_time_t s, e;
+
+			if( i > first )
+				srmio_data_chunk_get( data, i, &ck );
+
+			s = ck.time;
+			e = s + ck.dur;
+
+			if( s < t )
+				s = t;
+			if( e > tend )
+				e = tend;
+			if( e <= s )
+				continue;
+
+			covered += e - s;
+			_srmio_resample_add( &sum, &ck, e - s );
+		}
+
+		if( 2 * covered < recint )
+			return false;
+
+		div = covered;
+	}
+
+	chunk->time = t;
+	chunk->dur = recint;
+	chunk->temp = sum.temp / div;
+	chunk->pwr = sum.pwr / div + 0.5;
+	chunk->speed = sum.speed / div;
+	chunk->cad = sum.cad / div + 0.5;
+	chunk->hr = sum.hr / div + 0.5;
+	chunk->ele = sum.ele < 0
+		? sum.ele / div - 0.5
+		: sum.ele / div + 0.5;
+
+	return true;
+}
+
+/*
+ * find new chunk that covers "time". With "last" set the last chunk
+ * starting before time is returned, otherwise the first one ending
+ * after it.
+ */
+static unsigned _srmio_resample_find( srmio_data_t data, srmio_time_t time,
+	bool last )
+{
+	unsigned lo = 0, hi = data->cused;
+
+	while( lo < hi ){
+		unsigned mid = lo + (hi - lo) / 2;
+		srmio_chunk_t chunk = data->chunks[mid];
+		bool before = last
+			? chunk->time < time
+			: chunk->time + chunk->dur <= time;
+
+		if( before )
+			lo = mid +1;
+		else
+			hi = mid;
+	}
+
+	return last ? lo -1 : lo;
+}
+
+/*
+ * copy data with new recording interval. Data is expected to be free
+ * of overlaps - see srmio_data_fixup(). Marker are mapped to the new
+ * chunks covering the same time. Marker that end up in a gap are
+ * dropped.
+ *
+ * returns pointer to newly allocated srmio_data
+ * returns NULL on failure
+ */
+srmio_data_t srmio_data_resample( srmio_data_t data, srmio_time_t recint,
+	srmio_error_t *err )
+{
+	srmio_data_t dst;
+	struct _srmio_chunk_t batch[RESAMPLE_BATCH];
+	struct _srmio_chunk_t ck;
+	unsigned bused = 0;
+	srmio_time_t t;
+	unsigned first = 0, end, m;
+
+	assert( data );
+
+	if( ! recint ){
+		srmio_error_set( err, "invalid recint" );
+		return NULL;
+	}
+
+	if( data->cused < 1 ){
+		srmio_error_set( err, "no data" );
+		return NULL;
+	}
+
+	if( NULL == (dst = srmio_data_header( data, err )))
+		return NULL;
+
+	srmio_data_chunk_get( data, 0, &ck );
+	t = ck.time;
+	while( first < data->cused ){
+		/* skip old chunks ending before t */
+		while( ck.time + ck.dur <= t ){
+			if( ++first >= data->cused )
+				break;
+			srmio_data_chunk_get( data, first, &ck );
+		}
+
+		if( first >= data->cused )
+			break;
+
+		/* skip gap, restart grid */
+		if( ck.time >= t + recint ){
+			t = ck.time;
+			continue;
+		}
+
+		for( end = first +1; end < data->cused; ++end ){
+			struct _srmio_chunk_t next;
+
+			srmio_data_chunk_get( data, end, &next );
+			if( next.time >= t + recint )
+				break;
+		}
+
+		if( _srmio_resample_chunk( data, first, end, t, recint,
+			&batch[bused] ))
+
+			++bused;
+
+		if( bused >= RESAMPLE_BATCH ){
+			if( ! srmio_data_add_chunks( dst, batch, bused, err ))
+				goto clean1;
+			bused = 0;
+		}
+
+		t += recint;
+	}
+
+	if( ! srmio_data_add_chunks( dst, batch, bused, err ))
+		goto clean1;
+
+	if( ! dst->cused ){
+		srmio_error_set( err, "no data left after resampling" );
+		goto clean1;
+	}
+
+	/* map marker */
+	srmio_data_marker_sync( data );
+	for( m = 0; m < data->mused; ++m ){
+		srmio_marker_t mk = data->marker[m];
+		srmio_marker_t nm;
+		struct _srmio_chunk_t mfirst, mlast;
+		unsigned nfirst, nlast;
+
+		if( mk->first >= data->cused || mk->last >= data->cused
+			|| mk->first > mk->last )
+			continue;
+
+		srmio_data_chunk_get( data, mk->first, &mfirst );
+		srmio_data_chunk_get( data, mk->last, &mlast );
+
+		nfirst = _srmio_resample_find( dst, mfirst.time, false );
+		nlast = _srmio_resample_find( dst, mlast.time + mlast.dur,
+			true );
+
+		if( nfirst >= dst->cused || nlast >= dst->cused
+			|| nfirst > nlast ){
+
+			DPRINTF( "dropping marker %u-%u", mk->first, mk->last );
+			continue;
+		}
+
+		if( NULL == (nm = srmio_data_marker_clone( dst, mk, err )))
+			goto clean1;
+
+		nm->first = nfirst;
+		nm->last = nlast;
+
+		if( ! srmio_data_add_markerp( dst, nm, err ))
+			goto clean1;
+	}
+
+	return dst;
+
+clean1:
+	srmio_data_free( dst );
+	return NULL;
+}
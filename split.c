@@ -14,120 +14,263 @@
  * - when recint changes
  * - on negative time steps
  * - on gaps
- * - when data overlaps significantly 
+ * - when data overlaps significantly
  *
  */
-srmio_data_t *srmio_data_split( srmio_data_t src, srmio_time_t gap,
-	srmio_time_t overlap, srmio_error_t *err )
+
+struct _srmio_split_iter_t {
+	srmio_data_t	src;
+	srmio_time_t	gap;
+	srmio_time_t	overlap;
+	unsigned	min;	/* skip pieces with less chunks */
+	unsigned	next;	/* first chunk of next piece */
+	struct _srmio_block_t	*block;	/* known pieces, NULL: search */
+	unsigned	bcnt;
+	unsigned	bnext;
+};
+
+/*
+ * check if a new piece starts at chunk "this" following "prev"
+ */
+bool srmio_split_at( srmio_time_t gap, srmio_time_t overlap,
+	srmio_chunk_t prev, srmio_chunk_t this )
 {
-	srmio_data_t *list = NULL;
-	unsigned alloc = 0;
-	unsigned used = 0;
-	unsigned c, delta;
+	srmio_time_t end = prev->time + prev->dur;
+
+	if( this->dur != prev->dur ){
+		DPRINTF( "found recint change" );
+		return true;
+
+	} else if( this->time > end ){
+		if( this->time - end > gap ){
+			DPRINTF( "found gap" );
+			return true;
+		}
+
+	} else if( end > this->time ){
+		if( end - this->time > overlap ){
+			DPRINTF( "found overlap" );
+			return true;
+		}
+
+	}
+
+	return false;
+}
+
+/*
+ * start splitting src - see srmio_data_split_iter_next(). Pieces with
+ * less than min_chunks chunks are skipped. src mustn't be modified
+ * while the iterator is used. Split points are found while iterating,
+ * nothing is allocated for src.
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_split_iter_t srmio_data_split_iter_new( srmio_data_t src,
+	srmio_time_t gap, srmio_time_t overlap, unsigned min_chunks,
+	srmio_error_t *err )
+{
+	srmio_split_iter_t it;
 
 	assert( src );
 
-	srmio_error_set( err, "no data" );
+	if( NULL == (it = malloc( sizeof(struct _srmio_split_iter_t) ))){
+		srmio_error_errno( err, "new split iterator" );
+		return NULL;
+	}
 
-	for( c = 0; c < src->cused; ++c ){
-		int split = 0;
+	it->src = src;
+	it->gap = gap;
+	it->overlap = overlap;
+	it->min = min_chunks;
+	it->next = 0;
+	it->block = NULL;
+	it->bcnt = 0;
+	it->bnext = 0;
 
-		if( c == 0 ){
-			++split;
+	return it;
+}
 
-		} else {
-			srmio_time_t end = src->chunks[c-1]->time
-				+ src->chunks[c-1]->dur;
+/*
+ * like srmio_data_split_iter_new(), but src is cut into the given
+ * pieces instead of searching for split points.
+ *
+ * on success pointer is returned
+ * returns NULL on error.
+ */
+srmio_split_iter_t srmio_data_split_iter_blocks( srmio_data_t src,
+	const struct _srmio_block_t *block, unsigned cnt,
+	unsigned min_chunks, srmio_error_t *err )
+{
+	srmio_split_iter_t it;
 
-			if( src->chunks[c]->dur != src->chunks[c-1]->dur ){
-				DPRINTF( "found recint change" );
-				++split;
+	if( NULL == (it = srmio_data_split_iter_new( src, 0, 0, min_chunks,
+		err )))
 
-			} else if( src->chunks[c]->time > end ){
-				if( src->chunks[c]->time - end > gap ){
-					DPRINTF( "found gap" );
-					++split;
-				}
+		return NULL;
 
-			} else if( end > src->chunks[c]->time ){
-				if( end - src->chunks[c]->time > overlap ){
-					DPRINTF( "found overlap" );
-					++split;
-				}
+	if( ! cnt )
+		return it;
 
-			}
-		}
+	if( NULL == (it->block = malloc( cnt
+		* sizeof(struct _srmio_block_t) ))){
 
-		if( split ){
-			DPRINTF( "starting new data %u", used );
-			if( used +1 >= alloc ){
-				srmio_data_t *new;
+		srmio_error_errno( err, "split pieces" );
+		free( it );
+		return NULL;
+	}
 
-				if( NULL == (new = realloc( list,
-					sizeof(srmio_data_t) * ( alloc +1 +10)  ) )){
-					srmio_error_errno( err, "realloc");
-					goto clean;
-				}
+	memcpy( it->block, block, cnt * sizeof(struct _srmio_block_t) );
+	it->bcnt = cnt;
 
-				alloc += 10;
-				list = new;
-			}
+	return it;
+}
 
-			if( NULL == (list[used] = srmio_data_header( src, err)))
-				goto clean;
+/*
+ * release iterator. Pieces returned so far are kept.
+ */
+void srmio_data_split_iter_free( srmio_split_iter_t it )
+{
+	if( ! it )
+		return;
 
-			list[++used] = NULL;
-		}
+	free( it->block );
+	free( it );
+}
 
-		srmio_data_add_chunk( list[used-1], src->chunks[c], err );
+/*
+ * find next piece, returns false when there are no more
+ */
+static bool _srmio_split_iter_find( srmio_split_iter_t it,
+	unsigned *first, unsigned *last )
+{
+	srmio_data_t src = it->src;
+	struct _srmio_chunk_t prev, this;
+	unsigned c;
+
+	if( it->block ){
+		if( it->bnext >= it->bcnt )
+			return false;
+
+		*first = it->block[it->bnext].first;
+		*last = it->block[it->bnext].last;
+		++it->bnext;
+		return true;
 	}
 
-	delta = 0;
-	for( c = 0; c < used; ++c ){
-		unsigned last = delta + list[c]->cused -1;
-		unsigned m;
+	if( it->next >= src->cused )
+		return false;
 
-		DPRINTF( "file %d: %d - %d", c, delta, last );
+	*first = it->next;
+	srmio_data_chunk_get( src, *first, &prev );
 
-		for( m = 0; m < src->mused; ++m ){
-			srmio_marker_t mk = src->marker[m];
-			srmio_marker_t nm;
+	for( c = *first +1; c < src->cused; ++c ){
+		srmio_data_chunk_get( src, c, &this );
+		if( srmio_split_at( it->gap, it->overlap, &prev, &this ) )
+			break;
 
-			if( mk->last < delta || mk->first > last )
-				continue;
+		prev = this;
+	}
+	it->next = c;
+	*last = c -1;
 
-			DPRINTF( "found marker %u: %d - %d", m,
-				mk->first, mk->last );
+	return true;
+}
 
-			if( NULL == (nm = srmio_marker_clone( mk, err )))
-				goto clean;
+/*
+ * get next piece of data. It's a new data set with src's header,
+ * sharing the chunks with src (see srmio_data_slice()). Marker
+ * overlapping the piece are copied and clipped to it.
+ *
+ * *piece is set to NULL when there are no more pieces.
+ *
+ * returns false on error
+ */
+bool srmio_data_split_iter_next( srmio_split_iter_t it,
+	srmio_data_t *piece, srmio_error_t *err )
+{
+	unsigned first, last;
 
-			if( nm->first < delta )
-				nm->first = 0;
-			else
-				nm->first -= delta;
+	assert( it );
+	assert( piece );
 
-			// nm->last < delta was handled, before
-			if( nm->last > last )
-				nm->last = list[c]->cused -1;
-			else
-				nm->last -= delta;
+	*piece = NULL;
 
-			srmio_data_add_markerp( list[c], nm, err );
+	while( _srmio_split_iter_find( it, &first, &last ) ){
+		if( last - first +1 < it->min ){
+			DPRINTF( "skipping %u chunks at %u", last - first +1,
+				first );
+			continue;
 		}
 
-		delta += list[c]->cused;
+		DPRINTF( "piece %u - %u", first, last );
+
+		if( NULL == (*piece = srmio_data_slice( it->src, first, last,
+			err )))
+
+			return false;
+
+		return true;
 	}
 
+	return true;
+}
+
+/*
+ * split data into pieces, see srmio_data_split_iter_next().
+ *
+ * on success a NULL terminated list of data sets is returned.
+ * returns NULL on error.
+ */
+srmio_data_t *srmio_data_split( srmio_data_t src, srmio_time_t gap,
+	srmio_time_t overlap, srmio_error_t *err )
+{
+	srmio_split_iter_t it;
+	srmio_data_t *list = NULL;
+	unsigned alloc = 0;
+	unsigned used = 0;
+	unsigned c;
+
+	assert( src );
+
+	if( ! src->cused ){
+		srmio_error_set( err, "no data" );
+		return NULL;
+	}
+
+	if( NULL == (it = srmio_data_split_iter_new( src, gap, overlap, 0,
+		err )))
+
+		return NULL;
+
+	do {
+		if( used +1 >= alloc ){
+			srmio_data_t *new;
+
+			if( NULL == (new = realloc( list,
+				sizeof(srmio_data_t) * ( alloc +1 +10)  ) )){
+				srmio_error_errno( err, "realloc");
+				goto clean;
+			}
+
+			alloc += 10;
+			list = new;
+		}
+
+		if( ! srmio_data_split_iter_next( it, &list[used], err ))
+			goto clean;
+
+	} while( list[used++] );
+
+	srmio_data_split_iter_free( it );
 	return list;
 
 clean:
 	for( c = 0; c < used;  ++c )
 		srmio_data_free( list[c] );
 	free( list );
+	srmio_data_split_iter_free( it );
 
 	return NULL;
 }
-
-
-
@@ -0,0 +1,561 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+/*
+ * time library functions on reproducible synthetic data. Results are
+ * printed as tab separated list - one line per benchmark.
+ */
+
+#include "srmio.h"
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+
+#ifdef HAVE_GETOPT_H
+# include <getopt.h>
+#endif
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+# include <sys/time.h>
+#endif
+#include <time.h>
+
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
+
+#ifdef HAVE_MALLOC_H
+# include <malloc.h>
+#endif
+
+#include <dirent.h>
+
+#ifndef PATH_MAX
+# define PATH_MAX 4096
+#endif
+
+/* 2010-01-01 */
+#define BENCH_START	((srmio_time_t)12623040000ULL)
+#define BENCH_SEED	4711
+
+static double opt_time = 0.5;
+static unsigned opt_seed = BENCH_SEED;
+
+/************************************************************
+ *
+ * synthetic data
+ *
+ */
+
+/*
+ * ride with "chunks" 1sec chunks. It has small gaps and overlaps
+ * like data from a PowerControl, larger gaps for splitting and a
+ * marker every few minutes.
+ */
+static srmio_data_t synth( unsigned chunks, srmio_time_t start,
+	srmio_error_t *err )
+{
+	struct _srmio_synth_t conf;
+
+	srmio_synth_init( &conf );
+	conf.start = start;
+	conf.duration = (srmio_time_t)chunks * conf.recint;
+	conf.seed = opt_seed;
+	conf.athlete = "bench";
+
+	return srmio_data_synth( &conf, err );
+}
+
+/************************************************************
+ *
+ * measurement
+ *
+ */
+
+static double now( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* bytes allocated on the heap, 0 when unknown */
+static size_t heap_used( void )
+{
+#if defined HAVE_MALLINFO2
+	struct mallinfo2 mi = mallinfo2();
+
+	return mi.uordblks + mi.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * a single benchmark run: returns something to release after
+ * measuring retained heap
+ */
+typedef void *(*bench_func_t)( void *arg, srmio_error_t *err );
+typedef void (*bench_free_t)( void *result );
+
+static bool bench( const char *name, unsigned items, bench_func_t func,
+	bench_free_t rfree, void *arg )
+{
+	srmio_error_t err;
+	unsigned iter = 0;
+	double start, sec;
+	size_t heap = 0;
+
+	start = now();
+	do {
+		size_t before = heap_used();
+		void *result;
+
+		if( NULL == (result = (*func)( arg, &err ))){
+			fprintf( stderr, "%s failed: %s\n", name, err.message );
+			return false;
+		}
+
+		if( ! iter )
+			heap = heap_used() - before;
+
+		(*rfree)( result );
+		++iter;
+
+		sec = now() - start;
+	} while( sec < opt_time );
+
+	sec /= iter;
+	printf( "%s\t%u\t%u\t%.6f\t%.0f\t%lu\n",
+		name, items, iter, sec, items / sec, (unsigned long)heap );
+	fflush( stdout );
+
+	return true;
+}
+
+/************************************************************
+ *
+ * benchmarks
+ *
+ */
+
+struct bench_data_t {
+	srmio_data_t	data;
+	FILE		*fh;
+};
+
+static void bench_data_free( void *result )
+{
+	srmio_data_free( result );
+}
+
+static void bench_list_free( void *result )
+{
+	srmio_data_t *list = result, *dat;
+
+	for( dat = list; *dat; ++dat )
+		srmio_data_free( *dat );
+	free( list );
+}
+
+/* dummy result for functions that don't return data */
+static void bench_none_free( void *result )
+{
+	(void)result;
+}
+
+static void *bench_fixup( void *arg, srmio_error_t *err )
+{
+	struct bench_data_t *bd = arg;
+
+	return srmio_data_fixup( bd->data, err );
+}
+
+static void *bench_split( void *arg, srmio_error_t *err )
+{
+	struct bench_data_t *bd = arg;
+
+	return srmio_data_split( bd->data, 600, 500, err );
+}
+
+static void *bench_srm7_write( void *arg, srmio_error_t *err )
+{
+	struct bench_data_t *bd = arg;
+
+	rewind( bd->fh );
+	if( ! srmio_file_srm7_write( bd->data, bd->fh, err ))
+		return NULL;
+
+	fflush( bd->fh );
+	return bd;
+}
+
+static void *bench_srm_read( void *arg, srmio_error_t *err )
+{
+	struct bench_data_t *bd = arg;
+
+	rewind( bd->fh );
+	return srmio_file_srm_read( bd->fh, err );
+}
+
+static void *bench_srm_read_lazy( void *arg, srmio_error_t *err )
+{
+	struct bench_data_t *bd = arg;
+
+	rewind( bd->fh );
+	return srmio_file_srm_read_lazy( bd->fh, err );
+}
+
+static void *bench_wkt_write( void *arg, srmio_error_t *err )
+{
+	struct bench_data_t *bd = arg;
+
+	rewind( bd->fh );
+	if( ! srmio_file_wkt_write( bd->data, bd->fh, err ))
+		return NULL;
+
+	fflush( bd->fh );
+	return bd;
+}
+
+static bool bench_data( unsigned chunks )
+{
+	struct bench_data_t bd;
+	srmio_data_t fixed = NULL;
+	srmio_error_t err;
+	bool ret = false;
+
+	memset( &bd, 0, sizeof(bd) );
+
+	if( NULL == (bd.data = synth( chunks, BENCH_START, &err ))){
+		fprintf( stderr, "synth failed: %s\n", err.message );
+		return false;
+	}
+
+	if( ! bench( "fixup", chunks, bench_fixup, bench_data_free, &bd ))
+		goto clean1;
+
+	if( ! bench( "split", chunks, bench_split, bench_list_free, &bd ))
+		goto clean1;
+
+	if( NULL == (fixed = srmio_data_fixup( bd.data, &err ))){
+		fprintf( stderr, "fixup failed: %s\n", err.message );
+		goto clean1;
+	}
+	srmio_data_free( bd.data );
+	bd.data = fixed;
+
+	if( NULL == (bd.fh = tmpfile())){
+		fprintf( stderr, "tmpfile failed: %s\n", strerror(errno) );
+		goto clean1;
+	}
+
+	if( ! bench( "wkt_write", bd.data->cused, bench_wkt_write,
+		bench_none_free, &bd ))
+		goto clean2;
+
+	/* SRM files are limited to 64k chunks */
+	if( bd.data->cused > UINT16_MAX ){
+		printf( "# srm7: %u chunks exceed file format limit\n",
+			bd.data->cused );
+		ret = true;
+		goto clean2;
+	}
+
+	if( ! bench( "srm7_write", bd.data->cused, bench_srm7_write,
+		bench_none_free, &bd ))
+		goto clean2;
+
+	if( ! bench( "srm_read", bd.data->cused, bench_srm_read,
+		bench_data_free, &bd ))
+		goto clean2;
+
+	if( ! bench( "srm_read_lazy", bd.data->cused, bench_srm_read_lazy,
+		bench_data_free, &bd ))
+		goto clean2;
+
+	ret = true;
+
+clean2:
+	fclose( bd.fh );
+clean1:
+	srmio_data_free( bd.data );
+	return ret;
+}
+
+/************************************************************
+ *
+ * store
+ *
+ */
+
+struct bench_store_t {
+	const char	*path;
+	srmio_time_t	start;
+};
+
+static void *bench_store_have( void *arg, srmio_error_t *err )
+{
+	struct bench_store_t *bs = arg;
+	srmio_store_t store;
+	bool have;
+
+	if( NULL == (store = srmio_store_new( bs->path, err )))
+		return NULL;
+
+	if( ! srmio_store_have( store, "bench", bs->start, 1200, &have, err ))
+		goto clean1;
+
+	if( ! have ){
+		snprintf( err->message, SRMIO_ERROR_MSG_SIZE,
+			"file not found in store" );
+		goto clean1;
+	}
+
+	return store;
+
+clean1:
+	srmio_store_free( store );
+	return NULL;
+}
+
+static void bench_store_free( void *result )
+{
+	srmio_store_free( result );
+}
+
+/*
+ * remove directory tree
+ */
+static void rmtree( const char *path )
+{
+	struct dirent *ent;
+	DIR *dh;
+
+	if( NULL != (dh = opendir( path ))){
+		while( NULL != (ent = readdir( dh ))){
+			char sub[PATH_MAX];
+			struct stat st;
+
+			if( 0 == strcmp( ent->d_name, "." )
+				|| 0 == strcmp( ent->d_name, ".." ))
+				continue;
+
+			snprintf( sub, PATH_MAX, "%s/%s", path, ent->d_name );
+			if( 0 == stat( sub, &st ) && S_ISDIR( st.st_mode ))
+				rmtree( sub );
+			else
+				remove( sub );
+		}
+		closedir( dh );
+	}
+
+	rmdir( path );
+}
+
+static bool bench_store( unsigned files )
+{
+#ifdef HAVE_MKDTEMP
+	char path[PATH_MAX];
+	const char *tmp;
+	struct bench_store_t bs;
+	srmio_store_t store;
+	srmio_error_t err;
+	bool ret = false;
+	unsigned i;
+
+	if( NULL == (tmp = getenv( "TMPDIR" )))
+		tmp = "/tmp";
+
+	snprintf( path, PATH_MAX, "%s/srmbenchXXXXXX", tmp );
+	if( NULL == mkdtemp( path )){
+		fprintf( stderr, "mkdtemp failed: %s\n", strerror(errno) );
+		return false;
+	}
+
+	if( NULL == (store = srmio_store_new( path, &err ))){
+		fprintf( stderr, "store_new failed: %s\n", err.message );
+		goto clean1;
+	}
+
+	/* one short ride per day */
+	for( i = 0; i < files; ++i ){
+		srmio_data_t data, fixed;
+		bool ok;
+
+		if( NULL == (data = synth( 300, BENCH_START
+			+ (srmio_time_t)i * 864000, &err ))){
+
+			fprintf( stderr, "synth failed: %s\n", err.message );
+			goto clean2;
+		}
+
+		fixed = srmio_data_fixup( data, &err );
+		srmio_data_free( data );
+		if( ! fixed ){
+			fprintf( stderr, "fixup failed: %s\n", err.message );
+			goto clean2;
+		}
+
+		ok = srmio_store_add( store, fixed, NULL, &err );
+		srmio_data_free( fixed );
+		if( ! ok ){
+			fprintf( stderr, "store_add failed: %s\n", err.message );
+			goto clean2;
+		}
+	}
+
+	bs.path = path;
+	bs.start = BENCH_START + (srmio_time_t)(files / 2) * 864000;
+	ret = bench( "store_have", files, bench_store_have,
+		bench_store_free, &bs );
+
+clean2:
+	srmio_store_free( store );
+clean1:
+	rmtree( path );
+	return ret;
+#else
+	(void)files;
+	printf( "# store: mkdtemp isn't supported on this platform\n" );
+	return true;
+#endif
+}
+
+/************************************************************
+ *
+ * main
+ *
+ */
+
+static void usage( char *name );
+
+int main( int argc, char **argv )
+{
+	char *opt_chunks = "1000,10000,100000,1000000";
+	unsigned opt_files = 1000;
+	int opt_help = 0;
+	int needhelp = 0;
+	struct option lopts[] = {
+		{ "chunks", required_argument, NULL, 'c' },
+		{ "files", required_argument, NULL, 'f' },
+		{ "help", no_argument, NULL, 'h' },
+		{ "seed", required_argument, NULL, 's' },
+		{ "time", required_argument, NULL, 't' },
+		{ NULL, 0, NULL, 0 },
+	};
+	char *p;
+	char c;
+
+	while( -1 != ( c = getopt_long( argc, argv, "c:f:hs:t:", lopts, NULL ))){
+		switch(c){
+		  case 'c':
+			opt_chunks = optarg;
+			break;
+
+		  case 'f':
+			opt_files = atoi(optarg);
+			break;
+
+		  case 'h':
+			++opt_help;
+			break;
+
+		  case 's':
+			opt_seed = atoi(optarg);
+			break;
+
+		  case 't':
+			opt_time = atof(optarg);
+			break;
+
+		  default:
+			++needhelp;
+		}
+	}
+
+	if( opt_help ){
+		usage( argv[0] );
+		exit( 0 );
+	}
+
+	if( ! opt_seed ){
+		fprintf( stderr, "seed must not be 0\n" );
+		++needhelp;
+	}
+
+	if( needhelp ){
+		fprintf( stderr, "use %s --help for usage info\n", argv[0] );
+		exit(1);
+	}
+
+	printf( "# srmbench %s commit %s seed %u\n", PACKAGE_VERSION,
+		srmio_commit, opt_seed );
+	printf( "name\titems\titer\tsec\titems_per_sec\theap_bytes\n" );
+
+	for( p = opt_chunks; *p; ){
+		unsigned chunks = strtoul( p, &p, 10 );
+
+		if( chunks && ! bench_data( chunks ))
+			return 1;
+
+		while( *p == ',' )
+			++p;
+	}
+
+	if( opt_files && ! bench_store( opt_files ))
+		return 1;
+
+	return 0;
+}
+
+static void usage( char *name )
+{
+	printf(
+"usage: %s [options]\n"
+"time srmio functions on synthetic data\n"
+"\n"
+"options:\n"
+" --chunks=<n,..>|-c  ride sizes to use, default 1000,10000,100000,1000000\n"
+" --files=<n>|-f      files in store, 0 to skip, default 1000\n"
+" --help|-h           this cruft\n"
+" --seed=<n>|-s       seed for synthetic data\n"
+" --time=<sec>|-t     minimum time per benchmark, default 0.5\n"
+"\n"
+"Prints tab separated results. heap_bytes is the memory held by the\n"
+"result - 0 when it can't be determined.\n"
+, name );
+}
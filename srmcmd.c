@@ -22,6 +22,7 @@
  ************************************************************/
 
 #include "srmio.h"
+#include "getnum.h"
 
 #include "config.h"
 
@@ -52,12 +53,20 @@
 # include <strings.h>
 #endif
 
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#ifdef HAVE_LIMITS_H
+# include <limits.h>
+#endif
+
 
 
 static void csvdump( srmio_data_t data )
 {
-	srmio_chunk_t *ck;
 	srmio_time_t recint;
+	unsigned i;
 
 	if( ! srmio_data_recint( data, &recint, NULL ) )
 		return;
@@ -72,7 +81,10 @@ static void csvdump( srmio_data_t data )
 		"hr\t"
 		"ele"
 		"\n");
-	for( ck=data->chunks; *ck; ++ck ){
+	for( i = 0; i < data->cused; ++i ){
+		struct _srmio_chunk_t ck;
+
+		srmio_data_chunk_get( data, i, &ck );
 		printf(
 			"%.1f\t"	/* "time\t" */
 			"%.1f\t"	/* "dur\t" */
@@ -83,14 +95,14 @@ static void csvdump( srmio_data_t data )
 			"%u\t"		/* "hr\t" */
 			"%ld"		/* "ele\t" */
 			"\n",
-			(double)(*ck)->time / 10,
+			(double)ck.time / 10,
 			(double)recint / 10,
-			(*ck)->temp,
-			(*ck)->pwr,
-			(*ck)->speed,
-			(*ck)->cad,
-			(*ck)->hr,
-			(*ck)->ele
+			ck.temp,
+			ck.pwr,
+			ck.speed,
+			ck.cad,
+			ck.hr,
+			ck.ele
 			);
 	}
 }
@@ -112,24 +124,166 @@ static void logfunc( const char *msg, void *data )
 bool do_fixup( srmio_data_t *srmdata, bool fixup )
 {
 	srmio_error_t err;
-	srmio_data_t fixed;
 
 	if( ! fixup )
 		return true;
 
-	if( NULL == ( fixed = srmio_data_fixup( *srmdata, &err ) )){
-		fprintf( stderr, "srmio_data_fixup failed: %s\n",
+	if( ! srmio_data_fixup_inplace( *srmdata, &err ) ){
+		fprintf( stderr, "srmio_data_fixup_inplace failed: %s\n",
+			err.message );
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * restrict data to chunks between start and end (seconds since epoch,
+ * 0 = unlimited)
+ */
+bool do_range( srmio_data_t *srmdata, srmio_time_t start, srmio_time_t end )
+{
+	srmio_error_t err;
+	srmio_data_t range;
+	unsigned first, last;
+
+	if( ! start && ! end )
+		return true;
+
+	if( ! end )
+		end = (srmio_time_t)-1;
+
+	if( ! srmio_data_range( *srmdata, start, end, &first, &last, &err )){
+		fprintf( stderr, "srmio_data_range failed: %s\n",
+			err.message );
+		return false;
+	}
+
+	if( NULL == (range = srmio_data_slice( *srmdata, first, last, &err ))){
+		fprintf( stderr, "srmio_data_slice failed: %s\n",
+			err.message );
+		return false;
+	}
+
+	srmio_data_free( *srmdata );
+	*srmdata = range;
+	return true;
+}
+
+/*
+ * change recording interval, data is fixed first when requested
+ */
+bool do_resample( srmio_data_t *srmdata, bool fixup, srmio_time_t recint )
+{
+	srmio_error_t err;
+	srmio_data_t resampled;
+
+	if( ! recint )
+		return true;
+
+	if( ! do_fixup( srmdata, fixup ))
+		return false;
+
+	if( NULL == (resampled = srmio_data_resample( *srmdata, recint,
+		&err ))){
+
+		fprintf( stderr, "srmio_data_resample failed: %s\n",
 			err.message );
 		return false;
 	}
 
 	srmio_data_free( *srmdata );
-	*srmdata = fixed;
+	*srmdata = resampled;
 	return true;
 }
 
-bool write_files( srmio_data_t *srmdata, bool fixup, char *fname,
-	srmio_ftype_t type, srmio_time_t split )
+#ifdef HAVE_MKSTEMPS
+/*
+ * pieces of split data are fixed and written on a thread pool. Names
+ * are reported in order.
+ */
+struct write_job_t {
+	srmio_data_t	data;
+	char		*fname;
+	bool		failed;
+	char		msg[SRMIO_ERROR_MSG_SIZE + 64];
+};
+
+struct write_ctx_t {
+	bool		fixup;
+	srmio_ftype_t	type;
+	const char	*fname;		/* template */
+	int		suffixlen;
+	struct write_job_t	*job;
+};
+
+static void write_piece( void *arg, unsigned i )
+{
+	struct write_ctx_t *ctx = arg;
+	struct write_job_t *job = &ctx->job[i];
+	srmio_error_t err;
+	FILE *fh;
+	int fd;
+
+	if( job->failed )
+		return;
+
+	if( ctx->fixup && ! srmio_data_fixup_inplace( job->data, &err ) ){
+		snprintf( job->msg, sizeof(job->msg),
+			"srmio_data_fixup_inplace failed: %s", err.message );
+		goto clean1;
+	}
+
+	strcpy( job->fname, ctx->fname );
+	if( 0 > ( fd = mkstemps( job->fname, ctx->suffixlen ))){
+		snprintf( job->msg, sizeof(job->msg), "mkstemps(%s) failed: %s",
+			job->fname, strerror(errno) );
+		goto clean1;
+	}
+
+	if( NULL == ( fh = fdopen( fd, "w" ) )){
+		snprintf( job->msg, sizeof(job->msg), "fdopen failed: %s",
+			strerror(errno) );
+		close( fd );
+		goto clean2;
+	}
+
+	if( ! srmio_file_ftype_write( job->data, ctx->type, fh, &err ) ){
+		snprintf( job->msg, sizeof(job->msg),
+			"srmio_file_write(%s) failed: %s",
+			job->fname, err.message );
+		fclose( fh );
+		goto clean2;
+	}
+
+	fclose( fh );
+	return;
+
+clean2:
+	remove( job->fname );
+clean1:
+	job->failed = true;
+}
+
+static void write_free( struct write_job_t *job, unsigned used )
+{
+	unsigned i;
+
+	for( i = 0; i < used; ++i ){
+		free( job[i].fname );
+		srmio_data_free( job[i].data );
+	}
+}
+#endif
+
+/*
+ * write data to fname, or split it to files named after the fname
+ * template. Data fixed while downloading is split into the pieces
+ * of fx.
+ */
+bool write_files( srmio_data_t *srmdata, bool fixup, srmio_fixup_t fx,
+	char *fname, srmio_ftype_t type, srmio_time_t split,
+	unsigned min_chunks, unsigned threads )
 {
 	srmio_error_t err;
 	FILE *fh;
@@ -161,68 +315,121 @@ bool write_files( srmio_data_t *srmdata, bool fixup, char *fname,
 
 	} else {
 #ifdef HAVE_MKSTEMPS
-		srmio_data_t *dat, *list;
+		struct write_ctx_t ctx;
+		srmio_split_iter_t it;
+		srmio_pool_t pool;
 		char *match;
-		int suffixlen;
-		char *nfname;
-
-		if( NULL == (nfname = strdup(fname ))){
-			fprintf( stderr, "allocating new filenam failed: %s\n",
-				strerror(errno) );
-			return false;
-		}
+		unsigned window, used = 0, stop, i;
+		bool more = true;
+		bool ret = false;
 
 		if( NULL == (match = strrchr( fname, 'X' ) )){
 			fprintf( stderr, "missing 'XXXXX' in filename template\n" );
 			return false;
 		}
-		suffixlen = strlen(fname);
-		suffixlen -= (match - fname) +1;
 
-		if( NULL == ( list = srmio_data_split( *srmdata, split, 500, &err))){
+		ctx.fixup = fixup && ! fx;
+		ctx.type = type;
+		ctx.fname = fname;
+		ctx.suffixlen = strlen(fname);
+		ctx.suffixlen -= (match - fname) +1;
+
+		if( fx ){
+			it = srmio_fixup_split_iter_new( fx, min_chunks, &err );
+
+		} else {
+			it = srmio_data_split_iter_new( *srmdata, split, 500,
+				min_chunks, &err );
+		}
+
+		if( NULL == it ){
+
 			fprintf( stderr, "split failed: %s\n", err.message);
 			return false;
 		}
 
-		for( dat = list; *dat; ++dat ){
-			int fd;
+		if( NULL == ( pool = srmio_pool_new( threads, &err ))){
+			fprintf( stderr, "srmio_pool_new failed: %s\n",
+				err.message );
+			goto clean1;
+		}
 
-			/* TODO: make min chunks per file configurable */
-			if( (*dat)->cused < 5 ){
-				srmio_data_free( *dat );
-				continue;
-			}
+		/* limit pieces in progress */
+		window = 2 * srmio_pool_threads( pool );
+		if( NULL == ( ctx.job = malloc( window
+			* sizeof(struct write_job_t) ))){
 
-			if( ! do_fixup( dat, fixup ))
-				return false;
+			fprintf( stderr, "malloc failed: %s\n",
+				strerror(errno) );
+			goto clean2;
+		}
 
-			strcpy( nfname, fname );
-			if( 0 > ( fd = mkstemps( nfname, suffixlen ))){
-				fprintf( stderr, "mkstemps(%s) failed: %s\n",
-					nfname, strerror(errno) );
-				return false;
+		while( more ){
+			for( used = 0; used < window; ++used ){
+				struct write_job_t *jp = &ctx.job[used];
+
+				memset( jp, 0, sizeof(struct write_job_t) );
+
+				if( ! srmio_data_split_iter_next( it, &jp->data,
+					&err )){
+
+					fprintf( stderr, "split failed: %s\n",
+						err.message);
+					goto clean3;
+				}
+
+				if( ! jp->data ){
+					more = false;
+					break;
+				}
+
+				if( NULL == (jp->fname = strdup( fname ))){
+					snprintf( jp->msg, sizeof(jp->msg),
+						"allocating new filename failed: %s",
+						strerror(errno) );
+					jp->failed = true;
+					++used;
+					break;
+				}
 			}
 
-			if( NULL == ( fh = fdopen( fd, "w" ) )){
-				fprintf( stderr, "fdopen failed: %s\n",
-					strerror(errno) );
-				return false;
-			}
+			srmio_pool_run( pool, write_piece, &ctx, used );
+
+			/* report in order, stop at first failure */
+			stop = used;
+			for( i = 0; i < used; ++i ){
+				struct write_job_t *jp = &ctx.job[i];
+
+				if( i < stop && jp->failed ){
+					fprintf( stderr, "%s\n", jp->msg );
+					stop = i;
+
+				} else if( i > stop && ! jp->failed ){
+					remove( jp->fname );
 
-			if( ! srmio_file_ftype_write( *dat, type, fh, &err ) ){
-				fprintf( stderr, "srmio_file_write(%s) failed: %s\n",
-					nfname, err.message );
-				return false;
+				} else if( i < stop ){
+					printf( "%s\n", jp->fname );
+				}
 			}
 
-			fclose( fh );
+			if( stop < used )
+				goto clean3;
 
-			printf( "%s\n", nfname );
-			srmio_data_free( *dat );
+			write_free( ctx.job, used );
 		}
 
-		free( nfname );
-		free( list );
+		ret = true;
+		used = 0;
+
+clean3:
+		write_free( ctx.job, used );
+		free( ctx.job );
+clean2:
+		srmio_pool_free( pool );
+clean1:
+		srmio_data_split_iter_free( it );
+
+		return ret;
 #else
 		fprintf( stderr, "split isn't supported on this platform\n" );
 		return false;
@@ -242,16 +449,21 @@ int main( int argc, char **argv )
 	srmio_io_baudrate_t opt_baud = srmio_io_baud_max;
 	int opt_clear = 0;
 	int opt_date = 0;
+	srmio_time_t opt_end = 0;
 	int opt_ftdi = 0;
 	int opt_fixup = 0;
 	int opt_get = 0;
 	int opt_help = 0;
 	int opt_int = 0;
+	unsigned opt_min = 5;
 	int opt_name = 0;
 	int opt_pc = 5;
 	int opt_read = 0;
+	srmio_time_t opt_resample = 0;
 	srmio_time_t opt_split = 0;
 	srmio_ftype_t opt_rtype = srmio_ftype_srm7;
+	srmio_time_t opt_start = 0;
+	unsigned opt_threads = 0;
 	int opt_time = 0;
 	int opt_verb = 0;
 	int opt_version = 0;
@@ -262,29 +474,35 @@ int main( int argc, char **argv )
 		{ "baud", required_argument, NULL, 'b' },
 		{ "clear", no_argument, NULL, 'c' },
 		{ "date", no_argument, NULL, 'd' },
+		{ "end", required_argument, NULL, 'E' },
 		{ "ftdi", no_argument, NULL, 'f' },
 		{ "fixup", no_argument, NULL, 'x' },
 		{ "get", optional_argument, NULL, 'g' },
 		{ "help", no_argument, NULL, 'h' },
 		{ "int", required_argument, NULL, 'i' },
+		{ "min-chunks", required_argument, NULL, 'm' },
 		{ "name", no_argument, NULL, 'n' },
 		{ "pc", required_argument, NULL, 'p' },
 		{ "read", no_argument, NULL, 'r' },
 		{ "read-type", required_argument, NULL, 'R' },
+		{ "resample", required_argument, NULL, 'I' },
 		{ "split", required_argument, NULL, 's' },
+		{ "start", required_argument, NULL, 'S' },
+		{ "threads", required_argument, NULL, 'j' },
 		{ "time", no_argument, NULL, 't' },
 		{ "verbose", no_argument, NULL, 'v' },
 		{ "version", no_argument, NULL, 'V' },
 		{ "write", required_argument, NULL, 'w' },
 		{ "write-type", required_argument, NULL, 'W' },
+		{ NULL, 0, NULL, 0 },
 	};
 	char c;
+	unsigned long num;
 	srmio_error_t err;
 	srmio_io_t io;
 	srmio_pc_t srm;
 
-	/* TODO: option to filter data by timerange */
-	while( -1 != ( c = getopt_long( argc, argv, "b:cdfg::hi:np:rR:s:tVvw:W:x", lopts, NULL ))){
+	while( -1 != ( c = getopt_long( argc, argv, "b:cdE:fg::hi:I:j:m:np:rR:s:S:tVvw:W:x", lopts, NULL ))){
 		switch(c){
 		  case 'b':
 			if( ! srmio_io_name2baud( atoi(optarg), &opt_baud)){
@@ -301,6 +519,15 @@ int main( int argc, char **argv )
 			++opt_date;
 			break;
 
+		  case 'E':
+			if( ! get_num( optarg, ULONG_MAX / 10, &num ) ){
+				fprintf( stderr, "invalid end time: %s\n", optarg );
+				++needhelp;
+				break;
+			}
+			opt_end = (srmio_time_t)num * 10;
+			break;
+
 		  case 'f':
 			++opt_ftdi;
 			break;
@@ -319,6 +546,34 @@ int main( int argc, char **argv )
 			opt_int = atoi(optarg);
 			break;
 
+		  case 'I':
+			if( ! get_num( optarg, UINT_MAX, &num ) || ! num ){
+				fprintf( stderr, "invalid recording interval: %s\n",
+					optarg );
+				++needhelp;
+				break;
+			}
+			opt_resample = num;
+			break;
+
+		  case 'j':
+			if( ! get_num( optarg, UINT_MAX, &num ) ){
+				fprintf( stderr, "invalid thread count: %s\n", optarg );
+				++needhelp;
+				break;
+			}
+			opt_threads = num;
+			break;
+
+		  case 'm':
+			if( ! get_num( optarg, UINT_MAX, &num ) ){
+				fprintf( stderr, "invalid chunk count: %s\n", optarg );
+				++needhelp;
+				break;
+			}
+			opt_min = num;
+			break;
+
 		  case 'n':
 			++opt_name;
 			break;
@@ -342,13 +597,27 @@ int main( int argc, char **argv )
 
 		  case 's':
 #ifdef HAVE_MKSTEMPS
-			opt_split = atoi(optarg);
+			if( ! get_num( optarg, UINT_MAX, &num ) ){
+				fprintf( stderr, "invalid split gap: %s\n", optarg );
+				++needhelp;
+				break;
+			}
+			opt_split = num;
 #else
 			fprintf( stderr, "split isn't supported on this platform\n" );
 			++needhelp;
 #endif
 			break;
 
+		  case 'S':
+			if( ! get_num( optarg, ULONG_MAX / 10, &num ) ){
+				fprintf( stderr, "invalid start time: %s\n", optarg );
+				++needhelp;
+				break;
+			}
+			opt_start = (srmio_time_t)num * 10;
+			break;
+
 		  case 't':
 			++opt_time;
 			break;
@@ -400,6 +669,11 @@ int main( int argc, char **argv )
 	}
 	fname = argv[optind];
 
+	if( opt_end && opt_end <= opt_start ){
+		fprintf( stderr, "end time must be after start time\n" );
+		++needhelp;
+	}
+
 	if( needhelp ){
 		fprintf( stderr, "use %s --help for usage info\n", argv[0] );
 		exit(1);
@@ -424,6 +698,12 @@ int main( int argc, char **argv )
 
 		fclose( fh );
 
+		if( ! do_range( &srmdata, opt_start, opt_end ) )
+			return 1;
+
+		if( ! do_resample( &srmdata, opt_fixup, opt_resample ) )
+			return 1;
+
 		if( opt_name ){
 			if( ! srmdata->mused ){
 				fprintf( stderr, "no data available\n" );
@@ -451,7 +731,8 @@ int main( int argc, char **argv )
 
 
 		} else if( opt_write ){
-			if( ! write_files( &srmdata, opt_fixup, opt_write, opt_wtype, opt_split ))
+			if( ! write_files( &srmdata, opt_fixup, NULL, opt_write,
+				opt_wtype, opt_split, opt_min, opt_threads ))
 				return 1;
 
 		} else {
@@ -562,6 +843,7 @@ int main( int argc, char **argv )
 
 	} else if( opt_get || opt_date ){
 		srmio_data_t srmdata;
+		srmio_fixup_t fixup = NULL;
 
 		if( NULL == (srmdata = srmio_data_new( &err ) ) ){
 			fprintf( stderr, "srmio_data_new failed: %s\n",
@@ -572,8 +854,31 @@ int main( int argc, char **argv )
 		if( opt_all )
 			srmio_pc_set_xfer( srm, srmio_pc_xfer_type_all, NULL );
 
+		/* fix pieces while downloading, when they're written
+		 * unclipped */
+		if( opt_fixup && opt_write && opt_split && ! opt_start
+			&& ! opt_end && ! opt_resample ){
+
+			if( NULL == (fixup = srmio_fixup_new( srmdata,
+				opt_split, 500, &err ))){
+
+				fprintf( stderr, "srmio_fixup_new failed: %s\n",
+					err.message );
+				return 1;
+			}
+		}
+
 		/* get new/all chunks */
-		if( ! srmio_pc_xfer_all( srm, srmdata,
+		if( fixup ){
+			if( ! srmio_pc_xfer_all_fixup( srm, fixup,
+				progress, NULL, &err )){
+
+				fprintf( stderr, "srmio_pc_xfer_all_fixup failed: "
+					"%s\n", err.message );
+				return 1;
+			}
+
+		} else if( ! srmio_pc_xfer_all( srm, srmdata,
 			progress, NULL, &err )){
 
 			fprintf( stderr, "srmio_pc_xfer_all failed: %s\n",
@@ -581,6 +886,12 @@ int main( int argc, char **argv )
 			return 1;
 		}
 
+		if( ! do_range( &srmdata, opt_start, opt_end ) )
+			return 1;
+
+		if( ! do_resample( &srmdata, opt_fixup, opt_resample ) )
+			return 1;
+
 		if( opt_date ){
 			srmio_time_t start;
 
@@ -598,7 +909,8 @@ int main( int argc, char **argv )
 			printf( "%.0f\n", (double)start / 10 );
 
 		} else if( opt_write ){
-			if( ! write_files( &srmdata, opt_fixup, opt_write, opt_wtype, opt_split ))
+			if( ! write_files( &srmdata, opt_fixup, fixup, opt_write,
+				opt_wtype, opt_split, opt_min, opt_threads ))
 				return 1;
 
 		} else {
@@ -606,6 +918,7 @@ int main( int argc, char **argv )
 				return 1;
 			csvdump( srmdata );
 		}
+		srmio_fixup_free( fixup );
 		srmio_data_free( srmdata );
 
 	}
@@ -655,16 +968,21 @@ static void usage( char *name )
 " --baud=<rate>|-b    use fixed baud rate instead of auto-probing\n"
 " --clear|-c          clear data on SRM\n"
 " --date|-d           print date of workout\n"
+" --end=<time>|-E     only use data before time (seconds since 1970)\n"
 " --fixup|-x          try to fix time-glitches in retrieved data\n"
 " --ftdi|-f           use ftdi driver\n"
 " --get[=all]|-g      download data from SRM and dump it to stdout\n"
 " --help|-h           this cruft\n"
 " --int=<interval>|-i set recording interval, 10 -> 1sec\n"
+" --min-chunks=<n>|-m skip split data with less chunks, default 5\n"
 " --name|-n           get athlete name\n"
 " --pc=<type>|-p      power control version: 5, 6 or 7\n"
 " --read|-r           read from speciefied file instead of device\n"
 " --read-type=<t>|-R  read data as specified file format\n"
+" --resample=<int>|-I change recording interval, 10 -> 1sec\n"
 " --split=<gap>|-s    split data on gaps of specified length\n"
+" --start=<time>|-S   only use data from time on (seconds since 1970)\n"
+" --threads=<n>|-j    threads for writing split data, 0: one per CPU\n"
 " --time|-t           set current time\n"
 " --verbose|-v        increase verbosity\n"
 " --version|-V        show version number and exit\n"
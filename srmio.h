@@ -63,7 +63,7 @@ typedef uint64_t srmio_time_t;	/* seconds since epoch * 10 */
 struct _srmio_chunk_t {
 	srmio_time_t	time;	/* chunk start time */
 	srmio_time_t	dur;	/* chunk duration */
-	double		temp;	/* temperature C */
+	double		temp;	/* temperature °C */
 	unsigned	pwr;	/* avg power W */
 	double		speed;	/* avg speed km/h */
 	unsigned	cad;	/* avg cadence 1/min */
@@ -110,15 +110,27 @@ struct _srmio_data_t {
 	char		*notes;
 	char		*athlete;	/* athlete name */
 
-	/* array of chunks */
-	srmio_chunk_t	 *chunks;
+	/* number of chunks, use srmio_data_chunk() or
+	 * srmio_data_chunk_get() to access them */
 	unsigned	cused;
-	unsigned	cavail;
 
 	/* array of marker */
 	srmio_marker_t	 *marker;
 	unsigned	mused;
 	unsigned	mavail;
+
+	/* library internal, don't touch */
+	srmio_chunk_t	 *chunks;	/* not filled for compact data */
+	unsigned	cavail;
+	struct _srmio_arena_t	*carena;	/* chunk storage */
+	struct _srmio_arena_t	*marena;	/* marker storage */
+	unsigned	cforeign;	/* chunks not from carena */
+	struct _srmio_packed_t	*packed;	/* compact chunks */
+	struct _srmio_arena_t	**shared;	/* storage of shared chunks */
+	unsigned	sused;
+	struct _srmio_mindex_t	*mindex;	/* marker index */
+	struct _srmio_tindex_t	*tindex;	/* time index */
+	struct _srmio_sums_t	*sums;	/* running totals */
 };
 typedef struct _srmio_data_t *srmio_data_t;
 
@@ -126,8 +138,22 @@ srmio_data_t srmio_data_new( srmio_error_t *err );
 srmio_data_t srmio_data_header( srmio_data_t src, srmio_error_t *err );
 void srmio_data_free( srmio_data_t data );
 
+srmio_chunk_t srmio_data_chunk_new( srmio_data_t data, srmio_error_t *err );
+srmio_marker_t srmio_data_marker_new( srmio_data_t data, srmio_error_t *err );
+
+bool srmio_data_reserve( srmio_data_t data, unsigned chunks, unsigned markers,
+	srmio_error_t *err );
+
 bool srmio_data_add_chunkp( srmio_data_t data, srmio_chunk_t chunk, srmio_error_t *err );
 bool srmio_data_add_chunk( srmio_data_t data, srmio_chunk_t chunk, srmio_error_t *err );
+bool srmio_data_add_chunkref( srmio_data_t dst, srmio_data_t src,
+	unsigned i, srmio_error_t *err );
+bool srmio_data_add_chunkrefs( srmio_data_t dst, srmio_data_t src,
+	unsigned first, unsigned n, srmio_error_t *err );
+bool srmio_data_add_chunks( srmio_data_t data,
+	const struct _srmio_chunk_t *src, size_t n, srmio_error_t *err );
+bool srmio_data_add_chunks_move( srmio_data_t data, srmio_chunk_t src,
+	size_t n, srmio_error_t *err );
 bool srmio_data_add_markerp( srmio_data_t data, srmio_marker_t mark, srmio_error_t *err );
 bool srmio_data_add_marker( srmio_data_t data, unsigned first, unsigned last, srmio_error_t *err );
 
@@ -136,15 +162,136 @@ bool srmio_data_time_end( srmio_data_t data, srmio_time_t *end, srmio_error_t *e
 bool srmio_data_recint( srmio_data_t data, srmio_time_t *recint, srmio_error_t *err );
 srmio_marker_t *srmio_data_blocks( srmio_data_t data, srmio_error_t *err );
 
+void srmio_data_changed( srmio_data_t data );
+
+srmio_data_t srmio_data_slice( srmio_data_t src, unsigned first,
+	unsigned last, srmio_error_t *err );
+srmio_chunk_t srmio_data_chunk_unshare( srmio_data_t data, unsigned i,
+	srmio_error_t *err );
+bool srmio_data_unshare( srmio_data_t data, srmio_error_t *err );
 
 
 /************************************************************
  *
- * from fixup.c
+ * from mindex.c
  *
  ************************************************************/
 
-srmio_data_t srmio_data_fixup( srmio_data_t data, srmio_error_t *err );
+srmio_marker_t *srmio_data_markers_range( srmio_data_t data,
+	unsigned first, unsigned last, srmio_error_t *err );
+bool srmio_data_marker_shift( srmio_data_t data, unsigned pos,
+	unsigned delta, srmio_error_t *err );
+void srmio_data_marker_sync( srmio_data_t data );
+
+
+/************************************************************
+ *
+ * from tindex.c
+ *
+ ************************************************************/
+
+bool srmio_data_find_time( srmio_data_t data, srmio_time_t time,
+	unsigned *chunk, srmio_error_t *err );
+bool srmio_data_range( srmio_data_t data, srmio_time_t start,
+	srmio_time_t end, unsigned *first, unsigned *last, srmio_error_t *err );
+
+/* range of chunks with continuous timestamps */
+struct _srmio_block_t {
+	unsigned	first;
+	unsigned	last;
+};
+
+const struct _srmio_block_t *srmio_data_block_list( srmio_data_t data,
+	unsigned *cnt, srmio_error_t *err );
+
+
+/************************************************************
+ *
+ * from stats.c
+ *
+ ************************************************************/
+
+/* summary of a data set's chunks */
+struct _srmio_stats_t {
+	unsigned	chunks;
+	srmio_time_t	dur;		/* total duration 1/10 sec */
+	double		work;		/* J */
+	double		dist;		/* m */
+	double		pwr_avg;	/* W */
+	unsigned	pwr_max;
+	double		hr_avg;		/* 1/min */
+	unsigned	hr_max;
+	double		cad_avg;	/* 1/min */
+	unsigned	cad_max;
+};
+typedef struct _srmio_stats_t *srmio_stats_t;
+
+bool srmio_data_stats_enable( srmio_data_t data, srmio_error_t *err );
+void srmio_data_stats_disable( srmio_data_t data );
+bool srmio_data_stats_enabled( srmio_data_t data );
+bool srmio_data_stats( srmio_data_t data, srmio_stats_t stats,
+	srmio_error_t *err );
+
+
+/************************************************************
+ *
+ * from compact.c
+ *
+ ************************************************************/
+
+bool srmio_data_compact( srmio_data_t data, srmio_error_t *err );
+bool srmio_data_expand( srmio_data_t data, srmio_error_t *err );
+bool srmio_data_is_compact( srmio_data_t data );
+
+srmio_chunk_t srmio_data_chunk( srmio_data_t data, unsigned i,
+	srmio_error_t *err );
+void srmio_data_chunk_get( srmio_data_t data, unsigned i, srmio_chunk_t chunk );
+
+
+/************************************************************
+ *
+ * from columns.c
+ *
+ ************************************************************/
+
+/* columnar copy of a data set's chunks: row i of each array holds the
+ * values of chunk i */
+struct _srmio_columns_t {
+	unsigned	used;	/* number of rows */
+	unsigned	avail;	/* allocated rows */
+
+	srmio_time_t	*time;
+	srmio_time_t	*dur;
+	unsigned	*pwr;
+	double		*speed;
+	unsigned	*cad;
+	unsigned	*hr;
+	long		*ele;
+	double		*temp;
+};
+typedef struct _srmio_columns_t *srmio_columns_t;
+
+srmio_columns_t srmio_data_columns( srmio_data_t data, srmio_error_t *err );
+void srmio_columns_free( srmio_columns_t cols );
+void srmio_columns_get( srmio_columns_t cols, unsigned i, srmio_chunk_t chunk );
+
+
+/************************************************************
+ *
+ * from pool.c
+ *
+ ************************************************************/
+
+typedef struct _srmio_pool_t *srmio_pool_t;
+
+typedef void (*srmio_pool_job_t)( void *arg, unsigned i );
+
+srmio_pool_t srmio_pool_new( unsigned threads, srmio_error_t *err );
+void srmio_pool_free( srmio_pool_t pool );
+unsigned srmio_pool_threads( srmio_pool_t pool );
+void srmio_pool_run( srmio_pool_t pool, srmio_pool_job_t func,
+	void *arg, unsigned n );
+
 
 /************************************************************
  *
@@ -155,6 +302,76 @@ srmio_data_t srmio_data_fixup( srmio_data_t data, srmio_error_t *err );
 srmio_data_t *srmio_data_split( srmio_data_t src,
 	srmio_time_t gap, srmio_time_t overlap, srmio_error_t *err );
 
+typedef struct _srmio_split_iter_t *srmio_split_iter_t;
+
+srmio_split_iter_t srmio_data_split_iter_new( srmio_data_t src,
+	srmio_time_t gap, srmio_time_t overlap, unsigned min_chunks,
+	srmio_error_t *err );
+void srmio_data_split_iter_free( srmio_split_iter_t it );
+bool srmio_data_split_iter_next( srmio_split_iter_t it,
+	srmio_data_t *piece, srmio_error_t *err );
+
+
+/************************************************************
+ *
+ * from fixup.c
+ *
+ ************************************************************/
+
+srmio_data_t srmio_data_fixup( srmio_data_t data, srmio_error_t *err );
+srmio_data_t srmio_data_fixup_parallel( srmio_data_t data,
+	srmio_pool_t pool, srmio_error_t *err );
+bool srmio_data_fixup_inplace( srmio_data_t data, srmio_error_t *err );
+
+typedef struct _srmio_fixup_t *srmio_fixup_t;
+
+srmio_fixup_t srmio_fixup_new( srmio_data_t data, srmio_time_t gap,
+	srmio_time_t overlap, srmio_error_t *err );
+void srmio_fixup_free( srmio_fixup_t fx );
+bool srmio_fixup_add( srmio_fixup_t fx, srmio_chunk_t chunk,
+	srmio_error_t *err );
+bool srmio_fixup_finish( srmio_fixup_t fx, srmio_error_t *err );
+srmio_split_iter_t srmio_fixup_split_iter_new( srmio_fixup_t fx,
+	unsigned min_chunks, srmio_error_t *err );
+
+/************************************************************
+ *
+ * from resample.c
+ *
+ ************************************************************/
+
+srmio_data_t srmio_data_resample( srmio_data_t data, srmio_time_t recint,
+	srmio_error_t *err );
+
+
+/************************************************************
+ *
+ * from synth.c
+ *
+ ************************************************************/
+
+typedef enum {
+	srmio_synth_pc5,
+	srmio_synth_pc7,
+} srmio_synth_pc_t;
+
+struct _srmio_synth_t {
+	srmio_time_t	start;
+	srmio_time_t	duration;	/* without gaps */
+	srmio_time_t	recint;
+	unsigned	gaps;		/* per 10000 chunks */
+	srmio_time_t	gap_max;	/* longest gap */
+	unsigned	overlaps;	/* per 10000 chunks */
+	unsigned	marker;		/* avg chunks per marker, 0: none */
+	srmio_synth_pc_t	pc;	/* value ranges */
+	unsigned	seed;		/* non-zero */
+	const char	*athlete;
+};
+typedef struct _srmio_synth_t *srmio_synth_t;
+
+void srmio_synth_init( srmio_synth_t conf );
+srmio_data_t srmio_data_synth( srmio_synth_t conf, srmio_error_t *err );
+
 
 /************************************************************
  *
@@ -162,7 +379,27 @@ srmio_data_t *srmio_data_split( srmio_data_t src,
  *
  ************************************************************/
 
+/* file summary from srmio_file_srm_probe() */
+struct _srmio_file_srm_info_t {
+	char		version;	/* '5', '6' or '7' */
+	srmio_time_t	start;
+	srmio_time_t	end;
+	srmio_time_t	recint;
+	unsigned	chunks;
+	unsigned	marker;
+	char		athlete[256];
+};
+typedef struct _srmio_file_srm_info_t *srmio_file_srm_info_t;
+
+bool srmio_file_srm_probe( FILE *fh, srmio_file_srm_info_t info,
+	srmio_error_t *err );
 srmio_data_t srmio_file_srm_read( FILE *fh, srmio_error_t *err );
+srmio_data_t srmio_file_srm_read_lazy( FILE *fh, srmio_error_t *err );
+srmio_data_t srmio_file_srm_read_fd( int fd, srmio_error_t *err );
+srmio_data_t srmio_file_srm_read_mem( const unsigned char *mem, size_t len,
+	srmio_error_t *err );
+bool srmio_file_srm5_write( srmio_data_t data, FILE *fh, srmio_error_t *err );
+bool srmio_file_srm6_write( srmio_data_t data, FILE *fh, srmio_error_t *err );
 bool srmio_file_srm7_write( srmio_data_t data, FILE *fh, srmio_error_t *err );
 
 
@@ -215,6 +452,10 @@ bool srmio_store_have_data( srmio_store_t store, srmio_data_t data,
 
 bool srmio_store_add( srmio_store_t store, srmio_data_t data,
 	char **fname, srmio_error_t *err );
+bool srmio_store_reserve( srmio_store_t store, srmio_data_t data,
+	char **fname, srmio_error_t *err );
+bool srmio_store_write( srmio_store_t store, srmio_data_t data,
+	const char *fname, srmio_error_t *err );
 
 /************************************************************
  *
@@ -394,6 +635,7 @@ typedef void (*srmio_progress_t)( size_t total, size_t done,
 
 bool srmio_pc_xfer_start( srmio_pc_t conn, srmio_error_t *err );
 bool srmio_pc_xfer_get_blocks( srmio_pc_t conn, size_t *blocks, srmio_error_t *err );
+bool srmio_pc_xfer_block_chunks( srmio_pc_t conn, size_t *chunks );
 bool srmio_pc_xfer_block_next( srmio_pc_t conn, srmio_pc_xfer_block_t block );
 bool srmio_pc_xfer_chunk_next( srmio_pc_t conn, srmio_chunk_t chunk,
 	bool *is_intervall, bool *start_intervall );
@@ -405,6 +647,10 @@ bool srmio_pc_xfer_all( srmio_pc_t conn,
 	srmio_data_t data,
 	srmio_progress_t pfunc, void *prog_data,
 	srmio_error_t *err );
+bool srmio_pc_xfer_all_fixup( srmio_pc_t conn,
+	srmio_fixup_t fx,
+	srmio_progress_t pfunc, void *prog_data,
+	srmio_error_t *err );
 
 
 /************************************************************
@@ -8,6 +8,7 @@
  */
 
 #include "srmio.h"
+#include "getnum.h"
 
 #include "config.h"
 
@@ -38,6 +39,12 @@
 # include <strings.h>
 #endif
 
+#ifdef HAVE_LIMITS_H
+# include <limits.h>
+#endif
+
+/* chunks collected before they're added to data */
+#define XFER_BATCH	64
 
 char *dev = NULL;
 int opt_all = 0;
@@ -47,9 +54,11 @@ int opt_fixup = 0;
 int opt_ftdi = 0;
 srmio_time_t opt_fuzz = 1200;
 int opt_help = 0;
+unsigned opt_min = 5;
 int opt_pc = 5;
-int opt_split = 72000;
+srmio_time_t opt_split = 72000;
 char *opt_store = NULL;
+unsigned opt_threads = 0;
 int opt_verbose = 0;
 int opt_version = 0;
 char *opt_write = NULL;
@@ -60,9 +69,11 @@ struct option lopts[] = {
 	{ "fixup", no_argument, NULL, 'x' },
 	{ "ftdi", no_argument, NULL, 'f' },
 	{ "help", no_argument, NULL, 'h' },
+	{ "min-chunks", required_argument, NULL, 'm' },
 	{ "pc", required_argument, NULL, 'p' },
 	{ "split", required_argument, NULL, 's' },
 	{ "store", required_argument, NULL, 'S' },
+	{ "threads", required_argument, NULL, 'j' },
 	{ "verbose", no_argument, NULL, 'v' },
 	{ "version", no_argument, NULL, 'V' },
 	{ "write", required_argument, NULL, 'w' },
@@ -81,9 +92,11 @@ static void usage( char *name )
 " --fixup|-x          try to fix time-glitches in retrieved data\n"
 " --ftdi|-f           use ftdi driver\n"
 " --help|-h           this cruft\n"
+" --min-chunks=<n>|-m skip split data with less chunks, default 5\n"
 " --pc=<type>|-p      power control version: 5, 6 or 7\n"
 " --split=<gap>|-s    split data on gaps of specified length\n"
 " --store=<dir>|-S    srmwin data directory\n"
+" --threads=<n>|-j    threads for saving split data, 0: one per CPU\n"
 " --verbose|-v        increase verbosity\n"
 " --version|-V        show version number and exit\n"
 " --write=<fname>|-w  save unsplit data as specified .wkt file\n"
@@ -96,6 +109,7 @@ srmio_io_t io;
 srmio_pc_t srm;
 srmio_store_t store;
 srmio_data_t data;
+srmio_fixup_t fixup = NULL;
 
 struct _srmio_pc_xfer_block_t block;
 size_t block_cnt=0, block_num = 0;
@@ -261,27 +275,69 @@ bool do_preview( void )
 	return true;
 }
 
-bool do_fixup( srmio_data_t *srmdata )
+/*
+ * pieces of split data are prepared and written on a thread pool. File
+ * names are picked and reported in order.
+ */
+struct save_job_t {
+	srmio_data_t	data;
+	srmio_time_t	start;
+	char		*fname;
+	bool		failed;
+	char		msg[SRMIO_ERROR_MSG_SIZE + 64];
+};
+
+static void save_fail( struct save_job_t *job, const char *what,
+	srmio_error_t *jerr )
 {
-	srmio_data_t fixed;
+	job->failed = true;
+	snprintf( job->msg, sizeof(job->msg), "%s failed: %s",
+		what, jerr->message );
+}
 
-	if( ! opt_fixup )
-		return true;
+static void save_prepare( void *arg, unsigned i )
+{
+	struct save_job_t *job = &((struct save_job_t *)arg)[i];
+	srmio_error_t jerr;
 
-	if( NULL == ( fixed = srmio_data_fixup( *srmdata, &err ) )){
-		fprintf( stderr, "srmio_data_fixup failed: %s\n",
-			err.message );
-		return false;
+	if( ! srmio_data_time_start( job->data, &job->start, &jerr)){
+		save_fail( job, "data_time_start", &jerr );
+		return;
 	}
+}
 
-	srmio_data_free( *srmdata );
-	*srmdata = fixed;
-	return true;
+static void save_write( void *arg, unsigned i )
+{
+	struct save_job_t *job = &((struct save_job_t *)arg)[i];
+	srmio_error_t jerr;
+
+	if( ! job->fname )
+		return;
+
+	if( ! srmio_store_write( store, job->data, job->fname, &jerr )){
+		save_fail( job, "store_add", &jerr );
+		return;
+	}
+}
+
+static void save_free( struct save_job_t *job, unsigned used )
+{
+	unsigned i;
+
+	for( i = 0; i < used; ++i ){
+		free( job[i].fname );
+		srmio_data_free( job[i].data );
+	}
 }
 
 bool save_data( void )
 {
-	srmio_data_t *list, *dat;
+	srmio_split_iter_t it;
+	srmio_pool_t pool;
+	struct save_job_t *job;
+	unsigned window, used = 0, stop, i;
+	bool more = true;
+	bool ret = false;
 
 	if( ! data->cused )
 		return true;
@@ -303,82 +359,143 @@ bool save_data( void )
 		fclose( fh );
 	}
 
-	if( NULL == ( list = srmio_data_split( data, opt_split, 500, &err))){
+	if( fixup ){
+		/* data was fixed piece by piece while downloading */
+		it = srmio_fixup_split_iter_new( fixup, opt_min, &err );
+
+	} else {
+		it = srmio_data_split_iter_new( data, opt_split, 500,
+			opt_min, &err );
+	}
+
+	if( NULL == it ){
+
 		fprintf( stderr, "split failed: %s\n",
 			err.message );
 		return false;
 	}
 
-	for( dat = list; *dat; ++dat ){
-		srmio_time_t start;
-		bool skip = false;
-
-		/* TODO: make min chunks per file configurable */
-		if( (*dat)->cused < 5 ){
-			srmio_data_free( *dat );
-			continue;
-		}
+	if( NULL == ( pool = srmio_pool_new( opt_threads, &err ))){
+		fprintf( stderr, "srmio_pool_new failed: %s\n",
+			err.message );
+		goto clean1;
+	}
 
-		if( ! do_fixup( dat ))
-			return false;
+	/* limit pieces in progress */
+	window = 2 * srmio_pool_threads( pool );
+	if( NULL == ( job = malloc( window * sizeof(struct save_job_t) ))){
+		fprintf( stderr, "malloc failed: %s\n", strerror(errno) );
+		goto clean2;
+	}
 
-		if( ! srmio_data_time_start( *dat, &start, &err)){
-			fprintf( stderr, "data_time_start failed: %s\n",
-				err.message );
-			return false;
-		}
+	while( more ){
+		for( used = 0; used < window; ++used ){
+			memset( &job[used], 0, sizeof(struct save_job_t) );
 
-		if( ! opt_dup ){
-			if( ! srmio_store_have( store, (*dat)->athlete,
-				start, opt_fuzz, &skip, &err ) ){
+			if( ! srmio_data_split_iter_next( it, &job[used].data,
+				&err )){
 
-				fprintf( stderr, "store_have failed: %s\n",
+				fprintf( stderr, "split failed: %s\n",
 					err.message );
-				return false;
+				goto clean3;
+			}
+
+			if( ! job[used].data ){
+				more = false;
+				break;
 			}
 		}
 
-		if( skip ){
-			if( opt_verbose ){
-				time_t t = 0.1 * start;
+		srmio_pool_run( pool, save_prepare, job, used );
+
+		/* pick file names in order, stop at first failure */
+		for( stop = 0; stop < used; ++stop ){
+			struct save_job_t *jp = &job[stop];
+			srmio_error_t jerr;
+			bool skip = false;
+
+			if( jp->failed )
+				break;
 
-				fprintf( stderr, "skip data - in store: %s",
-					ctime( &t ) );
+			if( ! opt_dup ){
+				if( ! srmio_store_have( store, jp->data->athlete,
+					jp->start, opt_fuzz, &skip, &jerr ) ){
+
+					save_fail( jp, "store_have", &jerr );
+					break;
+				}
 			}
 
-		} else {
-			char *fname = NULL;
+			if( skip ){
+				if( opt_verbose ){
+					time_t t = 0.1 * jp->start;
 
-			if( ! srmio_store_add( store, *dat, &fname, &err )){
-				fprintf( stderr, "store_add failed: %s\n",
-					err.message );
-				return false;
+					fprintf( stderr, "skip data - in store: %s",
+						ctime( &t ) );
+				}
+				continue;
 			}
 
-			printf( "%s\n", fname );
-			free( fname );
+			if( ! srmio_store_reserve( store, jp->data,
+				&jp->fname, &jerr )){
+
+				save_fail( jp, "store_add", &jerr );
+				break;
+			}
 		}
 
-		srmio_data_free( *dat );
+		srmio_pool_run( pool, save_write, job, stop );
+
+		for( i = 0; i < used; ++i ){
+			struct save_job_t *jp = &job[i];
+
+			if( i < stop && jp->failed )
+				stop = i;
+
+			if( i > stop && jp->fname )
+				remove( jp->fname );
+
+			if( i < stop && jp->fname )
+				printf( "%s\n", jp->fname );
+
+			if( i == stop )
+				fprintf( stderr, "%s\n", jp->msg );
+		}
+
+		if( stop < used )
+			goto clean3;
+
+		save_free( job, used );
 	}
 
-	free( list );
+	ret = true;
+	used = 0;
 
-	return true;
-}
+clean3:
+	save_free( job, used );
+	free( job );
+clean2:
+	srmio_pool_free( pool );
+clean1:
+	srmio_data_split_iter_free( it );
 
+	return ret;
+}
 
 
 int main( int argc, char **argv )
 {
 	int needhelp = 0;
 	char c;
+	unsigned long num;
 	size_t done_chunks = 0;
 	int mfirst = -1;
+	int plast;
 
-	struct _srmio_chunk_t chunk;
+	struct _srmio_chunk_t batch[XFER_BATCH];
+	unsigned bused = 0;
 
-	while( -1 != ( c = getopt_long( argc, argv, "ab:dfhp:S:s:Vvw:x", lopts, NULL ))){
+	while( -1 != ( c = getopt_long( argc, argv, "ab:dfhj:m:p:S:s:Vvw:x", lopts, NULL ))){
 		switch(c){
 		  case 'a':
 			++opt_all;
@@ -403,6 +520,24 @@ int main( int argc, char **argv )
 			++opt_help;
 			break;
 
+		  case 'j':
+			if( ! get_num( optarg, UINT_MAX, &num ) ){
+				fprintf( stderr, "invalid thread count: %s\n", optarg );
+				++needhelp;
+				break;
+			}
+			opt_threads = num;
+			break;
+
+		  case 'm':
+			if( ! get_num( optarg, UINT_MAX, &num ) ){
+				fprintf( stderr, "invalid chunk count: %s\n", optarg );
+				++needhelp;
+				break;
+			}
+			opt_min = num;
+			break;
+
 		  case 'p':
 			opt_pc = atoi(optarg);
 			break;
@@ -412,7 +547,12 @@ int main( int argc, char **argv )
 			break;
 
 		  case 's':
-			opt_split = atoi(optarg);
+			if( ! get_num( optarg, UINT_MAX, &num ) ){
+				fprintf( stderr, "invalid split gap: %s\n", optarg );
+				++needhelp;
+				break;
+			}
+			opt_split = num;
 			break;
 
 		  case 'V':
@@ -475,6 +615,15 @@ int main( int argc, char **argv )
 		return 1;
 	}
 
+	/* fix pieces while downloading, split where they end */
+	if( opt_fixup && NULL == ( fixup = srmio_fixup_new( data, opt_split,
+		500, &err ))){
+
+		fprintf( stderr, "srmio_fixup_new failed: %s\n",
+			err.message );
+		return 1;
+	}
+
 	if( ! do_open() )
 		return 1;
 
@@ -507,6 +656,7 @@ int main( int argc, char **argv )
 	while( srmio_pc_xfer_block_next( srm, &block ) ){
 		bool is_first, is_int;
 		size_t prog_total;
+		size_t block_chunks;
 
 		if( prog_sum ){
 			prog_total = prog_sum;
@@ -530,7 +680,20 @@ int main( int argc, char **argv )
 				data->athlete = strdup( block.athlete );
 			}
 
-			while( srmio_pc_xfer_chunk_next( srm, &chunk, &is_int, &is_first ) ){
+			if( srmio_pc_xfer_block_chunks( srm, &block_chunks )
+				&& block_chunks
+				&& block_chunks < UINT_MAX - data->cused
+				&& ! srmio_data_reserve( data, data->cused
+					+ block_chunks, 0, &err ) ){
+
+				fprintf( stderr, "reserve chunks failed: %s",
+					err.message );
+				return 1;
+			}
+
+			while( srmio_pc_xfer_chunk_next( srm, &batch[bused], &is_int,
+				&is_first ) ){
+
 				if( opt_verbose && 0 == done_chunks % 16 ){
 					size_t block_done = 0;
 
@@ -552,18 +715,34 @@ int main( int argc, char **argv )
 
 				}
 
-				if( ! srmio_data_add_chunk( data, &chunk, &err ) ){
+				/* fixup might insert chunks before this one */
+				plast = (int)(data->cused + bused) -1;
+
+				if( ! fixup ){
+					++bused;
+
+				} else if( ! srmio_fixup_add( fixup, &batch[bused],
+					&err ) ){
+
 					fprintf( stderr, "add chunk failed: %s",
 						err.message );
 					return 1;
 				}
-
 				++done_chunks;
 
 				/* finish previous marker */
 				if( mfirst >= 0 && ( ! is_int || is_first) ){
+					if( ! srmio_data_add_chunks( data, batch,
+						bused, &err ) ){
+
+						fprintf( stderr, "add chunk failed: %s",
+							err.message );
+						return 1;
+					}
+					bused = 0;
+
 					if( ! srmio_data_add_marker( data, mfirst,
-						data->cused -2, &err ) ){
+						plast, &err ) ){
 
 						fprintf( stderr, "failed to add marker: %s",
 							err.message );
@@ -573,14 +752,30 @@ int main( int argc, char **argv )
 
 				/* start marker */
 				if( is_first ){
-					mfirst = (int)data->cused -1;
+					mfirst = (int)(data->cused + bused) -1;
 
 				} else if( ! is_int ){
 					mfirst = -1;
 
 				}
 
+				if( bused < XFER_BATCH )
+					continue;
+
+				if( ! srmio_data_add_chunks( data, batch, bused, &err ) ){
+					fprintf( stderr, "add chunk failed: %s",
+						err.message );
+					return 1;
+				}
+				bused = 0;
+			}
+
+			if( ! srmio_data_add_chunks( data, batch, bused, &err ) ){
+				fprintf( stderr, "add chunk failed: %s",
+					err.message );
+				return 1;
 			}
+			bused = 0;
 
 			/* finalize marker at block end */
 			if( mfirst >= 0 ){
@@ -615,10 +810,17 @@ int main( int argc, char **argv )
 
 	srmio_pc_xfer_finish( srm, NULL );
 
+	if( fixup && ! srmio_fixup_finish( fixup, &err ) ){
+		fprintf( stderr, "srmio_fixup_finish failed: %s\n",
+			err.message );
+		return 1;
+	}
+
 	/* split data, save */
 	if( ! save_data() )
 		return 1;
 
+	srmio_fixup_free( fixup );
 	srmio_data_free( data );
 	srmio_pc_free( srm );
 	srmio_io_free( io );
@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "srmio.h"
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+
+#ifdef HAVE_GETOPT_H
+# include <getopt.h>
+#endif
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif
+
+/* one ride per day when filling a store */
+#define SYNTH_DAY	864000
+
+static srmio_data_t synth( srmio_synth_t conf, int fixup )
+{
+	srmio_data_t data;
+	srmio_error_t err;
+
+	if( NULL == (data = srmio_data_synth( conf, &err ))){
+		fprintf( stderr, "srmio_data_synth failed: %s\n",
+			err.message );
+		return NULL;
+	}
+
+	if( fixup ){
+		srmio_data_t fixed;
+
+		if( NULL == (fixed = srmio_data_fixup( data, &err ))){
+			fprintf( stderr, "srmio_data_fixup failed: %s\n",
+				err.message );
+			srmio_data_free( data );
+			return NULL;
+		}
+
+		srmio_data_free( data );
+		data = fixed;
+	}
+
+	return data;
+}
+
+static bool write_file( srmio_synth_t conf, int fixup, const char *fname,
+	srmio_ftype_t ftype )
+{
+	srmio_data_t data;
+	srmio_error_t err;
+	FILE *fh = stdout;
+	bool ret = false;
+
+	if( NULL == (data = synth( conf, fixup )))
+		return false;
+
+	if( fname && 0 != strcmp( fname, "-" )
+		&& NULL == (fh = fopen( fname, "wb" ))){
+
+		fprintf( stderr, "fopen(%s) failed: %s\n", fname,
+			strerror(errno) );
+		goto clean1;
+	}
+
+	if( ! srmio_file_ftype_write( data, ftype, fh, &err ) ){
+		fprintf( stderr, "srmio_file_ftype_write failed: %s\n",
+			err.message );
+		goto clean2;
+	}
+
+	ret = true;
+
+clean2:
+	if( fh != stdout ){
+		if( 0 != fclose( fh ) ){
+			fprintf( stderr, "fclose(%s) failed: %s\n", fname,
+				strerror(errno) );
+			ret = false;
+		}
+	}
+clean1:
+	srmio_data_free( data );
+	return ret;
+}
+
+static bool fill_store( srmio_synth_t conf, int fixup, const char *path,
+	unsigned count )
+{
+	srmio_store_t store;
+	srmio_error_t err;
+	bool ret = false;
+	unsigned i;
+
+	if( NULL == (store = srmio_store_new( path, &err ))){
+		fprintf( stderr, "srmio_store_new failed: %s\n", err.message );
+		return false;
+	}
+
+	for( i = 0; i < count; ++i ){
+		srmio_data_t data;
+		char *fname;
+		bool ok;
+
+		if( NULL == (data = synth( conf, fixup )))
+			goto clean1;
+
+		ok = srmio_store_add( store, data, &fname, &err );
+		srmio_data_free( data );
+		if( ! ok ){
+			fprintf( stderr, "srmio_store_add failed: %s\n",
+				err.message );
+			goto clean1;
+		}
+
+		printf( "%s\n", fname );
+		free( fname );
+
+		/* vary rides */
+		conf->start += SYNTH_DAY;
+		if( ! ++conf->seed )
+			++conf->seed;
+	}
+
+	ret = true;
+
+clean1:
+	srmio_store_free( store );
+	return ret;
+}
+
+static void usage( char *name );
+
+int main( int argc, char **argv )
+{
+	struct _srmio_synth_t conf;
+	unsigned opt_count = 1;
+	int opt_fixup = 0;
+	int opt_help = 0;
+	char *opt_store = NULL;
+	int opt_version = 0;
+	srmio_ftype_t opt_wtype = srmio_ftype_srm7;
+	int needhelp = 0;
+	struct option lopts[] = {
+		{ "athlete", required_argument, NULL, 'a' },
+		{ "count", required_argument, NULL, 'c' },
+		{ "duration", required_argument, NULL, 'd' },
+		{ "fixup", no_argument, NULL, 'x' },
+		{ "gaps", required_argument, NULL, 'g' },
+		{ "gap-max", required_argument, NULL, 'G' },
+		{ "help", no_argument, NULL, 'h' },
+		{ "int", required_argument, NULL, 'i' },
+		{ "marker", required_argument, NULL, 'm' },
+		{ "overlaps", required_argument, NULL, 'o' },
+		{ "pc", required_argument, NULL, 'p' },
+		{ "seed", required_argument, NULL, 's' },
+		{ "start", required_argument, NULL, 'S' },
+		{ "store", required_argument, NULL, 'D' },
+		{ "version", no_argument, NULL, 'V' },
+		{ "write-type", required_argument, NULL, 'W' },
+		{ NULL, 0, NULL, 0 },
+	};
+	char *fname = NULL;
+	char c;
+
+	srmio_synth_init( &conf );
+
+	while( -1 != ( c = getopt_long( argc, argv, "a:c:d:D:g:G:hi:m:o:p:s:S:VW:x", lopts, NULL ))){
+		switch(c){
+		  case 'a':
+			conf.athlete = optarg;
+			break;
+
+		  case 'c':
+			opt_count = atoi(optarg);
+			break;
+
+		  case 'd':
+			conf.duration = (srmio_time_t)atol(optarg) * 10;
+			break;
+
+		  case 'D':
+			opt_store = optarg;
+			break;
+
+		  case 'g':
+			conf.gaps = atoi(optarg);
+			break;
+
+		  case 'G':
+			conf.gap_max = atol(optarg);
+			break;
+
+		  case 'h':
+			++opt_help;
+			break;
+
+		  case 'i':
+			conf.recint = atoi(optarg);
+			break;
+
+		  case 'm':
+			conf.marker = atoi(optarg);
+			break;
+
+		  case 'o':
+			conf.overlaps = atoi(optarg);
+			break;
+
+		  case 'p':
+			switch( atoi(optarg) ){
+			  case 5:
+			  case 6:
+				conf.pc = srmio_synth_pc5;
+				break;
+
+			  case 7:
+				conf.pc = srmio_synth_pc7;
+				break;
+
+			  default:
+				fprintf( stderr, "invalid pc type: %s\n", optarg );
+				++needhelp;
+			}
+			break;
+
+		  case 's':
+			conf.seed = strtoul( optarg, NULL, 10 );
+			break;
+
+		  case 'S':
+			conf.start = (srmio_time_t)atol(optarg) * 10;
+			break;
+
+		  case 'V':
+			++opt_version;
+			break;
+
+		  case 'W':
+			if( srmio_ftype_unknown == (
+				opt_wtype = srmio_ftype_from_string( optarg)) ){
+
+				fprintf( stderr, "unrecognized filetype: %s\n", optarg );
+				++needhelp;
+			}
+			break;
+
+		  case 'x':
+			++opt_fixup;
+			break;
+
+		  default:
+			++needhelp;
+		}
+	}
+
+	if( opt_help ){
+		usage( argv[0] );
+		exit( 0 );
+	}
+
+	if( opt_version ){
+		printf( "srmsynth %s commit %s\n", PACKAGE_VERSION,
+			srmio_commit );
+		return 0;
+	}
+
+	if( optind < argc )
+		fname = argv[optind];
+
+	if( opt_store && fname ){
+		fprintf( stderr, "destination file and store are exclusive\n" );
+		++needhelp;
+	}
+
+	if( ! opt_store && opt_count != 1 ){
+		fprintf( stderr, "multiple rides need a store\n" );
+		++needhelp;
+	}
+
+	if( needhelp ){
+		fprintf( stderr, "use %s --help for usage info\n", argv[0] );
+		exit(1);
+	}
+
+	if( opt_store ){
+		if( ! fill_store( &conf, opt_fixup, opt_store, opt_count ))
+			return 1;
+
+	} else {
+		if( ! write_file( &conf, opt_fixup, fname, opt_wtype ))
+			return 1;
+	}
+
+	return 0;
+}
+
+static void usage( char *name )
+{
+	printf(
+"usage: %s [options] [<fname>]\n"
+"generates rides with random data\n"
+"\n"
+"options:\n"
+" --athlete=<name>|-a  athlete name\n"
+" --count=<n>|-c       number of rides to add to store\n"
+" --duration=<sec>|-d  length of ride without gaps in seconds\n"
+" --fixup|-x           fix overlaps and small gaps before writing\n"
+" --gaps=<n>|-g        gaps per 10000 chunks\n"
+" --gap-max=<time>|-G  longest gap, 10 -> 1sec\n"
+" --help|-h            this cruft\n"
+" --int=<interval>|-i  recording interval, 10 -> 1sec\n"
+" --marker=<n>|-m      average chunks per marker, 0 for none\n"
+" --overlaps=<n>|-o    overlaps per 10000 chunks\n"
+" --pc=<type>|-p       value ranges of power control version: 5, 6 or 7\n"
+" --seed=<n>|-s        seed for random numbers\n"
+" --start=<time>|-S    start of (first) ride (seconds since 1970)\n"
+" --store=<path>|-D    add rides to store, one per day\n"
+" --version|-V         show version number and exit\n"
+" --write-type=<t>|-W  write data as specified file format\n"
+, name );
+}
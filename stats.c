@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "common.h"
+
+/*
+ * running totals over a data set's chunks.
+ *
+ * Once enabled, they're updated for each chunk added to the data set.
+ * When chunks are modified in place (see srmio_data_changed()) they're
+ * recalculated on next access.
+ */
+
+struct _srmio_sums_t {
+	bool		valid;
+
+	unsigned	chunks;
+	srmio_time_t	dur;
+	double		work;	/* W * 1/10 sec */
+	double		dist;	/* km/h * 1/10 sec */
+	unsigned	pwr_max;
+
+	double		hr;	/* 1/min * 1/10 sec */
+	srmio_time_t	hr_dur;
+	unsigned	hr_max;
+
+	double		cad;	/* 1/min * 1/10 sec */
+	srmio_time_t	cad_dur;
+	unsigned	cad_max;
+};
+
+/*
+ * release totals
+ */
+void srmio_sums_free( srmio_sums_t sums )
+{
+	free( sums );
+}
+
+/*
+ * totals have to be recalculated
+ */
+void srmio_sums_invalidate( srmio_sums_t sums )
+{
+	if( ! sums )
+		return;
+
+	sums->valid = false;
+}
+
+/*
+ * add chunk to totals
+ */
+static void _srmio_sums_add( srmio_sums_t sums, srmio_chunk_t chunk )
+{
+	++sums->chunks;
+	sums->dur += chunk->dur;
+	sums->work += (double)chunk->pwr * chunk->dur;
+	sums->dist += chunk->speed * chunk->dur;
+
+	if( chunk->pwr > sums->pwr_max )
+		sums->pwr_max = chunk->pwr;
+
+	if( chunk->hr ){
+		sums->hr += (double)chunk->hr * chunk->dur;
+		sums->hr_dur += chunk->dur;
+
+		if( chunk->hr > sums->hr_max )
+			sums->hr_max = chunk->hr;
+	}
+
+	if( chunk->cad ){
+		sums->cad += (double)chunk->cad * chunk->dur;
+		sums->cad_dur += chunk->dur;
+
+		if( chunk->cad > sums->cad_max )
+			sums->cad_max = chunk->cad;
+	}
+}
+
+/*
+ * recalculate totals from all chunks
+ */
+static void _srmio_sums_build( srmio_data_t data, srmio_sums_t sums )
+{
+	unsigned i;
+
+	memset( sums, 0, sizeof(struct _srmio_sums_t) );
+
+	for( i = 0; i < data->cused; ++i ){
+		struct _srmio_chunk_t chunk;
+
+		srmio_data_chunk_get( data, i, &chunk );
+		_srmio_sums_add( sums, &chunk );
+	}
+
+	sums->valid = true;
+}
+
+/*
+ * update totals for chunk that was appended to data->chunks
+ */
+void srmio_sums_added( srmio_data_t data, srmio_chunk_t chunk )
+{
+	srmio_sums_t sums = data->sums;
+
+	if( ! sums || ! sums->valid )
+		return;
+
+	_srmio_sums_add( sums, chunk );
+}
+
+/*
+ * start maintaining totals for data. This makes srmio_data_stats()
+ * cheap at the cost of some work for each added chunk. Data sets
+ * derived from data by srmio_data_header() - like the results of
+ * srmio_data_fixup() or srmio_data_split() - inherit this.
+ *
+ * returns false on error
+ */
+bool srmio_data_stats_enable( srmio_data_t data, srmio_error_t *err )
+{
+	assert( data );
+
+	if( data->sums )
+		return true;
+
+	if( NULL == (data->sums = malloc( sizeof(struct _srmio_sums_t) ))){
+		srmio_error_errno( err, "data stats" );
+		return false;
+	}
+
+	_srmio_sums_build( data, data->sums );
+	return true;
+}
+
+/*
+ * stop maintaining totals
+ */
+void srmio_data_stats_disable( srmio_data_t data )
+{
+	assert( data );
+
+	srmio_sums_free( data->sums );
+	data->sums = NULL;
+}
+
+/*
+ * check if totals are maintained for data
+ */
+bool srmio_data_stats_enabled( srmio_data_t data )
+{
+	assert( data );
+
+	return data->sums != NULL;
+}
+
+/*
+ * get summary of data's chunks. Averages are weighted by chunk
+ * duration. Chunks without hr/cad are ignored for their averages.
+ *
+ * Without srmio_data_stats_enable() this has to look at all chunks.
+ *
+ * returns false on error
+ */
+bool srmio_data_stats( srmio_data_t data, srmio_stats_t stats,
+	srmio_error_t *err )
+{
+	struct _srmio_sums_t tmp;
+	srmio_sums_t sums = data->sums;
+
+	assert( data );
+	assert( stats );
+
+	if( ! data->cused ){
+		srmio_error_set( err, "no data available" );
+		return false;
+	}
+
+	if( ! sums ){
+		sums = &tmp;
+		_srmio_sums_build( data, sums );
+
+	} else if( ! sums->valid ){
+		_srmio_sums_build( data, sums );
+	}
+
+	memset( stats, 0, sizeof(struct _srmio_stats_t) );
+
+	stats->chunks = sums->chunks;
+	stats->dur = sums->dur;
+	stats->work = sums->work / 10;
+	stats->dist = sums->dist / 36;
+	stats->pwr_max = sums->pwr_max;
+	stats->hr_max = sums->hr_max;
+	stats->cad_max = sums->cad_max;
+
+	if( sums->dur )
+		stats->pwr_avg = sums->work / sums->dur;
+
+	if( sums->hr_dur )
+		stats->hr_avg = sums->hr / sums->hr_dur;
+
+	if( sums->cad_dur )
+		stats->cad_avg = sums->cad / sums->cad_dur;
+
+	return true;
+}
+
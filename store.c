@@ -312,8 +312,8 @@ static bool _scan_file( store_athlete_t athlete,
 {
 	char path[PATH_MAX];
 	FILE *fh;
-	srmio_data_t data;
-	srmio_time_t start, end;
+	struct stat st;
+	struct _srmio_file_srm_info_t info;
 
 	assert( athlete );
 	assert( dir );
@@ -331,32 +331,39 @@ static bool _scan_file( store_athlete_t athlete,
 		return false;
 	}
 
-	if( NULL == (data = srmio_file_srm_read( fh, err )))
+	if( 0 != fstat( fileno( fh ), &st )){
+		srmio_error_errno( err, "stat %s", path );
 		goto clean1;
+	}
 
-	if( ! srmio_data_time_start( data, &start, err ))
-		goto clean2;
-	if( ! srmio_data_time_end( data, &end, err ))
-		goto clean2;
+	/* reserved by srmio_store_reserve(), but never written */
+	if( ! st.st_size ){
+		DPRINTF( "skipping empty %s", path );
+		fclose( fh );
+		return true;
+	}
 
-	if( ! _find_file( athlete, start, 0 )){
+	/* only start + end are needed, skip the chunks */
+	if( ! srmio_file_srm_probe( fh, &info, err ))
+		goto clean1;
+
+	if( ! _find_file( athlete, info.start, 0 )){
 		store_file_t file;
 
-		if( NULL == (file = _store_file_new(fname, start, end ))){
+		if( NULL == (file = _store_file_new(fname, info.start,
+			info.end ))){
+
 			srmio_error_errno( err, "store file new" );
-			goto clean2;
+			goto clean1;
 		}
 
 		list_file_add( athlete->file, file );
 		//DPRINTF( "added file %s", path );
 	}
 
-	srmio_data_free( data );
 	fclose(fh);
 	return true;
 
-clean2:
-	srmio_data_free( data );
 clean1:
 	fclose( fh );
 	return false;
@@ -611,7 +618,15 @@ static store_athlete_t _athlete_add( srmio_store_t store, const char *nick, srmi
 	return athlete;
 }
 
-bool srmio_store_add( srmio_store_t store, srmio_data_t data,
+/*
+ * pick an unused file name for data within the store and create an
+ * empty file with it, so following calls get different names. Data is
+ * written to it with srmio_store_write(). Until then, scans of the
+ * store ignore the file.
+ *
+ * returns false on error
+ */
+bool srmio_store_reserve( srmio_store_t store, srmio_data_t data,
 	char **rfname, srmio_error_t *err )
 {
 	srmio_time_t start;
@@ -621,6 +636,7 @@ bool srmio_store_add( srmio_store_t store, srmio_data_t data,
 
 	assert( store );
 	assert( data );
+	assert( rfname );
 
 	if( ! srmio_data_time_start( data, &start, err ) )
 		return false;
@@ -637,24 +653,89 @@ bool srmio_store_add( srmio_store_t store, srmio_data_t data,
 
 	if( NULL == (fh = fopen( fname, "wb"))){
 		srmio_error_errno( err, "fopen(%s)", fname );
+		free( fname );
+		return false;
+	}
+	fclose( fh );
+
+	*rfname = fname;
+	return true;
+}
+
+/*
+ * write data to a file name from srmio_store_reserve(). The store
+ * isn't modified, several files can be written in parallel. Data is
+ * written to a temporary file that is renamed to fname when complete,
+ * so fname is either empty or complete. Empty files are skipped when
+ * scanning the store. The file is removed on failure.
+ *
+ * returns false on error
+ */
+bool srmio_store_write( srmio_store_t store, srmio_data_t data,
+	const char *fname, srmio_error_t *err )
+{
+	char tmp[PATH_MAX];
+	FILE *fh;
+
+	assert( store );
+	assert( data );
+	assert( fname );
+
+	if( PATH_MAX <= snprintf( tmp, PATH_MAX, "%s.tmp", fname ) ){
+		srmio_error_errno( err, "path too long" );
 		goto clean1;
 	}
 
-	if( ! srmio_file_srm7_write( data, fh, err ))
+	if( NULL == (fh = fopen( tmp, "wb"))){
+		srmio_error_errno( err, "fopen(%s)", tmp );
+		goto clean1;
+	}
+
+	if( ! srmio_file_srm7_write( data, fh, err )){
+		fclose( fh );
 		goto clean2;
+	}
+
+	if( 0 != fclose( fh ) ){
+		srmio_error_errno( err, "write %s", tmp );
+		goto clean2;
+	}
+
+	if( 0 != rename( tmp, fname ) ){
+		srmio_error_errno( err, "rename %s", tmp );
+		goto clean2;
+	}
+
+	return true;
+
+clean2:
+	unlink( tmp );
+clean1:
+	unlink( fname );
+	return false;
+}
+
+bool srmio_store_add( srmio_store_t store, srmio_data_t data,
+	char **rfname, srmio_error_t *err )
+{
+	char *fname;
+
+	assert( store );
+	assert( data );
+
+	if( ! srmio_store_reserve( store, data, &fname, err ))
+		return false;
+
+	if( ! srmio_store_write( store, data, fname, err ))
+		goto clean1;
 
-	fclose( fh );
 	if( rfname )
 		*rfname = fname;
 	else
 		free( fname );
 	return true;
 
-clean2:
-	fclose( fh );
 clean1:
 	free(fname);
 	return false;
 }
-
-
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "common.h"
+
+/*
+ * generate rides for testing and benchmarking.
+ *
+ * Values follow a random walk within the ranges a PowerControl can
+ * record. A fixed seed gives the same data on all platforms.
+ */
+
+/* chunks collected before they're added to data */
+#define SYNTH_BATCH	256
+
+struct _srmio_synth_range_t {
+	unsigned	pwr_max;
+	double		speed_max;
+	double		speed_step;	/* resolution */
+	long		ele_min;
+	long		ele_max;
+};
+
+static const struct _srmio_synth_range_t _srmio_synth_range[] = {
+	/* srmio_synth_pc5: 12bit power, no elevation */
+	{ 4095, 230, 0.2, 0, 0 },
+	/* srmio_synth_pc7 */
+	{ 2500, 120, 0.1, -500, 8000 },
+};
+
+/* xorshift - same sequence everywhere */
+static uint32_t _srmio_synth_rnd( uint32_t *state )
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* random number in [0, n) */
+static unsigned _srmio_synth_upto( uint32_t *state, unsigned n )
+{
+	return n ? _srmio_synth_rnd( state ) % n : 0;
+}
+
+/*
+ * length of a gap: log-uniform between recint and gap_max, so there
+ * are many short and few long ones.
+ */
+static srmio_time_t _srmio_synth_gap( uint32_t *state,
+	srmio_time_t recint, srmio_time_t gap_max )
+{
+	srmio_time_t len = recint;
+	unsigned steps = 0;
+	unsigned s;
+
+	while( (len << steps) < gap_max && steps < 30 )
+		++steps;
+
+	s = _srmio_synth_upto( state, steps +1 );
+	len = (len << s) + _srmio_synth_upto( state, len << s );
+
+	return len > gap_max ? gap_max : len;
+}
+
+/*
+ * set defaults: one hour at 1sec recint from a PC7, starting
+ * 2010-01-01, with some gaps, overlaps and marker.
+ */
+void srmio_synth_init( srmio_synth_t conf )
+{
+	assert( conf );
+
+	memset( conf, 0, sizeof(struct _srmio_synth_t) );
+	conf->start = (srmio_time_t)12623040000ULL;
+	conf->duration = 36000;
+	conf->recint = 10;
+	conf->gaps = 10;
+	conf->gap_max = 72000;
+	conf->overlaps = 10;
+	conf->marker = 600;
+	conf->pc = srmio_synth_pc7;
+	conf->seed = 4711;
+	conf->athlete = "synth";
+}
+
+/*
+ * generate ride as configured. "gaps" and "overlaps" are the number of
+ * gaps/overlaps per 10000 chunks. Marker are placed every "marker"
+ * chunks on average.
+ *
+ * returns pointer to newly allocated srmio_data
+ * returns NULL on failure
+ */
+srmio_data_t srmio_data_synth( srmio_synth_t conf, srmio_error_t *err )
+{
+	const struct _srmio_synth_range_t *range;
+	struct _srmio_chunk_t batch[SYNTH_BATCH];
+	struct _srmio_chunk_t chunk;
+	unsigned bused = 0;
+	srmio_data_t data;
+	uint32_t state;
+	unsigned chunks, mfirst = 0, mnext, i;
+	double pwr, speed, hr;
+
+	assert( conf );
+
+	if( conf->pc != srmio_synth_pc5 && conf->pc != srmio_synth_pc7 ){
+		srmio_error_set( err, "invalid pc type" );
+		return NULL;
+	}
+	range = &_srmio_synth_range[conf->pc];
+
+	if( ! conf->recint ){
+		srmio_error_set( err, "invalid recint" );
+		return NULL;
+	}
+
+	if( 0 == (chunks = conf->duration / conf->recint )){
+		srmio_error_set( err, "duration is shorter than recint" );
+		return NULL;
+	}
+
+	if( ! conf->seed ){
+		srmio_error_set( err, "seed must not be 0" );
+		return NULL;
+	}
+	state = conf->seed;
+
+	if( NULL == (data = srmio_data_new( err )))
+		return NULL;
+
+	if( conf->athlete && NULL == (data->athlete = strdup( conf->athlete ))){
+		srmio_error_errno( err, "synth athlete" );
+		goto clean1;
+	}
+
+	data->slope = 17.4;
+	data->zeropos = 500;
+	data->circum = 2096;
+
+	if( ! srmio_data_reserve( data, chunks, 0, err ))
+		goto clean1;
+
+	memset( &chunk, 0, sizeof(chunk) );
+	chunk.time = conf->start;
+	chunk.dur = conf->recint;
+	chunk.ele = range->ele_max ? 300 : 0;
+	pwr = 200;
+	speed = 30;
+	hr = 110;
+	mnext = 1 + _srmio_synth_upto( &state, 2 * conf->marker );
+
+	for( i = 0; i < chunks; ++i ){
+		unsigned r = _srmio_synth_upto( &state, 10000 );
+
+		if( i && r < conf->gaps )
+			chunk.time += _srmio_synth_gap( &state, conf->recint,
+				conf->gap_max );
+		else if( i && r < conf->gaps + conf->overlaps )
+			chunk.time -= 1 + _srmio_synth_upto( &state,
+				conf->recint );
+
+		pwr += (int)_srmio_synth_upto( &state, 41 ) - 20;
+		if( pwr < 0 )
+			pwr = 0;
+		if( pwr > range->pwr_max )
+			pwr = range->pwr_max;
+
+		speed += ( pwr / 8 - speed ) / 20
+			+ ((int)_srmio_synth_upto( &state, 11 ) - 5) / 10.0;
+		if( speed < 0 )
+			speed = 0;
+		if( speed > range->speed_max )
+			speed = range->speed_max;
+
+		chunk.pwr = pwr;
+		chunk.speed = range->speed_step
+			* (unsigned)( speed / range->speed_step );
+		chunk.cad = pwr < 20 ? 0 : 60 + _srmio_synth_upto( &state, 50 );
+		/* heartrate follows power with some delay */
+		hr += ( 90 + pwr / 4 - hr ) / 30;
+		if( hr > 220 )
+			hr = 220;
+		chunk.hr = hr;
+
+		if( range->ele_max ){
+			chunk.ele += (int)_srmio_synth_upto( &state, 3 ) -1;
+			if( chunk.ele < range->ele_min )
+				chunk.ele = range->ele_min;
+			if( chunk.ele > range->ele_max )
+				chunk.ele = range->ele_max;
+		}
+
+		/* warms up by 1 degree per hour */
+		chunk.temp = 15 + ( i * conf->recint / 36000 ) % 10;
+
+		batch[bused++] = chunk;
+		if( bused >= SYNTH_BATCH ){
+			if( ! srmio_data_add_chunks( data, batch, bused, err ))
+				goto clean1;
+			bused = 0;
+		}
+
+		chunk.time += chunk.dur;
+
+		if( conf->marker && i +1 >= mnext ){
+			if( ! srmio_data_add_chunks( data, batch, bused, err ))
+				goto clean1;
+			bused = 0;
+
+			if( ! srmio_data_add_marker( data, mfirst, i, err ))
+				goto clean1;
+
+			mfirst = i +1;
+			mnext = i +1 + 1 + _srmio_synth_upto( &state,
+				2 * conf->marker );
+		}
+	}
+
+	if( ! srmio_data_add_chunks( data, batch, bused, err ))
+		goto clean1;
+
+	return data;
+
+clean1:
+	srmio_data_free( data );
+	return NULL;
+}
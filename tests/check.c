@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "check.h"
+
+static unsigned failed = 0;
+
+/*
+ * count and report failed checks, returns ok
+ */
+bool check( bool ok, const char *what, const char *file, unsigned line )
+{
+	if( ok )
+		return true;
+
+	fprintf( stderr, "%s:%u: check failed: %s\n", file, line, what );
+	++failed;
+	return false;
+}
+
+/*
+ * exit code for the test program
+ */
+int check_result( void )
+{
+	if( ! failed )
+		return 0;
+
+	fprintf( stderr, "%u checks failed\n", failed );
+	return 1;
+}
+
+/*
+ * generate a ride with marker. With glitches it has overlaps and small
+ * gaps for fixup to work on.
+ *
+ * returns NULL on error
+ */
+srmio_data_t check_synth( unsigned seed, bool glitches, srmio_error_t *err )
+{
+	struct _srmio_synth_t conf;
+
+	srmio_synth_init( &conf );
+	conf.seed = seed;
+	conf.marker = 300;
+
+	if( glitches ){
+		conf.gaps = 50;
+		conf.gap_max = 50;
+		conf.overlaps = 30;
+
+	} else {
+		conf.gaps = 0;
+		conf.overlaps = 0;
+	}
+
+	return srmio_data_synth( &conf, err );
+}
+
+/*
+ * new data set sharing src's chunks with a copy of its marker
+ *
+ * returns NULL on error
+ */
+srmio_data_t check_copy( srmio_data_t src, srmio_error_t *err )
+{
+	srmio_data_t dst;
+	unsigned m;
+
+	if( NULL == (dst = srmio_data_header( src, err )))
+		return NULL;
+
+	if( ! srmio_data_add_chunkrefs( dst, src, 0, src->cused, err ))
+		goto clean1;
+
+	srmio_data_marker_sync( src );
+	for( m = 0; m < src->mused; ++m ){
+		if( ! srmio_data_add_marker( dst, src->marker[m]->first,
+			src->marker[m]->last, err ))
+
+			goto clean1;
+	}
+
+	return dst;
+
+clean1:
+	srmio_data_free( dst );
+	return NULL;
+}
+
+bool check_chunk_same( srmio_chunk_t a, srmio_chunk_t b )
+{
+	return a->time == b->time
+		&& a->dur == b->dur
+		&& a->temp == b->temp
+		&& a->pwr == b->pwr
+		&& a->speed == b->speed
+		&& a->cad == b->cad
+		&& a->hr == b->hr
+		&& a->ele == b->ele;
+}
+
+/*
+ * compare all chunk values, reports the first difference
+ */
+bool check_chunks_same( srmio_data_t a, srmio_data_t b )
+{
+	unsigned i;
+
+	if( a->cused != b->cused ){
+		fprintf( stderr, "chunk count differs: %u, %u\n",
+			a->cused, b->cused );
+		return false;
+	}
+
+	for( i = 0; i < a->cused; ++i ){
+		struct _srmio_chunk_t x, y;
+
+		srmio_data_chunk_get( a, i, &x );
+		srmio_data_chunk_get( b, i, &y );
+
+		if( ! check_chunk_same( &x, &y ) ){
+			fprintf( stderr, "chunk %u differs: "
+				"time=%.1f/%.1f pwr=%u/%u\n",
+				i,
+				(double)x.time / 10,
+				(double)y.time / 10,
+				x.pwr,
+				y.pwr );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * compare marker ranges, reports the first difference
+ */
+bool check_marker_same( srmio_data_t a, srmio_data_t b )
+{
+	unsigned m;
+
+	srmio_data_marker_sync( a );
+	srmio_data_marker_sync( b );
+
+	if( a->mused != b->mused ){
+		fprintf( stderr, "marker count differs: %u, %u\n",
+			a->mused, b->mused );
+		return false;
+	}
+
+	for( m = 0; m < a->mused; ++m ){
+		srmio_marker_t x = a->marker[m];
+		srmio_marker_t y = b->marker[m];
+
+		if( x->first != y->first || x->last != y->last ){
+			fprintf( stderr, "marker %u differs: %u-%u, %u-%u\n",
+				m, x->first, x->last, y->first, y->last );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * compare file contents from the start
+ */
+bool check_file_same( FILE *a, FILE *b )
+{
+	int x, y;
+
+	rewind( a );
+	rewind( b );
+	do {
+		x = getc( a );
+		y = getc( b );
+	} while( x == y && x != EOF );
+
+	return x == y;
+}
+
+/*
+ * copy first len bytes of fh to a temporary file, reports errors
+ */
+FILE *check_truncated( FILE *fh, long len )
+{
+	FILE *out;
+	long i;
+	int c;
+
+	if( NULL == (out = tmpfile())){
+		perror( "tmpfile" );
+		return NULL;
+	}
+
+	rewind( fh );
+	for( i = 0; i < len && EOF != (c = getc( fh )); ++i )
+		putc( c, out );
+
+	rewind( out );
+	return out;
+}
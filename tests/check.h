@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#ifndef _CHECK_H
+#define _CHECK_H
+
+#include "srmio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * helpers shared by the regression tests run with "make check". Each
+ * test is a program returning non-zero when a check failed.
+ */
+
+/* report failed condition, evaluates to cond */
+#define CHECK( cond )	check( (cond), #cond, __FILE__, __LINE__ )
+
+bool check( bool ok, const char *what, const char *file, unsigned line );
+int check_result( void );
+
+srmio_data_t check_synth( unsigned seed, bool glitches, srmio_error_t *err );
+srmio_data_t check_copy( srmio_data_t src, srmio_error_t *err );
+
+bool check_chunk_same( srmio_chunk_t a, srmio_chunk_t b );
+bool check_chunks_same( srmio_data_t a, srmio_data_t b );
+bool check_marker_same( srmio_data_t a, srmio_data_t b );
+bool check_file_same( FILE *a, FILE *b );
+FILE *check_truncated( FILE *fh, long len );
+
+#endif
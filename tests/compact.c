@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "check.h"
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/*
+ * compact and lazily read data must give the same chunks as the full
+ * representation - through all library functions. Lazy reads must
+ * match full ones for mapped files and for streams that can't be
+ * mapped.
+ */
+
+static FILE *write_srm7( srmio_data_t data )
+{
+	srmio_error_t err;
+	FILE *fh;
+
+	if( NULL == (fh = tmpfile()))
+		return NULL;
+
+	if( ! srmio_file_srm7_write( data, fh, &err )){
+		fprintf( stderr, "write: %s\n", err.message );
+		fclose( fh );
+		return NULL;
+	}
+
+	rewind( fh );
+	return fh;
+}
+
+/*
+ * read fh lazily through a pipe, fed by a child process
+ */
+static srmio_data_t lazy_pipe( FILE *fh )
+{
+	srmio_error_t err;
+	srmio_data_t data;
+	FILE *in, *out;
+	int fd[2];
+	pid_t pid;
+	int c;
+
+	if( 0 > pipe( fd )){
+		perror( "pipe" );
+		return NULL;
+	}
+
+	if( 0 > (pid = fork())){
+		perror( "fork" );
+		close( fd[0] );
+		close( fd[1] );
+		return NULL;
+	}
+
+	if( ! pid ){
+		close( fd[0] );
+		if( NULL == (out = fdopen( fd[1], "w" )))
+			_exit( 1 );
+
+		rewind( fh );
+		while( EOF != (c = getc( fh )))
+			putc( c, out );
+
+		_exit( fclose( out ) ? 1 : 0 );
+	}
+
+	close( fd[1] );
+	if( NULL == (in = fdopen( fd[0], "r" ))){
+		perror( "fdopen" );
+		close( fd[0] );
+		waitpid( pid, NULL, 0 );
+		return NULL;
+	}
+
+	if( NULL == (data = srmio_file_srm_read_lazy( in, &err )))
+		fprintf( stderr, "lazy pipe: %s\n", err.message );
+
+	fclose( in );
+	waitpid( pid, NULL, 0 );
+	return data;
+}
+
+/*
+ * lazy reads of the first len bytes of fh from a file and a pipe must
+ * match a full read
+ */
+static bool lazy_same( FILE *fh, long len )
+{
+	srmio_error_t err;
+	srmio_data_t full, lazy;
+	bool ok = false;
+	FILE *part;
+
+	if( NULL == (part = check_truncated( fh, len )))
+		return false;
+
+	if( NULL == (full = srmio_file_srm_read( part, &err ))){
+		fprintf( stderr, "read: %s\n", err.message );
+		goto clean1;
+	}
+
+	rewind( part );
+	if( NULL == (lazy = srmio_file_srm_read_lazy( part, &err ))){
+		fprintf( stderr, "lazy: %s\n", err.message );
+		goto clean2;
+	}
+
+	ok = srmio_data_is_compact( lazy )
+		&& check_chunks_same( full, lazy )
+		&& check_marker_same( full, lazy );
+	srmio_data_free( lazy );
+
+	if( ! ok || NULL == (lazy = lazy_pipe( part ))){
+		ok = false;
+		goto clean2;
+	}
+
+	ok = srmio_data_is_compact( lazy )
+		&& check_chunks_same( full, lazy )
+		&& check_marker_same( full, lazy );
+	srmio_data_free( lazy );
+
+clean2:
+	srmio_data_free( full );
+clean1:
+	fclose( part );
+	return ok;
+}
+
+static bool fixup_same( srmio_data_t a, srmio_data_t b )
+{
+	srmio_error_t err;
+	srmio_data_t fa, fb;
+	bool ok = false;
+
+	if( NULL == (fa = srmio_data_fixup( a, &err )))
+		return false;
+
+	if( NULL != (fb = srmio_data_fixup( b, &err ))){
+		ok = check_chunks_same( fa, fb ) && check_marker_same( fa, fb );
+		srmio_data_free( fb );
+	}
+
+	srmio_data_free( fa );
+	return ok;
+}
+
+int main( void )
+{
+	srmio_error_t err;
+	srmio_data_t synth, full, lazy, comp, sf, sl;
+	struct _srmio_chunk_t orig, got;
+	srmio_chunk_t ck;
+	FILE *fh, *fa, *fb;
+	unsigned mid;
+
+	/* full resolution of SRM files fits the compact encoding */
+	if( ! CHECK( NULL != (synth = check_synth( 3, true, &err )))
+		|| ! CHECK( NULL != (fh = write_srm7( synth ))))
+
+		return check_result();
+
+	srmio_data_free( synth );
+
+	if( ! CHECK( NULL != (full = srmio_file_srm_read( fh, &err ))))
+		return check_result();
+
+	rewind( fh );
+	if( ! CHECK( NULL != (lazy = srmio_file_srm_read_lazy( fh, &err ))))
+		return check_result();
+
+	rewind( fh );
+	if( ! CHECK( NULL != (comp = srmio_file_srm_read( fh, &err ))))
+		return check_result();
+
+	/* mapped file and pipe, complete and cut within a chunk */
+	if( CHECK( 0 == fseek( fh, 0, SEEK_END ))){
+		long len = ftell( fh );
+
+		CHECK( lazy_same( fh, len ));
+		CHECK( lazy_same( fh, len - 7 ));
+		CHECK( lazy_same( fh, len / 2 ));
+	}
+
+	fclose( fh );
+
+	/* lazy access */
+	CHECK( srmio_data_is_compact( lazy ));
+	CHECK( ! srmio_data_is_compact( full ));
+	CHECK( check_chunks_same( full, lazy ));
+	CHECK( check_marker_same( full, lazy ));
+
+	/* explicit compaction */
+	CHECK( srmio_data_compact( comp, &err ));
+	CHECK( srmio_data_is_compact( comp ));
+	CHECK( check_chunks_same( full, comp ));
+
+	/* library functions on compact data */
+	CHECK( fixup_same( full, lazy ));
+	CHECK( fixup_same( full, comp ));
+
+	sf = srmio_data_slice( full, 5, 50, &err );
+	sl = srmio_data_slice( lazy, 5, 50, &err );
+	if( CHECK( sf && sl ))
+		CHECK( check_chunks_same( sf, sl ));
+	srmio_data_free( sf );
+	srmio_data_free( sl );
+
+	fa = write_srm7( full );
+	fb = write_srm7( lazy );
+	if( CHECK( fa && fb ))
+		CHECK( check_file_same( fa, fb ));
+	if( fa )
+		fclose( fa );
+	if( fb )
+		fclose( fb );
+
+	/* modifying a materialized chunk */
+	mid = lazy->cused / 2;
+	srmio_data_chunk_get( lazy, mid, &orig );
+	if( CHECK( NULL != (ck = srmio_data_chunk( lazy, mid, &err )))){
+		CHECK( check_chunk_same( ck, &orig ));
+
+		ck->pwr = orig.pwr +1;
+		srmio_data_chunk_get( lazy, mid, &got );
+		CHECK( got.pwr == orig.pwr +1 );
+
+		ck->pwr = orig.pwr;
+	}
+
+	/* changes are kept when compacting again */
+	if( CHECK( NULL != (ck = srmio_data_chunk( comp, mid, &err )))){
+		ck->hr = orig.hr +1;
+		CHECK( srmio_data_compact( comp, &err ));
+		srmio_data_chunk_get( comp, mid, &got );
+		CHECK( got.hr == orig.hr +1 );
+	}
+
+	/* reserving keeps compact data compact */
+	CHECK( srmio_data_reserve( lazy, lazy->cused + 100,
+		lazy->mused + 10, &err ));
+	CHECK( srmio_data_is_compact( lazy ));
+	CHECK( check_chunks_same( full, lazy ));
+	CHECK( check_marker_same( full, lazy ));
+
+	/* back to full representation */
+	CHECK( srmio_data_expand( lazy, &err ));
+	CHECK( ! srmio_data_is_compact( lazy ));
+	CHECK( check_chunks_same( full, lazy ));
+
+	srmio_data_free( comp );
+	srmio_data_free( lazy );
+	srmio_data_free( full );
+
+	return check_result();
+}
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "check.h"
+
+/*
+ * all fixup variants must give the same result as the sequential
+ * srmio_data_fixup() and leave their source alone. Streaming fixup
+ * must give the pieces of split data fixed afterwards. Parallel fixup
+ * is checked at the boundaries of its parts and when it has to fall
+ * back to sequential fixing.
+ */
+
+#define SEEDS	8
+
+/* split thresholds for streaming: some gaps are filled, some split */
+#define GAP	15
+#define OVERLAP	5
+#define MIN	5
+
+/*
+ * add src chunk by chunk through a fixup filter
+ */
+static srmio_data_t streamed( srmio_data_t src, srmio_time_t gap,
+	srmio_time_t overlap, srmio_fixup_t *fxp, srmio_error_t *err )
+{
+	srmio_data_t data;
+	srmio_fixup_t fx;
+	unsigned i;
+
+	if( NULL == (data = srmio_data_header( src, err )))
+		return NULL;
+
+	if( NULL == (fx = srmio_fixup_new( data, gap, overlap, err )))
+		goto clean1;
+
+	for( i = 0; i < src->cused; ++i ){
+		struct _srmio_chunk_t chunk;
+
+		srmio_data_chunk_get( src, i, &chunk );
+		if( ! srmio_fixup_add( fx, &chunk, err ))
+			goto clean2;
+	}
+
+	if( ! srmio_fixup_finish( fx, err ))
+		goto clean2;
+
+	*fxp = fx;
+	return data;
+
+clean2:
+	srmio_fixup_free( fx );
+clean1:
+	srmio_data_free( data );
+	return NULL;
+}
+
+/*
+ * streamed pieces must equal split pieces fixed afterwards
+ */
+static void check_pieces( srmio_data_t data )
+{
+	srmio_error_t err;
+	srmio_split_iter_t want, got;
+	srmio_fixup_t fx;
+	srmio_data_t str, a, b;
+
+	if( ! CHECK( NULL != (str = streamed( data, GAP, OVERLAP, &fx,
+		&err ))))
+
+		return;
+
+	want = srmio_data_split_iter_new( data, GAP, OVERLAP, MIN, &err );
+	got = srmio_fixup_split_iter_new( fx, MIN, &err );
+	if( ! CHECK( want && got ))
+		goto clean1;
+
+	do {
+		if( ! CHECK( srmio_data_split_iter_next( want, &a, &err ))
+			|| ! CHECK( srmio_data_split_iter_next( got, &b,
+			&err )))
+
+			break;
+
+		if( CHECK( ( a == NULL ) == ( b == NULL )) && a ){
+			if( CHECK( srmio_data_fixup_inplace( a, &err )))
+				CHECK( check_chunks_same( a, b ));
+		}
+
+		srmio_data_free( a );
+		srmio_data_free( b );
+	} while( a && b );
+
+clean1:
+	srmio_data_split_iter_free( want );
+	srmio_data_split_iter_free( got );
+	srmio_fixup_free( fx );
+	srmio_data_free( str );
+}
+
+/* time step before a chunk */
+struct step_t {
+	unsigned	c;
+	long		delta;	/* added to time, 1/10 sec */
+};
+
+/*
+ * data with n chunks of recint and the given steps. Values vary, so
+ * filled gaps differ from their neighbours.
+ */
+static srmio_data_t stepped( unsigned n, srmio_time_t recint,
+	const struct step_t *step )
+{
+	struct _srmio_chunk_t chunk;
+	srmio_error_t err;
+	srmio_data_t data;
+	srmio_time_t time = 12623040000ULL;
+	unsigned i;
+
+	if( NULL == (data = srmio_data_new( &err )))
+		return NULL;
+
+	for( i = 0; i < n; ++i, time += recint ){
+		for( ; step->c && step->c == i; ++step )
+			time += step->delta;
+
+		memset( &chunk, 0, sizeof(chunk) );
+		chunk.time = time;
+		chunk.dur = recint;
+		chunk.pwr = i % 997;
+		chunk.cad = i % 120;
+		chunk.hr = 60 + i % 130;
+		chunk.speed = 0.1 * ( i % 500 );
+
+		if( ! srmio_data_add_chunk( data, &chunk, &err ))
+			goto clean1;
+	}
+
+	return data;
+
+clean1:
+	fprintf( stderr, "stepped: %s\n", err.message );
+	srmio_data_free( data );
+	return NULL;
+}
+
+static void parallel_same( srmio_pool_t pool, srmio_data_t data )
+{
+	srmio_error_t err;
+	srmio_data_t seq, par;
+
+	if( ! CHECK( NULL != (seq = srmio_data_fixup( data, &err ))))
+		return;
+
+	if( CHECK( NULL != (par = srmio_data_fixup_parallel( data, pool,
+		&err )))){
+
+		CHECK( check_chunks_same( seq, par ));
+		CHECK( check_marker_same( seq, par ));
+		srmio_data_free( par );
+	}
+
+	srmio_data_free( seq );
+}
+
+/*
+ * independent parts: cut at the long gaps at 5000 and 10000, gaps and
+ * overlaps to fix right before and after them. Severe overlaps move
+ * chunks of earlier parts back in time.
+ */
+static void check_parts( srmio_pool_t pool )
+{
+	static const struct step_t step[] = {
+		{ 4990, 15 },
+		{ 4995, -40 },
+		{ 5000, 300 },
+		{ 5003, 12 },
+		{ 5010, -3 },
+		{ 9995, -40 },
+		{ 9999, 15 },
+		{ 10000, 250 },
+		{ 10001, 8 },
+		{ 10002, -5 },
+		{ 14000, -25 },
+		{ 0, 0 }
+	};
+	srmio_error_t err;
+	srmio_data_t data;
+
+	if( ! CHECK( NULL != (data = stepped( 15000, 10, step ))))
+		return;
+
+	CHECK( srmio_data_add_marker( data, 4980, 5020, &err ));
+	CHECK( srmio_data_add_marker( data, 9990, 10010, &err ));
+	CHECK( srmio_data_add_marker( data, 100, 14900, &err ));
+	CHECK( srmio_data_add_marker( data, 5000, 5000, &err ));
+
+	parallel_same( pool, data );
+	srmio_data_free( data );
+}
+
+/*
+ * part depends on the previous one after fixing: small overlaps at
+ * recint < 1sec push all following chunks of the part forward, so the
+ * long gap at 5000 shrinks to a small one that gets filled.
+ */
+static void check_dependent( srmio_pool_t pool )
+{
+	static const struct step_t step[] = {
+		{ 4000, -3 },
+		{ 5000, 12 },
+		{ 0, 0 }
+	};
+	srmio_error_t err;
+	srmio_data_t data;
+
+	if( ! CHECK( NULL != (data = stepped( 10000, 5, step ))))
+		return;
+
+	CHECK( srmio_data_add_marker( data, 4990, 5010, &err ));
+
+	parallel_same( pool, data );
+	srmio_data_free( data );
+}
+
+static void check_seed( srmio_pool_t pool, unsigned seed )
+{
+	srmio_error_t err;
+	srmio_data_t data, orig, seq, par, inp, str;
+	srmio_fixup_t fx;
+
+	if( ! CHECK( NULL != (data = check_synth( seed, true, &err )))
+		|| ! CHECK( NULL != (orig = check_synth( seed, true, &err ))))
+
+		return;
+
+	if( ! CHECK( NULL != (seq = srmio_data_fixup( data, &err ))))
+		goto clean1;
+
+	if( CHECK( NULL != (par = srmio_data_fixup_parallel( data, pool,
+		&err )))){
+
+		CHECK( check_chunks_same( seq, par ));
+		CHECK( check_marker_same( seq, par ));
+		srmio_data_free( par );
+	}
+
+	/* in place on a data set sharing the chunks */
+	if( CHECK( NULL != (inp = check_copy( data, &err )))){
+		if( CHECK( srmio_data_fixup_inplace( inp, &err ))){
+			CHECK( check_chunks_same( seq, inp ));
+			CHECK( check_marker_same( seq, inp ));
+		}
+		srmio_data_free( inp );
+	}
+
+	/* chunks only, marker are added by the caller */
+	if( CHECK( NULL != (str = streamed( data, (srmio_time_t)-1,
+		(srmio_time_t)-1, &fx, &err )))){
+
+		CHECK( check_chunks_same( seq, str ));
+		srmio_fixup_free( fx );
+		srmio_data_free( str );
+	}
+
+	check_pieces( data );
+
+	CHECK( check_chunks_same( orig, data ));
+	CHECK( check_marker_same( orig, data ));
+
+	srmio_data_free( seq );
+clean1:
+	srmio_data_free( orig );
+	srmio_data_free( data );
+}
+
+int main( void )
+{
+	srmio_error_t err;
+	srmio_pool_t pool;
+	unsigned seed;
+
+	if( ! CHECK( NULL != (pool = srmio_pool_new( 4, &err ))))
+		return check_result();
+
+	for( seed = 1; seed <= SEEDS; ++seed )
+		check_seed( pool, seed );
+
+	check_parts( pool );
+	check_dependent( pool );
+
+	srmio_pool_free( pool );
+
+	return check_result();
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "check.h"
+
+/*
+ * marker shifts must be visible in data->marker right away, the
+ * marker index has to follow them and gap filling fixups move marker
+ * behind the gap.
+ */
+
+struct range_t {
+	unsigned	first;
+	unsigned	last;
+};
+
+static void shift( struct range_t *expect, unsigned n, unsigned pos,
+	unsigned delta )
+{
+	unsigned m;
+
+	for( m = 0; m < n; ++m ){
+		if( expect[m].first >= pos )
+			expect[m].first += delta;
+		if( expect[m].last >= pos )
+			expect[m].last += delta;
+	}
+}
+
+/* compare data->marker without syncing first */
+static bool same( srmio_data_t data, struct range_t *expect )
+{
+	unsigned m;
+
+	for( m = 0; m < data->mused; ++m ){
+		if( data->marker[m]->first != expect[m].first
+			|| data->marker[m]->last != expect[m].last ){
+
+			fprintf( stderr, "marker %u: %u-%u, expected %u-%u\n",
+				m,
+				data->marker[m]->first,
+				data->marker[m]->last,
+				expect[m].first,
+				expect[m].last );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* compare srmio_data_markers_range() with a plain scan */
+static bool range_same( srmio_data_t data, unsigned first, unsigned last )
+{
+	srmio_error_t err;
+	srmio_marker_t *mk;
+	unsigned m, i = 0;
+	bool ok = true;
+
+	if( NULL == (mk = srmio_data_markers_range( data, first, last, &err )))
+		return false;
+
+	for( m = 0; m < data->mused; ++m ){
+		srmio_marker_t x = data->marker[m];
+
+		if( x->first > last || x->last < first )
+			continue;
+
+		if( mk[i++] != x ){
+			ok = false;
+			break;
+		}
+	}
+	if( ok && mk[i] )
+		ok = false;
+
+	free( mk );
+	return ok;
+}
+
+static void check_shift( void )
+{
+	srmio_error_t err;
+	srmio_data_t data;
+	struct range_t *expect;
+	unsigned m, i;
+	const unsigned shifts[][2] = {
+		{ 100, 3 },
+		{ 500, 2 },
+		{ 501, 7 },
+		{ 50, 1 },	/* before earlier shifts */
+		{ 0, 4 },
+	};
+
+	if( ! CHECK( NULL != (data = check_synth( 2, false, &err )))
+		|| ! CHECK( data->mused > 3 ))
+
+		return;
+
+	if( ! CHECK( NULL != (expect = malloc( data->mused
+		* sizeof(struct range_t) ))))
+
+		return;
+
+	for( m = 0; m < data->mused; ++m ){
+		expect[m].first = data->marker[m]->first;
+		expect[m].last = data->marker[m]->last;
+	}
+
+	/* build index before shifting */
+	CHECK( range_same( data, 0, data->cused -1 ));
+
+	for( i = 0; i < sizeof(shifts) / sizeof(shifts[0]); ++i ){
+		CHECK( srmio_data_marker_shift( data, shifts[i][0],
+			shifts[i][1], &err ));
+		shift( expect, data->mused, shifts[i][0], shifts[i][1] );
+
+		CHECK( same( data, expect ));
+		CHECK( range_same( data, shifts[i][0], shifts[i][0] + 20 ));
+	}
+
+	for( i = 0; i < data->cused + 40; i += 97 )
+		CHECK( range_same( data, i, i + 150 ));
+
+	free( expect );
+	srmio_data_free( data );
+}
+
+/*
+ * 20 chunks with one missing after the first 10, fixups fill it
+ */
+static srmio_data_t gap_data( srmio_error_t *err )
+{
+	srmio_data_t data;
+	unsigned i;
+
+	if( NULL == (data = srmio_data_new( err )))
+		return NULL;
+
+	for( i = 0; i < 20; ++i ){
+		struct _srmio_chunk_t chunk;
+
+		memset( &chunk, 0, sizeof(chunk) );
+		chunk.time = 12623040000ULL + 10 * ( i < 10 ? i : i +1 );
+		chunk.dur = 10;
+		chunk.pwr = 100 + i;
+
+		if( ! srmio_data_add_chunk( data, &chunk, err ))
+			goto clean1;
+	}
+
+	if( ! srmio_data_add_marker( data, 2, 5, err )
+		|| ! srmio_data_add_marker( data, 2, 11, err )
+		|| ! srmio_data_add_marker( data, 12, 15, err ))
+
+		goto clean1;
+
+	return data;
+
+clean1:
+	srmio_data_free( data );
+	return NULL;
+}
+
+static void check_fixup( void )
+{
+	srmio_error_t err;
+	srmio_data_t data, fixed;
+	struct range_t expect[] = {
+		{ 2, 5 },
+		{ 2, 12 },
+		{ 13, 16 },
+	};
+
+	if( ! CHECK( NULL != (data = gap_data( &err ))))
+		return;
+
+	if( CHECK( NULL != (fixed = srmio_data_fixup( data, &err )))){
+		CHECK( fixed->cused == 21 );
+		CHECK( fixed->mused == 3 && same( fixed, expect ));
+		srmio_data_free( fixed );
+	}
+
+	if( CHECK( srmio_data_fixup_inplace( data, &err ))){
+		CHECK( data->cused == 21 );
+		CHECK( data->mused == 3 && same( data, expect ));
+		CHECK( range_same( data, 12, 12 ));
+	}
+
+	srmio_data_free( data );
+}
+
+int main( void )
+{
+	check_shift();
+	check_fixup();
+
+	return check_result();
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "check.h"
+
+/*
+ * srmio_data_resample() interpolates when upsampling, averages weighted
+ * by time when downsampling, keeps gaps and maps marker to the new
+ * chunks.
+ */
+
+#define START	12623040000ULL
+
+/*
+ * chunk i starts at START + time[i] with recint and pwr[i]
+ */
+static srmio_data_t build( unsigned n, const srmio_time_t *time,
+	srmio_time_t recint, const unsigned *pwr, srmio_error_t *err )
+{
+	srmio_data_t data;
+	unsigned i;
+
+	if( NULL == (data = srmio_data_new( err )))
+		return NULL;
+
+	for( i = 0; i < n; ++i ){
+		struct _srmio_chunk_t chunk;
+
+		memset( &chunk, 0, sizeof(chunk) );
+		chunk.time = START + time[i];
+		chunk.dur = recint;
+		chunk.pwr = pwr[i];
+
+		if( ! srmio_data_add_chunk( data, &chunk, err )){
+			srmio_data_free( data );
+			return NULL;
+		}
+	}
+
+	return data;
+}
+
+static bool chunk_is( srmio_data_t data, unsigned i, srmio_time_t time,
+	srmio_time_t dur, unsigned pwr )
+{
+	struct _srmio_chunk_t ck;
+
+	if( i >= data->cused ){
+		fprintf( stderr, "missing chunk %u\n", i );
+		return false;
+	}
+
+	srmio_data_chunk_get( data, i, &ck );
+	if( ck.time == START + time && ck.dur == dur && ck.pwr == pwr )
+		return true;
+
+	fprintf( stderr, "chunk %u: time=%.1f dur=%.1f pwr=%u\n",
+		i, (double)(ck.time - START) / 10, (double)ck.dur / 10,
+		ck.pwr );
+	return false;
+}
+
+/* 2sec -> 1sec: interpolate between the centers of old chunks */
+static void check_upsample( void )
+{
+	srmio_error_t err;
+	srmio_time_t time[] = { 0, 20, 40, 60 };
+	unsigned pwr[] = { 100, 140, 180, 220 };
+	srmio_data_t data, res;
+	unsigned i;
+
+	if( ! CHECK( NULL != (data = build( 4, time, 20, pwr, &err ))))
+		return;
+
+	if( ! CHECK( NULL != (res = srmio_data_resample( data, 10, &err ))))
+		goto clean1;
+
+	CHECK( res->cused == 8 );
+
+	/* no neighbour before first chunk */
+	CHECK( chunk_is( res, 0, 0, 10, 100 ));
+
+	/* 1/4 of the way to the neighbour */
+	for( i = 1; i < 7; ++i ){
+		unsigned o = i / 2;
+		int dir = i % 2 ? 1 : -1;
+
+		CHECK( chunk_is( res, i, 10 * i, 10,
+			pwr[o] + dir * ( 140 - 100 ) / 4 ));
+	}
+
+	/* no neighbour after last chunk */
+	CHECK( chunk_is( res, 7, 70, 10, 220 ));
+
+	srmio_data_free( res );
+clean1:
+	srmio_data_free( data );
+}
+
+/* 1sec -> 2.5sec: average weighted by overlapping time */
+static void check_downsample( void )
+{
+	srmio_error_t err;
+	srmio_time_t time[] = { 0, 10, 20, 30, 40 };
+	unsigned pwr[] = { 0, 10, 20, 30, 40 };
+	srmio_data_t data, res;
+
+	if( ! CHECK( NULL != (data = build( 5, time, 10, pwr, &err ))))
+		return;
+
+	if( ! CHECK( NULL != (res = srmio_data_resample( data, 25, &err ))))
+		goto clean1;
+
+	CHECK( res->cused == 2 );
+	CHECK( chunk_is( res, 0, 0, 25,
+		( 10 * 0 + 10 * 10 + 5 * 20 ) / 25 ));
+	CHECK( chunk_is( res, 1, 25, 25,
+		( 5 * 20 + 10 * 30 + 10 * 40 ) / 25 ));
+
+	srmio_data_free( res );
+clean1:
+	srmio_data_free( data );
+}
+
+/*
+ * gaps: new chunks less than half covered are skipped, the grid
+ * restarts after the gap. Marker are mapped by time, dropped when
+ * nothing is left of them.
+ */
+static void check_gap( void )
+{
+	srmio_error_t err;
+	srmio_time_t time[17];
+	unsigned pwr[17];
+	srmio_data_t data, res;
+	unsigned i;
+
+	/* 0 - 9sec, gap, 100 - 108sec */
+	for( i = 0; i < 17; ++i ){
+		time[i] = i < 9 ? 10 * i : 1000 + 10 * ( i - 9 );
+		pwr[i] = 100;
+	}
+
+	if( ! CHECK( NULL != (data = build( 17, time, 10, pwr, &err ))))
+		return;
+
+	if( ! CHECK( srmio_data_add_marker( data, 2, 5, &err )
+		&& srmio_data_add_marker( data, 8, 8, &err )
+		&& srmio_data_add_marker( data, 9, 16, &err )))
+
+		goto clean1;
+
+	if( ! CHECK( NULL != (res = srmio_data_resample( data, 40, &err ))))
+		goto clean1;
+
+	/* 8 - 12sec has only 1sec of data */
+	CHECK( res->cused == 4 );
+	CHECK( chunk_is( res, 0, 0, 40, 100 ));
+	CHECK( chunk_is( res, 1, 40, 40, 100 ));
+	CHECK( chunk_is( res, 2, 1000, 40, 100 ));
+	CHECK( chunk_is( res, 3, 1040, 40, 100 ));
+
+	srmio_data_marker_sync( res );
+	if( CHECK( res->mused == 2 )){
+		CHECK( res->marker[0]->first == 0 && res->marker[0]->last == 1 );
+		CHECK( res->marker[1]->first == 2 && res->marker[1]->last == 3 );
+	}
+
+	srmio_data_free( res );
+clean1:
+	srmio_data_free( data );
+}
+
+int main( void )
+{
+	check_upsample();
+	check_downsample();
+	check_gap();
+
+	return check_result();
+}
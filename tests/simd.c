@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "check.h"
+#include "common.h"
+
+/*
+ * vectorized SRM record decoding must give exactly the chunks of the
+ * scalar code - for random records and record counts that don't fill
+ * the last group.
+ */
+
+#ifdef USE_X86_SIMD
+
+typedef unsigned (*kernel_func)( srmio_chunk_t ck,
+	const unsigned char *buf, unsigned n, srmio_time_t time,
+	srmio_time_t recint );
+
+typedef void (*scalar_func)( srmio_chunk_t ck, const unsigned char *buf );
+
+struct kernel_t {
+	const char	*name;
+	kernel_func	func;
+	srmio_simd_t	level;
+	unsigned	group;	/* records per group */
+	unsigned	len;	/* record length */
+	scalar_func	scalar;
+};
+
+/* same as _srmio_data_chunks_srm6() in file_srm.c */
+static void scalar6( srmio_chunk_t ck, const unsigned char *buf )
+{
+	unsigned c0 = buf[0];
+	unsigned c1 = buf[1];
+	unsigned c2 = buf[2];
+
+	ck->temp = 0;
+	ck->pwr = ( c1 & 0x0f) | ( c2 << 4 );
+	ck->speed = (double)( ((c1 & 0xf0) << 3)
+		| (c0 & 0x7f) ) * 3 / 26;
+	ck->cad = buf[3];
+	ck->hr = buf[4];
+	ck->ele = 0;
+}
+
+/* same as _srmio_data_chunks_srm7() in file_srm.c */
+static void scalar7( srmio_chunk_t ck, const unsigned char *buf )
+{
+	ck->pwr = buf_get_luint16( buf, 0 );
+	ck->cad = buf[2];
+	ck->hr = buf[3];
+	ck->speed = ( (double)buf_get_lint32( buf, 4 ) * 3.6) / 1000;
+	if( ck->speed < 0 )
+		ck->speed = 0;
+	ck->ele = buf_get_lint32( buf, 8 );
+	ck->temp = 0.1 * buf_get_lint16( buf, 12 );
+}
+
+static const struct kernel_t kernels[] = {
+	{ "srm6_sse2", srmio_file_chunks_srm6_sse2, srmio_simd_sse2, 4, 5,
+		scalar6 },
+	{ "srm6_avx2", srmio_file_chunks_srm6_avx2, srmio_simd_avx2, 8, 5,
+		scalar6 },
+	{ "srm7_sse2", srmio_file_chunks_srm7_sse2, srmio_simd_sse2, 4, 14,
+		scalar7 },
+	{ "srm7_avx2", srmio_file_chunks_srm7_avx2, srmio_simd_avx2, 8, 14,
+		scalar7 },
+	{ NULL, NULL, srmio_simd_none, 0, 0, NULL }
+};
+
+#define TIME	12623040000ULL
+#define RECINT	10
+
+/*
+ * decode n random records with the kernel, finish the remaining ones
+ * like file_srm.c does and compare with the scalar code
+ */
+static bool decode_same( const struct kernel_t *k, unsigned n )
+{
+	struct _srmio_chunk_t *want, *got;
+	unsigned char *buf;
+	unsigned done, i;
+	bool ok = false;
+
+	/* exact size, kernels must not read past the last record */
+	if( NULL == (buf = malloc( n * k->len )))
+		return false;
+
+	for( i = 0; i < n * k->len; ++i )
+		buf[i] = rand();
+
+	want = calloc( n, sizeof(struct _srmio_chunk_t) );
+	got = calloc( n, sizeof(struct _srmio_chunk_t) );
+	if( ! want || ! got )
+		goto clean1;
+
+	for( i = 0; i < n; ++i ){
+		want[i].time = TIME + i * RECINT;
+		want[i].dur = RECINT;
+		(*k->scalar)( &want[i], buf + i * k->len );
+	}
+
+	done = (*k->func)( got, buf, n, TIME, RECINT );
+	if( done % k->group || done >= n || n - done > k->group ){
+
+		fprintf( stderr, "%s: %u of %u records decoded\n",
+			k->name, done, n );
+		goto clean1;
+	}
+
+	for( i = done; i < n; ++i ){
+		got[i].time = TIME + i * RECINT;
+		got[i].dur = RECINT;
+		(*k->scalar)( &got[i], buf + i * k->len );
+	}
+
+	for( i = 0; i < n; ++i ){
+		if( ! check_chunk_same( &got[i], &want[i] ) ){
+			fprintf( stderr, "%s: %u records, chunk %u differs: "
+				"pwr=%u/%u speed=%f/%f cad=%u/%u hr=%u/%u "
+				"ele=%ld/%ld temp=%f/%f\n",
+				k->name, n, i,
+				got[i].pwr, want[i].pwr,
+				got[i].speed, want[i].speed,
+				got[i].cad, want[i].cad,
+				got[i].hr, want[i].hr,
+				got[i].ele, want[i].ele,
+				got[i].temp, want[i].temp );
+			goto clean1;
+		}
+	}
+
+	ok = true;
+
+clean1:
+	free( got );
+	free( want );
+	free( buf );
+	return ok;
+}
+
+int main( void )
+{
+	static const unsigned cnt[] = { 1, 3, 4, 5, 7, 8, 9, 11, 13, 16,
+		17, 23, 31, 33, 255, 1001 };
+	srmio_simd_t level = srmio_simd_level();
+	const struct kernel_t *k;
+	unsigned i;
+
+	srand( 7 );
+
+	for( k = kernels; k->name; ++k ){
+		if( k->level > level ){
+			fprintf( stderr, "%s: not supported by CPU\n", k->name );
+			continue;
+		}
+
+		for( i = 0; i < sizeof(cnt) / sizeof(cnt[0]); ++i )
+			CHECK( decode_same( k, cnt[i] ));
+	}
+
+	return check_result();
+}
+
+#else
+
+int main( void )
+{
+	/* skipped */
+	return 77;
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "check.h"
+
+/*
+ * slices share chunks with their source. Modifying either side must
+ * copy the chunk first, the other side keeps the old values.
+ */
+
+static unsigned pwr( srmio_data_t data, unsigned i )
+{
+	struct _srmio_chunk_t chunk;
+
+	srmio_data_chunk_get( data, i, &chunk );
+	return chunk.pwr;
+}
+
+int main( void )
+{
+	srmio_error_t err;
+	srmio_data_t data, orig, slice, sub;
+	srmio_chunk_t ck, again;
+	unsigned i;
+
+	if( ! CHECK( NULL != (data = check_synth( 1, false, &err )))
+		|| ! CHECK( NULL != (orig = check_synth( 1, false, &err )))
+		|| ! CHECK( data->cused > 200 ))
+
+		return check_result();
+
+	/* marker within and across the slice */
+	CHECK( srmio_data_add_marker( data, 20, 30, &err ));
+	CHECK( srmio_data_add_marker( data, 95, 150, &err ));
+
+	if( ! CHECK( NULL != (slice = srmio_data_slice( data, 10, 99, &err ))))
+		return check_result();
+
+	CHECK( slice->cused == 90 );
+	for( i = 0; i < slice->cused; ++i ){
+		struct _srmio_chunk_t x, y;
+
+		srmio_data_chunk_get( slice, i, &x );
+		srmio_data_chunk_get( data, i + 10, &y );
+		if( ! CHECK( check_chunk_same( &x, &y )))
+			break;
+	}
+
+	/* marker are clipped to the slice */
+	srmio_data_marker_sync( slice );
+	if( CHECK( slice->mused >= 2 )){
+		srmio_marker_t *mk = srmio_data_markers_range( slice, 0,
+			slice->cused -1, &err );
+
+		if( CHECK( mk != NULL )){
+			for( i = 0; mk[i]; ++i )
+				CHECK( mk[i]->last < slice->cused );
+			free( mk );
+		}
+	}
+	CHECK( NULL == srmio_data_slice( data, 10, data->cused, &err ));
+
+	/* modify source: slice keeps the old value */
+	if( CHECK( NULL != (ck = srmio_data_chunk_unshare( data, 10, &err )))){
+		ck->pwr = 4242;
+
+		CHECK( pwr( data, 10 ) == 4242 );
+		CHECK( pwr( slice, 0 ) == pwr( orig, 10 ));
+
+		/* already private: no further copy */
+		again = srmio_data_chunk_unshare( data, 10, &err );
+		CHECK( again == ck );
+	}
+
+	/* modify slice: source keeps the old value */
+	if( CHECK( NULL != (ck = srmio_data_chunk_unshare( slice, 1, &err )))){
+		ck->pwr = 4343;
+
+		CHECK( pwr( slice, 1 ) == 4343 );
+		CHECK( pwr( data, 11 ) == pwr( orig, 11 ));
+	}
+
+	/* nested slice survives its parents */
+	if( ! CHECK( NULL != (sub = srmio_data_slice( slice, 0, 9, &err ))))
+		return check_result();
+
+	srmio_data_free( data );
+	CHECK( pwr( slice, 0 ) == pwr( orig, 10 ));
+	CHECK( pwr( sub, 1 ) == 4343 );
+
+	/* unshare all: modifying the slice in place leaves sub alone */
+	if( CHECK( srmio_data_unshare( slice, &err ))){
+		for( i = 0; i < slice->cused; ++i ){
+			if( NULL == (ck = srmio_data_chunk( slice, i, &err )))
+				break;
+			ck->pwr = 1;
+		}
+		CHECK( i == slice->cused );
+		CHECK( pwr( sub, 2 ) == pwr( orig, 12 ));
+	}
+
+	srmio_data_free( slice );
+	CHECK( pwr( sub, 3 ) == pwr( orig, 13 ));
+
+	srmio_data_free( sub );
+	srmio_data_free( orig );
+
+	return check_result();
+}
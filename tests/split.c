@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "check.h"
+
+/*
+ * split iterator and srmio_data_split() must cut data where a plain
+ * scan over the chunks finds gaps, overlaps and recint changes. The
+ * iterator skips pieces with less than min_chunks chunks.
+ */
+
+#define SEEDS	4
+
+/* thresholds: some gaps/overlaps of check_synth() split, some don't */
+#define GAP	15
+#define OVERLAP	5
+
+/*
+ * find end of piece starting at first
+ */
+static unsigned scan_piece( srmio_data_t data, srmio_time_t gap,
+	srmio_time_t overlap, unsigned first )
+{
+	struct _srmio_chunk_t prev, this;
+	unsigned c;
+
+	srmio_data_chunk_get( data, first, &prev );
+	for( c = first +1; c < data->cused; ++c, prev = this ){
+		srmio_time_t end = prev.time + prev.dur;
+
+		srmio_data_chunk_get( data, c, &this );
+
+		if( this.dur != prev.dur
+			|| ( this.time > end && this.time - end > gap )
+			|| ( this.time < end && end - this.time > overlap ))
+
+			break;
+	}
+
+	return c -1;
+}
+
+/*
+ * compare piece with a slice of data
+ */
+static bool piece_same( srmio_data_t data, unsigned first, unsigned last,
+	srmio_data_t piece )
+{
+	srmio_error_t err;
+	srmio_data_t want;
+	bool ok;
+
+	if( NULL == (want = srmio_data_slice( data, first, last, &err ))){
+		fprintf( stderr, "slice: %s\n", err.message );
+		return false;
+	}
+
+	ok = check_chunks_same( want, piece )
+		&& check_marker_same( want, piece );
+	if( ! ok )
+		fprintf( stderr, "piece %u - %u differs\n", first, last );
+
+	srmio_data_free( want );
+	return ok;
+}
+
+/*
+ * iterator must return the scanned pieces with at least min chunks
+ */
+static void check_iter( srmio_data_t data, srmio_time_t gap,
+	srmio_time_t overlap, unsigned min )
+{
+	srmio_error_t err;
+	srmio_split_iter_t it;
+	srmio_data_t piece;
+	unsigned first = 0, last, pieces = 0;
+
+	if( ! CHECK( NULL != (it = srmio_data_split_iter_new( data, gap,
+		overlap, min, &err ))))
+
+		return;
+
+	for( ; first < data->cused; first = last +1 ){
+		last = scan_piece( data, gap, overlap, first );
+		if( last - first +1 < min )
+			continue;
+
+		if( ! CHECK( srmio_data_split_iter_next( it, &piece, &err ))
+			|| ! CHECK( piece != NULL ))
+
+			goto clean1;
+
+		++pieces;
+		if( ! CHECK( piece_same( data, first, last, piece ))){
+			srmio_data_free( piece );
+			goto clean1;
+		}
+		srmio_data_free( piece );
+	}
+
+	/* no more pieces */
+	if( CHECK( srmio_data_split_iter_next( it, &piece, &err )))
+		CHECK( piece == NULL );
+	srmio_data_free( piece );
+
+	/* filtering must leave something to compare */
+	CHECK( pieces > 0 );
+
+clean1:
+	srmio_data_split_iter_free( it );
+}
+
+/*
+ * srmio_data_split() must return all scanned pieces
+ */
+static void check_list( srmio_data_t data, srmio_time_t gap,
+	srmio_time_t overlap )
+{
+	srmio_error_t err;
+	srmio_data_t *list;
+	unsigned first = 0, last, i = 0;
+
+	if( ! CHECK( NULL != (list = srmio_data_split( data, gap, overlap,
+		&err ))))
+
+		return;
+
+	for( ; first < data->cused; first = last +1, ++i ){
+		last = scan_piece( data, gap, overlap, first );
+
+		if( ! CHECK( list[i] != NULL )
+			|| ! CHECK( piece_same( data, first, last, list[i] )))
+			break;
+	}
+	if( first >= data->cused )
+		CHECK( list[i] == NULL );
+
+	for( i = 0; list[i]; ++i )
+		srmio_data_free( list[i] );
+	free( list );
+}
+
+/*
+ * data with a recint change and a negative time step
+ */
+static srmio_data_t special( void )
+{
+	struct _srmio_chunk_t chunk;
+	srmio_error_t err;
+	srmio_data_t data;
+	srmio_time_t time = 12623040000ULL;
+	unsigned i;
+
+	if( NULL == (data = srmio_data_new( &err )))
+		return NULL;
+
+	memset( &chunk, 0, sizeof(chunk) );
+	for( i = 0; i < 200; ++i ){
+		chunk.dur = i < 20 ? 10 : 20;
+		if( i == 100 )
+			time -= 300;
+
+		chunk.time = time;
+		chunk.pwr = i;
+		time += chunk.dur;
+
+		if( ! srmio_data_add_chunk( data, &chunk, &err ))
+			goto clean1;
+	}
+
+	if( ! srmio_data_add_marker( data, 10, 120, &err ))
+		goto clean1;
+
+	return data;
+
+clean1:
+	fprintf( stderr, "special: %s\n", err.message );
+	srmio_data_free( data );
+	return NULL;
+}
+
+static void check_data( srmio_data_t data )
+{
+	static const unsigned min[] = { 0, 1, 5, 50 };
+	unsigned i;
+
+	check_list( data, GAP, OVERLAP );
+	check_list( data, 0, 0 );
+
+	for( i = 0; i < sizeof(min) / sizeof(min[0]); ++i ){
+		check_iter( data, GAP, OVERLAP, min[i] );
+		check_iter( data, 0, 0, min[i] );
+	}
+}
+
+int main( void )
+{
+	srmio_error_t err;
+	srmio_data_t data;
+	unsigned seed;
+
+	for( seed = 1; seed <= SEEDS; ++seed ){
+		if( CHECK( NULL != (data = check_synth( seed, true, &err )))){
+			check_data( data );
+			srmio_data_free( data );
+		}
+	}
+
+	if( CHECK( NULL != (data = special()))){
+		check_data( data );
+		srmio_data_free( data );
+	}
+
+	return check_result();
+}
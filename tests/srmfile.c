@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "check.h"
+
+#include <time.h>
+
+/*
+ * data written as SRM5/6/7 file must read back with the values the
+ * format can hold. Writing the read data again gives the same file.
+ * Probing a file must report what reading it gives - even when it's
+ * truncated.
+ */
+
+typedef bool (*write_func)( srmio_data_t data, FILE *fh,
+	srmio_error_t *err );
+
+struct format_t {
+	const char	*name;
+	write_func	write;
+	bool		temp;	/* temperature and elevation stored */
+	double		speed;	/* speed resolution */
+};
+
+static const struct format_t srm5 = {
+	"srm5", srmio_file_srm5_write, false, 3.0 / 26 };
+static const struct format_t srm6 = {
+	"srm6", srmio_file_srm6_write, false, 3.0 / 26 };
+static const struct format_t srm7 = {
+	"srm7", srmio_file_srm7_write, true, 0.0036 };
+
+/*
+ * write data to a temporary file, reports errors
+ */
+static FILE *write_tmp( const struct format_t *fmt, srmio_data_t data )
+{
+	srmio_error_t err;
+	FILE *fh;
+
+	if( NULL == (fh = tmpfile())){
+		perror( "tmpfile" );
+		return NULL;
+	}
+
+	if( ! (*fmt->write)( data, fh, &err )){
+		fprintf( stderr, "%s: %s\n", fmt->name, err.message );
+		fclose( fh );
+		return NULL;
+	}
+
+	rewind( fh );
+	return fh;
+}
+
+static double dist( double a, double b )
+{
+	return a > b ? a - b : b - a;
+}
+
+/* compare values within the format's resolution */
+static bool values_near( const struct format_t *fmt, srmio_data_t a,
+	srmio_data_t b )
+{
+	unsigned i;
+
+	if( a->cused != b->cused ){
+		fprintf( stderr, "%s: chunk count differs: %u, %u\n",
+			fmt->name, a->cused, b->cused );
+		return false;
+	}
+
+	for( i = 0; i < a->cused; ++i ){
+		struct _srmio_chunk_t x, y;
+
+		srmio_data_chunk_get( a, i, &x );
+		srmio_data_chunk_get( b, i, &y );
+
+		if( x.time != y.time
+			|| x.dur != y.dur
+			|| x.pwr != y.pwr
+			|| x.cad != y.cad
+			|| x.hr != y.hr
+			|| dist( x.speed, y.speed ) > fmt->speed
+			|| ( fmt->temp && dist( x.temp, y.temp ) > 0.1 )
+			|| ( fmt->temp && x.ele != y.ele )){
+
+			fprintf( stderr, "%s: chunk %u differs: "
+				"time=%.1f/%.1f pwr=%u/%u cad=%u/%u\n",
+				fmt->name,
+				i,
+				(double)x.time / 10,
+				(double)y.time / 10,
+				x.pwr,
+				y.pwr,
+				x.cad,
+				y.cad );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * write data, read it back and compare, write again and compare files
+ */
+static void roundtrip( const struct format_t *fmt, srmio_data_t data )
+{
+	srmio_error_t err;
+	srmio_data_t back, again;
+	FILE *f1, *f2;
+
+	if( ! CHECK( NULL != (f1 = write_tmp( fmt, data ))))
+		return;
+
+	if( ! CHECK( NULL != (back = srmio_file_srm_read( f1, &err ))))
+		goto clean1;
+
+	CHECK( values_near( fmt, data, back ));
+	CHECK( check_marker_same( data, back ));
+
+	if( CHECK( NULL != (f2 = write_tmp( fmt, back )))){
+		CHECK( check_file_same( f1, f2 ));
+
+		rewind( f2 );
+		if( CHECK( NULL != (again = srmio_file_srm_read( f2, &err )))){
+			CHECK( check_chunks_same( back, again ));
+			srmio_data_free( again );
+		}
+		fclose( f2 );
+	}
+
+	srmio_data_free( back );
+clean1:
+	fclose( f1 );
+}
+
+/*
+ * local midnight of the synth default start
+ */
+static srmio_time_t midnight( void )
+{
+	struct tm tm;
+
+	memset( &tm, 0, sizeof(tm) );
+	tm.tm_year = 110;
+	tm.tm_mday = 1;
+	tm.tm_isdst = -1;
+
+	return (srmio_time_t)mktime( &tm ) * 10;
+}
+
+static srmio_data_t synth( srmio_synth_pc_t pc, unsigned gaps,
+	srmio_time_t start )
+{
+	struct _srmio_synth_t conf;
+	srmio_error_t err;
+	srmio_data_t data;
+
+	srmio_synth_init( &conf );
+	conf.seed = 4;
+	conf.pc = pc;
+	conf.gaps = gaps;
+	conf.gap_max = 6000;
+	conf.overlaps = 0;
+	conf.marker = 300;
+	if( start )
+		conf.start = start;
+
+	if( NULL == (data = srmio_data_synth( &conf, &err )))
+		fprintf( stderr, "synth: %s\n", err.message );
+
+	return data;
+}
+
+/*
+ * probe and full read of the first len bytes must agree
+ */
+static bool probe_same( const struct format_t *fmt, FILE *fh, long len )
+{
+	struct _srmio_file_srm_info_t info;
+	srmio_error_t err;
+	srmio_data_t data;
+	srmio_time_t start, end;
+	bool probed, ok = false;
+	FILE *part;
+
+	if( NULL == (part = check_truncated( fh, len )))
+		return false;
+
+	probed = srmio_file_srm_probe( part, &info, &err );
+
+	rewind( part );
+	data = srmio_file_srm_read( part, &err );
+	fclose( part );
+
+	/* neither works without chunks */
+	if( ! data || ! data->cused ){
+		ok = ! probed;
+		goto clean1;
+	}
+
+	if( ! probed ){
+		fprintf( stderr, "%s: probe %ld bytes: %s\n", fmt->name, len,
+			err.message );
+		goto clean1;
+	}
+
+	if( ! srmio_data_time_start( data, &start, &err )
+		|| ! srmio_data_time_end( data, &end, &err ))
+		goto clean1;
+
+	ok = info.version == fmt->name[3]
+		&& info.start == start
+		&& info.end == end
+		&& info.chunks == data->cused;
+
+	if( ! ok )
+		fprintf( stderr, "%s: probe %ld bytes: "
+			"start %.1f/%.1f end %.1f/%.1f chunks %u/%u\n",
+			fmt->name, len,
+			(double)info.start / 10, (double)start / 10,
+			(double)info.end / 10, (double)end / 10,
+			info.chunks, data->cused );
+
+clean1:
+	srmio_data_free( data );
+	return ok;
+}
+
+/*
+ * probe file cut at various lengths - within chunks, blocks and the
+ * header
+ */
+static void check_probe( const struct format_t *fmt, srmio_data_t data )
+{
+	FILE *fh;
+	long len, cut;
+
+	if( ! CHECK( NULL != (fh = write_tmp( fmt, data ))))
+		return;
+
+	if( CHECK( 0 == fseek( fh, 0, SEEK_END ))
+		&& CHECK( 0 < (len = ftell( fh )))){
+
+		CHECK( probe_same( fmt, fh, len ));
+		for( cut = 1; cut < len; cut += cut < 64 ? 3 : 997 )
+			if( ! CHECK( probe_same( fmt, fh, len - cut )))
+				break;
+	}
+
+	fclose( fh );
+}
+
+/*
+ * decode known SRM6 records: power and speed packed into the first 3
+ * bytes, followed by cadence and heartrate
+ */
+static void check_srm6_record( void )
+{
+	static const unsigned char rec[] = {
+		0x05, 0x3a, 0x0c, 0x5a, 0x8c,
+		0x7f, 0xf1, 0xff, 0x00, 0x3c,
+	};
+	srmio_error_t err;
+	srmio_data_t data, back;
+	struct _srmio_chunk_t ck;
+	unsigned i;
+	FILE *fh;
+
+	if( ! CHECK( NULL != (data = srmio_data_new( &err ))))
+		return;
+
+	/* two chunks in a single block, their records end the file */
+	for( i = 0; i < 2; ++i ){
+		memset( &ck, 0, sizeof(ck) );
+		ck.time = midnight() + 10 * ( i +1 );
+		ck.dur = 10;
+		CHECK( srmio_data_add_chunk( data, &ck, &err ));
+	}
+
+	if( ! CHECK( NULL != (fh = write_tmp( &srm6, data ))))
+		goto clean1;
+
+	if( ! CHECK( 0 == fseek( fh, -(long)sizeof(rec), SEEK_END ))
+		|| ! CHECK( sizeof(rec) == fwrite( rec, 1, sizeof(rec), fh )))
+
+		goto clean2;
+
+	rewind( fh );
+	if( ! CHECK( NULL != (back = srmio_file_srm_read( fh, &err ))))
+		goto clean2;
+
+	if( CHECK( back->cused == 2 )){
+		srmio_data_chunk_get( back, 0, &ck );
+		CHECK( ck.pwr == 0xca );
+		CHECK( ck.speed == (double)0x185 * 3 / 26 );
+		CHECK( ck.cad == 0x5a );
+		CHECK( ck.hr == 0x8c );
+
+		srmio_data_chunk_get( back, 1, &ck );
+		CHECK( ck.pwr == 0xff1 );
+		CHECK( ck.speed == (double)0x7ff * 3 / 26 );
+		CHECK( ck.cad == 0 );
+		CHECK( ck.hr == 0x3c );
+	}
+
+	srmio_data_free( back );
+clean2:
+	fclose( fh );
+clean1:
+	srmio_data_free( data );
+}
+
+int main( void )
+{
+	srmio_data_t data;
+	srmio_time_t day = midnight();
+	FILE *fh;
+
+	/* with gaps: several blocks */
+	if( CHECK( NULL != (data = synth( srmio_synth_pc7, 20, 0 )))){
+		roundtrip( &srm7, data );
+		check_probe( &srm7, data );
+		srmio_data_free( data );
+	}
+
+	if( CHECK( NULL != (data = synth( srmio_synth_pc5, 20, 0 )))){
+		roundtrip( &srm6, data );
+		roundtrip( &srm7, data );
+		check_probe( &srm6, data );
+
+		/* SRM5 can't hold gaps */
+		CHECK( NULL == (fh = write_tmp( &srm5, data )));
+		if( fh )
+			fclose( fh );
+		srmio_data_free( data );
+	}
+
+	/* SRM5 starts one recint after midnight */
+	if( CHECK( NULL != (data = synth( srmio_synth_pc5, 0, day + 10 )))){
+		roundtrip( &srm5, data );
+		check_probe( &srm5, data );
+		srmio_data_free( data );
+	}
+
+	if( CHECK( NULL != (data = synth( srmio_synth_pc5, 0, day + 20 )))){
+		CHECK( NULL == (fh = write_tmp( &srm5, data )));
+		if( fh )
+			fclose( fh );
+		srmio_data_free( data );
+	}
+
+	check_srm6_record();
+
+	return check_result();
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "check.h"
+
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ * files in the store are found by later scans. A name that was
+ * reserved but never written - for example after a crash - must not
+ * break scanning.
+ */
+
+/*
+ * ride on the given day after the synth default start
+ */
+static srmio_data_t ride( unsigned day )
+{
+	struct _srmio_synth_t conf;
+	srmio_error_t err;
+	srmio_data_t data;
+
+	srmio_synth_init( &conf );
+	conf.seed = day +1;
+	conf.start += day * 864000;
+
+	if( NULL == (data = srmio_data_synth( &conf, &err )))
+		fprintf( stderr, "synth: %s\n", err.message );
+
+	return data;
+}
+
+/*
+ * scan store at path and check which rides it has
+ */
+static bool have( const char *path, srmio_data_t data, bool want )
+{
+	srmio_error_t err;
+	srmio_store_t store;
+	bool got = false;
+
+	if( NULL == (store = srmio_store_new( path, &err ))){
+		fprintf( stderr, "store: %s\n", err.message );
+		return false;
+	}
+
+	if( ! srmio_store_have_data( store, data, 0, &got, &err )){
+		fprintf( stderr, "store have: %s\n", err.message );
+		srmio_store_free( store );
+		return false;
+	}
+
+	srmio_store_free( store );
+	return got == want;
+}
+
+int main( void )
+{
+	char path[] = "/tmp/srmio-store-XXXXXX";
+	char cmd[PATH_MAX];
+	srmio_error_t err;
+	srmio_store_t store;
+	srmio_data_t a = NULL, b = NULL, c = NULL;
+	char *fname = NULL, *rname = NULL;
+	struct stat st;
+
+	if( ! CHECK( NULL != mkdtemp( path )))
+		return check_result();
+
+	if( ! CHECK( NULL != (a = ride( 0 )))
+		|| ! CHECK( NULL != (b = ride( 1 )))
+		|| ! CHECK( NULL != (c = ride( 2 ))))
+
+		goto clean1;
+
+	if( ! CHECK( NULL != (store = srmio_store_new( path, &err ))))
+		goto clean1;
+
+	CHECK( srmio_store_add( store, a, &fname, &err ));
+
+	/* crash before write: empty file is left behind */
+	CHECK( srmio_store_reserve( store, b, &rname, &err ));
+	srmio_store_free( store );
+
+	if( CHECK( rname && 0 == stat( rname, &st )))
+		CHECK( st.st_size == 0 );
+
+	CHECK( have( path, a, true ));
+	CHECK( have( path, b, false ));
+	CHECK( have( path, c, false ));
+
+	/* writing it later, renamed into place */
+	if( CHECK( NULL != (store = srmio_store_new( path, &err )))){
+		if( CHECK( rname ))
+			CHECK( srmio_store_write( store, b, rname, &err ));
+		srmio_store_free( store );
+	}
+
+	if( CHECK( rname && 0 == stat( rname, &st ))){
+		CHECK( st.st_size > 0 );
+
+		/* no temporary file left */
+		snprintf( cmd, sizeof(cmd), "%s.tmp", rname );
+		CHECK( 0 != stat( cmd, &st ));
+	}
+
+	CHECK( have( path, a, true ));
+	CHECK( have( path, b, true ));
+	CHECK( have( path, c, false ));
+
+clean1:
+	free( fname );
+	free( rname );
+	srmio_data_free( a );
+	srmio_data_free( b );
+	srmio_data_free( c );
+
+	snprintf( cmd, sizeof(cmd), "rm -rf %s", path );
+	CHECK( 0 == system( cmd ));
+
+	return check_result();
+}
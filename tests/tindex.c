@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "check.h"
+
+/*
+ * time lookups and the continuous blocks maintained by the index must
+ * match a plain scan over the chunks - while chunks are appended, when
+ * timestamps aren't ascending and after chunks were modified in place.
+ */
+
+#define START	12623040000ULL
+
+static bool add( srmio_data_t data, srmio_time_t time, srmio_time_t dur )
+{
+	struct _srmio_chunk_t chunk;
+	srmio_error_t err;
+
+	memset( &chunk, 0, sizeof(chunk) );
+	chunk.time = START + time;
+	chunk.dur = dur;
+
+	if( srmio_data_add_chunk( data, &chunk, &err ))
+		return true;
+
+	fprintf( stderr, "add chunk: %s\n", err.message );
+	return false;
+}
+
+/* append n chunks, the first one at time */
+static bool add_block( srmio_data_t data, srmio_time_t time,
+	srmio_time_t dur, unsigned n )
+{
+	unsigned i;
+
+	for( i = 0; i < n; ++i ){
+		if( ! add( data, time + i * dur, dur ))
+			return false;
+	}
+
+	return true;
+}
+
+static bool before( srmio_chunk_t a, unsigned ai, srmio_chunk_t b,
+	unsigned bi )
+{
+	return a->time < b->time || ( a->time == b->time && ai < bi );
+}
+
+/*
+ * chunk covering time, the first one after it when there's none. With
+ * overlaps, the earliest covering chunk wins. Returns cused when there's
+ * no such chunk.
+ */
+static unsigned scan_find( srmio_data_t data, srmio_time_t time )
+{
+	struct _srmio_chunk_t ck, best = { 0 };
+	unsigned i, found = data->cused;
+	bool cover = false;
+
+	for( i = 0; i < data->cused; ++i ){
+		bool c;
+
+		srmio_data_chunk_get( data, i, &ck );
+		c = ck.time <= time && time < ck.time + ck.dur;
+
+		if( ! c && ck.time <= time )
+			continue;
+
+		if( found < data->cused ){
+			if( cover && ! c )
+				continue;
+			if( cover == c && ! before( &ck, i, &best, found ))
+				continue;
+		}
+
+		found = i;
+		best = ck;
+		cover = c;
+	}
+
+	return found;
+}
+
+/*
+ * lowest and highest chunk overlapping start to end (exclusive).
+ * Returns false when there's none.
+ */
+static bool scan_range( srmio_data_t data, srmio_time_t start,
+	srmio_time_t end, unsigned *first, unsigned *last )
+{
+	unsigned i;
+	bool found = false;
+
+	for( i = 0; i < data->cused; ++i ){
+		struct _srmio_chunk_t ck;
+
+		srmio_data_chunk_get( data, i, &ck );
+		if( ck.time >= end || ck.time + ck.dur <= start )
+			continue;
+
+		if( ! found )
+			*first = i;
+		*last = i;
+		found = true;
+	}
+
+	return found;
+}
+
+/*
+ * compare lookups for all times from before the data to after it
+ */
+static bool lookups_same( srmio_data_t data )
+{
+	struct _srmio_chunk_t ck;
+	srmio_time_t from, to, t, e;
+	srmio_error_t err;
+	unsigned i;
+
+	from = to = START;
+	for( i = 0; i < data->cused; ++i ){
+		srmio_data_chunk_get( data, i, &ck );
+		if( ! i || ck.time < from )
+			from = ck.time;
+		if( ! i || ck.time + ck.dur > to )
+			to = ck.time + ck.dur;
+	}
+	from -= 20;
+	to += 20;
+
+	for( t = from; t < to; ++t ){
+		unsigned want = scan_find( data, t );
+		unsigned got;
+		bool ok = srmio_data_find_time( data, t, &got, &err );
+
+		if( ok != ( want < data->cused ) || ( ok && got != want )){
+			fprintf( stderr, "find %.1f: got %u%s, want %u\n",
+				(double)(t - START) / 10, got,
+				ok ? "" : " (none)", want );
+			return false;
+		}
+	}
+
+	for( t = from; t < to; t += 7 ){
+		for( e = t +1; e < to; e += 13 ){
+			unsigned wf = 0, wl = 0, gf = 0, gl = 0;
+			bool want = scan_range( data, t, e, &wf, &wl );
+			bool ok = srmio_data_range( data, t, e, &gf, &gl, &err );
+
+			if( ok != want || ( ok && ( gf != wf || gl != wl ))){
+				fprintf( stderr, "range %.1f - %.1f: "
+					"got %u-%u%s, want %u-%u%s\n",
+					(double)(t - START) / 10,
+					(double)(e - START) / 10,
+					gf, gl, ok ? "" : " (none)",
+					wf, wl, want ? "" : " (none)" );
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * compare block list with the blocks found by a scan: a new block
+ * starts whenever a chunk doesn't start at the end of its predecessor.
+ */
+static bool blocks_same( srmio_data_t data )
+{
+	const struct _srmio_block_t *blk;
+	struct _srmio_chunk_t prev, ck = { 0 };
+	srmio_error_t err;
+	unsigned cnt, b = 0, first = 0, i;
+
+	if( NULL == (blk = srmio_data_block_list( data, &cnt, &err ))){
+		fprintf( stderr, "block list: %s\n", err.message );
+		return false;
+	}
+
+	for( i = 0; i <= data->cused; ++i ){
+		if( i < data->cused )
+			srmio_data_chunk_get( data, i, &ck );
+
+		if( i && ( i == data->cused || ck.time != prev.time + prev.dur )){
+			if( b >= cnt || blk[b].first != first
+				|| blk[b].last != i -1 ){
+
+				fprintf( stderr, "block %u: got %u-%u, want %u-%u\n",
+					b,
+					b < cnt ? blk[b].first : 0,
+					b < cnt ? blk[b].last : 0,
+					first, i -1 );
+				return false;
+			}
+
+			++b;
+			first = i;
+		}
+
+		prev = ck;
+	}
+
+	if( b != cnt ){
+		fprintf( stderr, "block count differs: %u, %u\n", cnt, b );
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * blocks maintained while appending must match the ones of a rebuilt
+ * index
+ */
+static void check_blocks( void )
+{
+	srmio_error_t err;
+	srmio_data_t data;
+	srmio_chunk_t ck;
+	unsigned cnt, i;
+
+	if( ! CHECK( NULL != (data = srmio_data_new( &err ))))
+		return;
+
+	CHECK( NULL == srmio_data_block_list( data, &cnt, &err ));
+
+	CHECK( add_block( data, 0, 10, 20 ));
+	CHECK( blocks_same( data ));
+
+	/* gap starts a new block */
+	CHECK( add_block( data, 255, 10, 10 ));
+	CHECK( blocks_same( data ));
+
+	/* recint change without gap extends it */
+	CHECK( add_block( data, 355, 20, 10 ));
+	CHECK( add_block( data, 555, 5, 10 ));
+	CHECK( blocks_same( data ));
+	srmio_data_block_list( data, &cnt, &err );
+	CHECK( cnt == 2 );
+
+	/* overlap */
+	CHECK( add_block( data, 500, 10, 5 ));
+	CHECK( blocks_same( data ));
+
+	/* same after rebuild */
+	srmio_data_changed( data );
+	CHECK( blocks_same( data ));
+
+	/* close the gap in place */
+	for( i = 20; i < 40; ++i ){
+		if( ! CHECK( NULL != (ck = srmio_data_chunk( data, i, &err ))))
+			goto clean1;
+		ck->time -= 55;
+	}
+	srmio_data_changed( data );
+	CHECK( blocks_same( data ));
+
+	/* and keep appending to the rebuilt index */
+	CHECK( add_block( data, 550, 10, 3 ));
+	CHECK( blocks_same( data ));
+
+clean1:
+	srmio_data_free( data );
+}
+
+/*
+ * index is kept while chunks are appended after gaps and recint
+ * changes, then falls back to sorting for non-ascending timestamps
+ */
+static void check_append( void )
+{
+	srmio_error_t err;
+	srmio_data_t data;
+	unsigned c;
+
+	if( ! CHECK( NULL != (data = srmio_data_new( &err ))))
+		return;
+
+	CHECK( ! srmio_data_find_time( data, START, &c, &err ));
+
+	CHECK( add_block( data, 0, 10, 20 ));
+	CHECK( lookups_same( data ));
+
+	/* gap */
+	CHECK( add_block( data, 255, 10, 10 ));
+	CHECK( lookups_same( data ));
+
+	/* recint change without gap */
+	CHECK( add_block( data, 355, 20, 10 ));
+	CHECK( lookups_same( data ));
+
+	/* gap, recint change */
+	CHECK( add_block( data, 600, 5, 7 ));
+	CHECK( lookups_same( data ));
+
+	/* back in time, overlapping earlier chunks */
+	CHECK( add_block( data, 130, 5, 12 ));
+	CHECK( lookups_same( data ));
+
+	/* same time as existing chunk */
+	CHECK( add( data, 20, 5 ));
+	CHECK( lookups_same( data ));
+
+	srmio_data_free( data );
+}
+
+/* non-ascending data read in one go */
+static void check_unsorted( void )
+{
+	srmio_error_t err;
+	srmio_data_t data, copy;
+
+	if( ! CHECK( NULL != (data = srmio_data_new( &err ))))
+		return;
+
+	CHECK( add_block( data, 500, 10, 30 ));
+	CHECK( add_block( data, 0, 10, 30 ));
+	CHECK( add_block( data, 250, 10, 30 ));
+	CHECK( add_block( data, 245, 10, 5 ));
+
+	/* index built on first lookup */
+	if( CHECK( NULL != (copy = check_copy( data, &err )))){
+		CHECK( lookups_same( copy ));
+		srmio_data_free( copy );
+	}
+
+	CHECK( lookups_same( data ));
+	srmio_data_free( data );
+}
+
+/*
+ * move chunk times in place, the index must follow after
+ * srmio_data_changed()
+ */
+static void check_changed( void )
+{
+	srmio_error_t err;
+	srmio_data_t data;
+	srmio_chunk_t ck;
+	unsigned c, i;
+
+	if( ! CHECK( NULL != (data = srmio_data_new( &err ))))
+		return;
+
+	CHECK( add_block( data, 0, 10, 40 ));
+	CHECK( lookups_same( data ));
+
+	/* open a gap in the middle */
+	for( i = 20; i < data->cused; ++i ){
+		if( ! CHECK( NULL != (ck = srmio_data_chunk( data, i, &err ))))
+			goto clean1;
+		ck->time += 1000;
+	}
+	srmio_data_changed( data );
+
+	CHECK( srmio_data_find_time( data, START + 250, &c, &err ) && c == 20 );
+	CHECK( lookups_same( data ));
+
+	/* make it non-ascending */
+	if( CHECK( NULL != (ck = srmio_data_chunk( data, 30, &err )))){
+		ck->time = START + 50;
+		srmio_data_changed( data );
+		CHECK( lookups_same( data ));
+	}
+
+	/* and ascending again */
+	if( CHECK( NULL != (ck = srmio_data_chunk( data, 30, &err )))){
+		ck->time = START + 1300;
+		srmio_data_changed( data );
+		CHECK( lookups_same( data ));
+	}
+
+clean1:
+	srmio_data_free( data );
+}
+
+int main( void )
+{
+	check_append();
+	check_unsorted();
+	check_changed();
+	check_blocks();
+
+	return check_result();
+}
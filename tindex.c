@@ -0,0 +1,552 @@
+/*
+ * Copyright (c) 2008 Rainer Clasen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms described in the file LICENSE included in this
+ * distribution.
+ *
+ */
+
+#include "common.h"
+
+/*
+ * time index over a data set's chunks.
+ *
+ * Chunks are grouped into blocks with continuous timestamps and a
+ * common recint. When the blocks are in ascending order, a lookup is
+ * a binary search over the blocks plus some arithmetic within the
+ * block. Otherwise the index falls back to a list of chunks sorted by
+ * time.
+ *
+ * The blocks are maintained by srmio_data_add_chunkp(). In addition it
+ * tracks the continuous blocks - ignoring recint changes - as reported
+ * by srmio_data_blocks().
+ */
+
+struct _srmio_tblock_t {
+	srmio_time_t	start;
+	srmio_time_t	recint;
+	unsigned	first;	/* chunk index */
+	unsigned	cnt;
+};
+
+struct _srmio_tindex_t {
+	struct _srmio_tblock_t	*block;
+	unsigned		bused;
+	unsigned		bavail;
+	bool			ascending;
+
+	/* continuous blocks */
+	struct _srmio_block_t	*cont;
+	unsigned		cused;
+	unsigned		cavail;
+
+	/* fallback for non-ascending blocks, built on demand */
+	unsigned		*order;	/* chunk indices sorted by time */
+	srmio_time_t		*otime;	/* their time */
+	srmio_time_t		*oend;	/* latest end up to this position */
+};
+
+/*
+ * release time index
+ */
+void srmio_tindex_free( srmio_tindex_t idx )
+{
+	if( ! idx )
+		return;
+
+	free( idx->block );
+	free( idx->cont );
+	free( idx->order );
+	free( idx->otime );
+	free( idx->oend );
+	free( idx );
+}
+
+struct _srmio_tindex_sort_t {
+	srmio_time_t	time;
+	srmio_time_t	end;
+	unsigned	i;
+};
+
+static int _srmio_tindex_cmp( const void *a, const void *b )
+{
+	const struct _srmio_tindex_sort_t *sa = a;
+	const struct _srmio_tindex_sort_t *sb = b;
+
+	if( sa->time != sb->time )
+		return sa->time < sb->time ? -1 : 1;
+
+	if( sa->i != sb->i )
+		return sa->i < sb->i ? -1 : 1;
+
+	return 0;
+}
+
+/*
+ * build list of chunks sorted by time
+ */
+static bool _srmio_tindex_sort( srmio_data_t data, srmio_tindex_t idx,
+	srmio_error_t *err )
+{
+	struct _srmio_tindex_sort_t *sort;
+	unsigned i;
+
+	if( idx->order )
+		return true;
+
+	if( NULL == (sort = malloc( data->cused
+		* sizeof(struct _srmio_tindex_sort_t) ))){
+
+		srmio_error_errno( err, "sort chunks" );
+		return false;
+	}
+
+	for( i = 0; i < data->cused; ++i ){
+		struct _srmio_chunk_t chunk;
+
+		srmio_data_chunk_get( data, i, &chunk );
+		sort[i].time = chunk.time;
+		sort[i].end = chunk.time + chunk.dur;
+		sort[i].i = i;
+	}
+
+	qsort( sort, data->cused, sizeof(struct _srmio_tindex_sort_t),
+		_srmio_tindex_cmp );
+
+	if( NULL == (idx->order = malloc( data->cused * sizeof(unsigned) ))){
+		srmio_error_errno( err, "sort chunks" );
+		goto clean1;
+	}
+
+	if( NULL == (idx->otime = malloc( data->cused * sizeof(srmio_time_t) ))){
+		srmio_error_errno( err, "sort chunks" );
+		goto clean2;
+	}
+
+	if( NULL == (idx->oend = malloc( data->cused * sizeof(srmio_time_t) ))){
+		srmio_error_errno( err, "sort chunks" );
+		goto clean3;
+	}
+
+	for( i = 0; i < data->cused; ++i ){
+		idx->order[i] = sort[i].i;
+		idx->otime[i] = sort[i].time;
+		idx->oend[i] = sort[i].end;
+		if( i && idx->oend[i-1] > idx->oend[i] )
+			idx->oend[i] = idx->oend[i-1];
+	}
+
+	free( sort );
+	return true;
+
+clean3:
+	free( idx->otime );
+	idx->otime = NULL;
+
+clean2:
+	free( idx->order );
+	idx->order = NULL;
+
+clean1:
+	free( sort );
+	return false;
+}
+
+/*
+ * add chunk i to index
+ */
+static bool _srmio_tindex_add( srmio_tindex_t idx, unsigned i,
+	srmio_chunk_t chunk, srmio_error_t *err )
+{
+	struct _srmio_tblock_t *blk = NULL;
+	srmio_time_t end = 0;
+
+	/* sorted list doesn't know about this chunk */
+	free( idx->order );
+	idx->order = NULL;
+	free( idx->otime );
+	idx->otime = NULL;
+	free( idx->oend );
+	idx->oend = NULL;
+
+	if( idx->bused ){
+		blk = &idx->block[idx->bused -1];
+		end = blk->start + blk->cnt * blk->recint;
+	}
+
+	/* continuous blocks */
+	if( blk && chunk->time == end ){
+		idx->cont[idx->cused -1].last = i;
+
+	} else {
+		if( idx->cused >= idx->cavail ){
+			struct _srmio_block_t *tmp;
+			unsigned avail = idx->cavail ? 2 * idx->cavail : 16;
+
+			if( NULL == (tmp = realloc( idx->cont, avail
+				* sizeof(struct _srmio_block_t) ))){
+
+				srmio_error_errno( err, "time index blocks" );
+				return false;
+			}
+
+			idx->cont = tmp;
+			idx->cavail = avail;
+		}
+
+		idx->cont[idx->cused].first = i;
+		idx->cont[idx->cused].last = i;
+		++idx->cused;
+	}
+
+	/* blocks with common recint */
+	if( blk && chunk->time == end && chunk->dur == blk->recint ){
+		++blk->cnt;
+		return true;
+	}
+
+	if( blk && chunk->time < end )
+		idx->ascending = false;
+
+	if( idx->bused >= idx->bavail ){
+		struct _srmio_tblock_t *tmp;
+		unsigned avail = idx->bavail ? 2 * idx->bavail : 16;
+
+		if( NULL == (tmp = realloc( idx->block, avail
+			* sizeof(struct _srmio_tblock_t) ))){
+
+			srmio_error_errno( err, "time index blocks" );
+			return false;
+		}
+
+		idx->block = tmp;
+		idx->bavail = avail;
+	}
+
+	blk = &idx->block[idx->bused++];
+	blk->start = chunk->time;
+	blk->recint = chunk->dur;
+	blk->first = i;
+	blk->cnt = 1;
+
+	return true;
+}
+
+/*
+ * allocate empty time index
+ */
+static srmio_tindex_t _srmio_tindex_new( srmio_error_t *err )
+{
+	srmio_tindex_t idx;
+
+	if( NULL == (idx = malloc( sizeof(struct _srmio_tindex_t) ))){
+		srmio_error_errno( err, "new time index" );
+		return NULL;
+	}
+	memset( idx, 0, sizeof(struct _srmio_tindex_t) );
+	idx->ascending = true;
+
+	return idx;
+}
+
+/*
+ * update index for the chunk that was just appended to data. The index
+ * is dropped (and rebuilt on demand) when this fails.
+ */
+void srmio_tindex_added( srmio_data_t data )
+{
+	unsigned i = data->cused -1;
+
+	if( ! data->tindex ){
+		/* index for existing chunks is built on demand */
+		if( i )
+			return;
+
+		if( NULL == (data->tindex = _srmio_tindex_new( NULL )))
+			return;
+	}
+
+	if( ! _srmio_tindex_add( data->tindex, i, data->chunks[i], NULL )){
+		srmio_tindex_free( data->tindex );
+		data->tindex = NULL;
+	}
+}
+
+/*
+ * get time index, build it when necessary
+ */
+static srmio_tindex_t _srmio_tindex_get( srmio_data_t data,
+	srmio_error_t *err )
+{
+	srmio_tindex_t idx;
+	unsigned i;
+
+	if( data->tindex )
+		return data->tindex;
+
+	if( NULL == (idx = _srmio_tindex_new( err )))
+		return NULL;
+
+	for( i = 0; i < data->cused; ++i ){
+		struct _srmio_chunk_t chunk;
+
+		srmio_data_chunk_get( data, i, &chunk );
+		if( ! _srmio_tindex_add( idx, i, &chunk, err ) )
+			goto clean1;
+	}
+
+	DPRINTF( "%u blocks, %sascending", idx->bused,
+		idx->ascending ? "" : "not " );
+
+	data->tindex = idx;
+	return idx;
+
+clean1:
+	srmio_tindex_free( idx );
+	return NULL;
+}
+
+/*
+ * find chunk covering time using blocks. Returns data->cused when
+ * there's no chunk at or after time.
+ */
+static unsigned _srmio_tindex_blocks( srmio_tindex_t idx, srmio_time_t time )
+{
+	struct _srmio_tblock_t *blk;
+	unsigned lo = 0, hi = idx->bused;
+	srmio_time_t off;
+
+	/* find last block starting at or before time */
+	while( lo < hi ){
+		unsigned mid = lo + (hi - lo) / 2;
+
+		if( idx->block[mid].start <= time )
+			lo = mid +1;
+		else
+			hi = mid;
+	}
+
+	if( ! lo )
+		return idx->block[0].first;
+
+	blk = &idx->block[lo -1];
+	off = blk->recint ? (time - blk->start) / blk->recint : 0;
+	if( off < blk->cnt )
+		return blk->first + off;
+
+	/* in gap after block */
+	return blk->first + blk->cnt;
+}
+
+/*
+ * find chunk covering time using sorted list. Returns position in sorted
+ * list. For overlapping chunks, the first one covering time is picked.
+ */
+static unsigned _srmio_tindex_sorted( srmio_tindex_t idx, unsigned cnt,
+	srmio_time_t time )
+{
+	unsigned lo = 0, hi = cnt;
+	unsigned after;
+
+	/* first chunk starting after time */
+	while( lo < hi ){
+		unsigned mid = lo + (hi - lo) / 2;
+
+		if( idx->otime[mid] <= time )
+			lo = mid +1;
+		else
+			hi = mid;
+	}
+	after = lo;
+
+	/* first chunk ending after time. As oend is the latest end up to
+	 * this position, this chunk itself does */
+	lo = 0;
+	hi = after;
+	while( lo < hi ){
+		unsigned mid = lo + (hi - lo) / 2;
+
+		if( idx->oend[mid] <= time )
+			lo = mid +1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * find chunk covering the specified time. When time is within a gap,
+ * the first chunk after it is returned.
+ *
+ * returns false on error or when there's no data at or after time
+ */
+bool srmio_data_find_time( srmio_data_t data, srmio_time_t time,
+	unsigned *chunk, srmio_error_t *err )
+{
+	srmio_tindex_t idx;
+	unsigned found;
+
+	assert( data );
+	assert( chunk );
+
+	if( ! data->cused ){
+		srmio_error_set( err, "no data available" );
+		return false;
+	}
+
+	if( NULL == (idx = _srmio_tindex_get( data, err )))
+		return false;
+
+	if( idx->ascending ){
+		found = _srmio_tindex_blocks( idx, time );
+
+	} else {
+		if( ! _srmio_tindex_sort( data, idx, err ) )
+			return false;
+
+		found = _srmio_tindex_sorted( idx, data->cused, time );
+		if( found < data->cused )
+			found = idx->order[found];
+	}
+
+	if( found >= data->cused ){
+		srmio_error_set( err, "no data at %.1f", (double)time / 10 );
+		return false;
+	}
+
+	*chunk = found;
+	return true;
+}
+
+/*
+ * find chunks covering the time range start to end (exclusive).
+ *
+ * For data with non-ascending timestamps "first" and "last" are the
+ * lowest and highest chunk index within the time range - chunks
+ * between them might be outside.
+ *
+ * returns false on error or when there's no data within the range
+ */
+bool srmio_data_range( srmio_data_t data, srmio_time_t start,
+	srmio_time_t end, unsigned *first, unsigned *last, srmio_error_t *err )
+{
+	srmio_tindex_t idx;
+	unsigned f, l;
+
+	assert( data );
+	assert( first );
+	assert( last );
+
+	if( ! data->cused ){
+		srmio_error_set( err, "no data available" );
+		return false;
+	}
+
+	if( start >= end ){
+		srmio_error_set( err, "empty time range" );
+		return false;
+	}
+
+	if( NULL == (idx = _srmio_tindex_get( data, err )))
+		return false;
+
+	if( idx->ascending ){
+		f = _srmio_tindex_blocks( idx, start );
+		l = _srmio_tindex_blocks( idx, end -1 );
+
+		/* end within gap or after data */
+		if( l >= data->cused ){
+			l = data->cused -1;
+
+		} else {
+			struct _srmio_chunk_t chunk;
+
+			srmio_data_chunk_get( data, l, &chunk );
+			if( chunk.time > end -1 ){
+				if( ! l ){
+					l = data->cused; /* nothing found */
+				} else {
+					--l;
+				}
+			}
+		}
+
+		if( f >= data->cused || l >= data->cused || f > l )
+			goto none;
+
+	} else {
+		unsigned s, e;
+
+		if( ! _srmio_tindex_sort( data, idx, err ) )
+			return false;
+
+		s = _srmio_tindex_sorted( idx, data->cused, start );
+
+		/* first position starting at or after end */
+		for( e = s; e < data->cused && idx->otime[e] < end; ++e );
+
+		if( s >= e )
+			goto none;
+
+		f = data->cused;
+		l = 0;
+		for( ; s < e; ++s ){
+			struct _srmio_chunk_t chunk;
+
+			/* started earlier, might be over already */
+			if( idx->otime[s] < start ){
+				srmio_data_chunk_get( data, idx->order[s], &chunk );
+				if( chunk.time + chunk.dur <= start )
+					continue;
+			}
+
+			if( idx->order[s] < f )
+				f = idx->order[s];
+			if( idx->order[s] > l )
+				l = idx->order[s];
+		}
+
+		if( f >= data->cused )
+			goto none;
+	}
+
+	*first = f;
+	*last = l;
+	return true;
+
+none:
+	srmio_error_set( err, "no data between %.1f and %.1f",
+		(double)start / 10, (double)end / 10 );
+	return false;
+}
+
+/*
+ * get list of blocks with continuous timestamps. The list is owned by
+ * data and valid until chunks are added or modified.
+ *
+ * on success pointer to list is returned and cnt is set to the number
+ * of blocks.
+ * returns NULL on error.
+ */
+const struct _srmio_block_t *srmio_data_block_list( srmio_data_t data,
+	unsigned *cnt, srmio_error_t *err )
+{
+	srmio_tindex_t idx;
+
+	assert( data );
+	assert( cnt );
+
+	if( ! data->cused ){
+		srmio_error_set( err, "no data available");
+		return NULL;
+	}
+
+	if( NULL == (idx = _srmio_tindex_get( data, err )))
+		return NULL;
+
+	*cnt = idx->cused;
+	return idx->cont;
+}
+